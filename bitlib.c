@@ -0,0 +1,877 @@
+/*
+ * <Eugene Yu Jun Hao 1900094810>
+ * bitlib.c - Array versions of the Data Lab bit puzzles
+ *
+ * Details:
+ * 1. Reference - the Data Lab solutions (bang, leastBitPos, fitsBits,
+ *    ilog2, rotateLeft, modThree) are kept verbatim as ref_* and are the
+ *    definition of every other version, including their results for
+ *    inputs the lab leaves open (ilog2 of x <= 0 is 31 for x < 0, 0 for 0).
+ * 2. Levels - SSE2, AVX2 and AVX-512 kernels process 4/8/16 ints per
+ *    step and finish the tail with the reference. The best level the
+ *    CPU supports is chosen on first use (like mm_init in malloclab).
+ * 3. Tricks -
+ *    ilog2: AVX-512 uses vplzcntd. Otherwise the value is made exact in
+ *           a float (shift right 8 when x >= 2^24) and the exponent
+ *           field is read back.
+ *    modThree: the same digit-sum folds as the lab (2^16, 2^8, 2^4,
+ *           2^2 are all 1 mod 3), on |x| as unsigned so Tmin needs no
+ *           special case, then the sign of x is put back.
+ * 4. bl_check - compares every level against the reference, over all
+ *    2^32 inputs when stride is 1 (and every shift for fitsBits and
+ *    rotateLeft), split over threads. The reference itself is checked
+ *    by dlcheck.c against plain C semantics.
+ *    bl_bench - ns/op of every routine at every level, reference
+ *    included, to catch speed regressions next to correctness ones.
+ * 5. Remainders - modThree generalized to any divisor d >= 2.
+ *    Scalar: Lemire's fastmod (two multiplies) and x * M <= M - 1 for
+ *           divisibility; BL_DEFINE_MOD(d) bakes d in at compile time.
+ *    Vector: the libdivide branch-free quotient t = mulhi(x, m),
+ *           q = (t + ((x - t) >> 1)) >> (l - 1), r = x - q * d, which
+ *           needs only 32x32 multiplies. Divisibility multiplies by the
+ *           inverse of the odd part of d and compares after a rotate.
+ *    Digit-sum folding only works for d dividing 2^k - 1 and takes more
+ *    steps than the multiply, so it is left to modThree.
+ *
+ * Build: gcc -O2 -pthread -c bitlib.c (no -m flags needed, kernels carry
+ * their own target attributes).
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bitlib.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BL_X86
+#include <immintrin.h>
+#define SSE2   __attribute__((target("sse2")))
+#define AVX2   __attribute__((target("avx2")))
+#define AVX512 __attribute__((target("avx512f,avx512cd")))
+#endif
+
+typedef void unary_t(const int *x, int *out, size_t n);
+typedef void binary_t(const int *x, int y, int *out, size_t n);
+typedef void mod_t(const int *x, const struct bl_divisor *dv, int *out, size_t n);
+typedef void umod_t(const unsigned *x, const struct bl_divisor *dv,
+                    unsigned *out, size_t n);
+typedef void divisible_t(const unsigned *x, const struct bl_divisor *dv,
+                         int *out, size_t n);
+
+struct bl_kernels {
+    unary_t *bang;
+    unary_t *leastBitPos;
+    binary_t *fitsBits;
+    unary_t *ilog2;
+    binary_t *rotateLeft;
+    unary_t *modThree;
+    mod_t *mod;
+    umod_t *umod;
+    divisible_t *divisible;
+};
+
+static struct bl_kernels *impl = 0;  /* kernels in use */
+static int level = -1;               /* level in use */
+static int maxlevel = -1;            /* best level of this CPU */
+
+/*=========================== REFERENCE (datalab.c) ===========================*/
+/* The lab assumes wrapping 2s complement (e.g. ~x+1 of Tmin in modThree),
+ * and writes a&b | c&d */
+#pragma GCC push_options
+#pragma GCC optimize ("wrapv")
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wparentheses"
+
+static int ref_bang(int x) {
+  int y = x & (~x+1);
+  y = (~y+1) & (1<<31);
+  y = y>>31;
+  y = y&1;
+  return y ^ 1;
+}
+
+static int ref_leastBitPos(int x) {
+  return x & (~x + 1);
+}
+
+static int ref_fitsBits(int x, int n) {
+  int n1 = 32 + ~n + 1;
+  int x1 = x << n1;
+  x1 = x1 >> n1;
+  return !(x1^x);
+}
+
+static int ref_ilog2(int x) {
+  int x1 = !!(x >> 16)<<4;
+  int x2 = !!(x >> x1 >> 8)<<3;
+  int x3 = !!(x >> x1 >> x2 >> 4)<<2;
+  int x4 = !!(x >> x1 >> x2 >> x3 >> 2)<<1;
+  int x5 = !!(x >> x1 >> x2 >> x3 >> x4 >> 1);
+  return x1 + x2 + x3 + x4 + x5;
+}
+
+static int ref_rotateLeft(int x, int n) {
+  return (x << n) | ((x>>(33+~n)) & ~(~0<<n));
+}
+
+static int ref_modThree(int x) {
+    int res = 0;
+    int isTmin = !!x & !(x^(~x+1));
+    int s = (x>>31);
+    int mask = (0xff<<8)+0xff;
+    int x1 = s&(~x+1) | ~s&x;
+    res = x1;
+    res = (res>>16) + (res&mask);
+    res = (res>>16) + (res&mask);
+    res = (res>>8) + (res&0xff);
+    res = (res>>8) + (res&0xff);
+    res = (res>>4) + (res&0xf);
+    res = (res>>4) + (res&0xf);
+    res = (res>>2) + (res&0x3);
+    res = (res>>2) + (res&0x3);
+    res = res + !(res^3) + isTmin;
+    res = res&3;
+    res = s&(~res+1) | ~s&res;
+    return res;
+}
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+
+/*=========================== SCALAR ===========================*/
+
+static void scalar_bang(const int *x, int *out, size_t n){
+    size_t i;
+    for(i = 0; i < n; i++) out[i] = ref_bang(x[i]);
+}
+
+static void scalar_leastBitPos(const int *x, int *out, size_t n){
+    size_t i;
+    for(i = 0; i < n; i++) out[i] = ref_leastBitPos(x[i]);
+}
+
+static void scalar_fitsBits(const int *x, int bits, int *out, size_t n){
+    size_t i;
+    for(i = 0; i < n; i++) out[i] = ref_fitsBits(x[i], bits);
+}
+
+static void scalar_ilog2(const int *x, int *out, size_t n){
+    size_t i;
+    for(i = 0; i < n; i++) out[i] = ref_ilog2(x[i]);
+}
+
+static void scalar_rotateLeft(const int *x, int r, int *out, size_t n){
+    size_t i;
+    for(i = 0; i < n; i++) out[i] = ref_rotateLeft(x[i], r);
+}
+
+static void scalar_modThree(const int *x, int *out, size_t n){
+    size_t i;
+    for(i = 0; i < n; i++) out[i] = ref_modThree(x[i]);
+}
+
+static void scalar_mod(const int *x, const struct bl_divisor *dv,
+                       int *out, size_t n){
+    size_t i;
+    for(i = 0; i < n; i++) out[i] = bl_fastmod(x[i], dv->M, dv->d);
+}
+
+static void scalar_umod(const unsigned *x, const struct bl_divisor *dv,
+                        unsigned *out, size_t n){
+    size_t i;
+    for(i = 0; i < n; i++) out[i] = bl_fastumod(x[i], dv->M, dv->d);
+}
+
+static void scalar_divisible(const unsigned *x, const struct bl_divisor *dv,
+                             int *out, size_t n){
+    size_t i;
+    for(i = 0; i < n; i++) out[i] = bl_fastdivisible(x[i], dv->M);
+}
+
+static struct bl_kernels scalar_kernels = {
+    scalar_bang, scalar_leastBitPos, scalar_fitsBits,
+    scalar_ilog2, scalar_rotateLeft, scalar_modThree,
+    scalar_mod, scalar_umod, scalar_divisible
+};
+
+#ifdef BL_X86
+/*=========================== SSE2 (4 lanes) ===========================*/
+
+#define LOAD128(p)      _mm_loadu_si128((const __m128i *)(p))
+#define STORE128(p, v)  _mm_storeu_si128((__m128i *)(p), (v))
+
+SSE2 static void sse2_bang(const int *x, int *out, size_t n){
+    __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi32(1);
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4){
+        __m128i v = LOAD128(x + i);
+        STORE128(out + i, _mm_and_si128(_mm_cmpeq_epi32(v, zero), one));
+    }
+    scalar_bang(x + i, out + i, n - i);
+}
+
+SSE2 static void sse2_leastBitPos(const int *x, int *out, size_t n){
+    __m128i zero = _mm_setzero_si128();
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4){
+        __m128i v = LOAD128(x + i);
+        STORE128(out + i, _mm_and_si128(v, _mm_sub_epi32(zero, v)));
+    }
+    scalar_leastBitPos(x + i, out + i, n - i);
+}
+
+SSE2 static void sse2_fitsBits(const int *x, int bits, int *out, size_t n){
+    __m128i one = _mm_set1_epi32(1), c = _mm_cvtsi32_si128(32 - bits);
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4){
+        __m128i v = LOAD128(x + i);
+        __m128i t = _mm_sra_epi32(_mm_sll_epi32(v, c), c);
+        STORE128(out + i, _mm_and_si128(_mm_cmpeq_epi32(t, v), one));
+    }
+    scalar_fitsBits(x + i, bits, out + i, n - i);
+}
+
+SSE2 static void sse2_ilog2(const int *x, int *out, size_t n){
+    __m128i zero = _mm_setzero_si128(), eight = _mm_set1_epi32(8);
+    __m128i bias = _mm_set1_epi32(127);
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4){
+        __m128i v = LOAD128(x + i);
+        /* x >= 2^24 (unsigned): use x >> 8 so the float is exact */
+        __m128i hi = _mm_cmpgt_epi32(_mm_srli_epi32(v, 24), zero);
+        __m128i y = _mm_or_si128(_mm_and_si128(hi, _mm_srli_epi32(v, 8)),
+                                 _mm_andnot_si128(hi, v));
+        __m128i e = _mm_srli_epi32(_mm_castps_si128(_mm_cvtepi32_ps(y)), 23);
+        e = _mm_add_epi32(_mm_sub_epi32(e, bias), _mm_and_si128(hi, eight));
+        STORE128(out + i, _mm_andnot_si128(_mm_cmpeq_epi32(y, zero), e));
+    }
+    scalar_ilog2(x + i, out + i, n - i);
+}
+
+SSE2 static void sse2_rotateLeft(const int *x, int r, int *out, size_t n){
+    __m128i cl = _mm_cvtsi32_si128(r), cr = _mm_cvtsi32_si128(32 - r);
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4){
+        __m128i v = LOAD128(x + i);
+        STORE128(out + i, _mm_or_si128(_mm_sll_epi32(v, cl),
+                                       _mm_srl_epi32(v, cr)));
+    }
+    scalar_rotateLeft(x + i, r, out + i, n - i);
+}
+
+SSE2 static void sse2_modThree(const int *x, int *out, size_t n){
+    __m128i m16 = _mm_set1_epi32(0xffff), m8 = _mm_set1_epi32(0xff);
+    __m128i m4 = _mm_set1_epi32(0xf), m2 = _mm_set1_epi32(0x3);
+    __m128i two = _mm_set1_epi32(2);
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4){
+        __m128i v = LOAD128(x + i);
+        __m128i s = _mm_srai_epi32(v, 31);
+        __m128i a = _mm_sub_epi32(_mm_xor_si128(v, s), s);
+        a = _mm_add_epi32(_mm_srli_epi32(a, 16), _mm_and_si128(a, m16));
+        a = _mm_add_epi32(_mm_srli_epi32(a, 16), _mm_and_si128(a, m16));
+        a = _mm_add_epi32(_mm_srli_epi32(a, 8), _mm_and_si128(a, m8));
+        a = _mm_add_epi32(_mm_srli_epi32(a, 8), _mm_and_si128(a, m8));
+        a = _mm_add_epi32(_mm_srli_epi32(a, 4), _mm_and_si128(a, m4));
+        a = _mm_add_epi32(_mm_srli_epi32(a, 4), _mm_and_si128(a, m4));
+        a = _mm_add_epi32(_mm_srli_epi32(a, 2), _mm_and_si128(a, m2));
+        a = _mm_add_epi32(_mm_srli_epi32(a, 2), _mm_and_si128(a, m2));
+        /* a in [0, 4]: 3 -> 0, 4 -> 1 */
+        a = _mm_sub_epi32(a, _mm_and_si128(_mm_cmpgt_epi32(a, two), m2));
+        STORE128(out + i, _mm_sub_epi32(_mm_xor_si128(a, s), s));
+    }
+    scalar_modThree(x + i, out + i, n - i);
+}
+
+static struct bl_kernels sse2_kernels = {
+    sse2_bang, sse2_leastBitPos, sse2_fitsBits,
+    sse2_ilog2, sse2_rotateLeft, sse2_modThree,
+    scalar_mod, scalar_umod, scalar_divisible   /* no 32-bit mullo in SSE2 */
+};
+
+/*=========================== AVX2 (8 lanes) ===========================*/
+
+#define LOAD256(p)      _mm256_loadu_si256((const __m256i *)(p))
+#define STORE256(p, v)  _mm256_storeu_si256((__m256i *)(p), (v))
+
+AVX2 static void avx2_bang(const int *x, int *out, size_t n){
+    __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi32(1);
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8){
+        __m256i v = LOAD256(x + i);
+        STORE256(out + i, _mm256_and_si256(_mm256_cmpeq_epi32(v, zero), one));
+    }
+    scalar_bang(x + i, out + i, n - i);
+}
+
+AVX2 static void avx2_leastBitPos(const int *x, int *out, size_t n){
+    __m256i zero = _mm256_setzero_si256();
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8){
+        __m256i v = LOAD256(x + i);
+        STORE256(out + i, _mm256_and_si256(v, _mm256_sub_epi32(zero, v)));
+    }
+    scalar_leastBitPos(x + i, out + i, n - i);
+}
+
+AVX2 static void avx2_fitsBits(const int *x, int bits, int *out, size_t n){
+    __m256i one = _mm256_set1_epi32(1);
+    __m128i c = _mm_cvtsi32_si128(32 - bits);
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8){
+        __m256i v = LOAD256(x + i);
+        __m256i t = _mm256_sra_epi32(_mm256_sll_epi32(v, c), c);
+        STORE256(out + i, _mm256_and_si256(_mm256_cmpeq_epi32(t, v), one));
+    }
+    scalar_fitsBits(x + i, bits, out + i, n - i);
+}
+
+AVX2 static void avx2_ilog2(const int *x, int *out, size_t n){
+    __m256i zero = _mm256_setzero_si256(), eight = _mm256_set1_epi32(8);
+    __m256i bias = _mm256_set1_epi32(127);
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8){
+        __m256i v = LOAD256(x + i);
+        __m256i hi = _mm256_cmpgt_epi32(_mm256_srli_epi32(v, 24), zero);
+        __m256i y = _mm256_blendv_epi8(v, _mm256_srli_epi32(v, 8), hi);
+        __m256i e = _mm256_srli_epi32(
+            _mm256_castps_si256(_mm256_cvtepi32_ps(y)), 23);
+        e = _mm256_add_epi32(_mm256_sub_epi32(e, bias),
+                             _mm256_and_si256(hi, eight));
+        STORE256(out + i, _mm256_max_epi32(e, zero));
+    }
+    scalar_ilog2(x + i, out + i, n - i);
+}
+
+AVX2 static void avx2_rotateLeft(const int *x, int r, int *out, size_t n){
+    __m128i cl = _mm_cvtsi32_si128(r), cr = _mm_cvtsi32_si128(32 - r);
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8){
+        __m256i v = LOAD256(x + i);
+        STORE256(out + i, _mm256_or_si256(_mm256_sll_epi32(v, cl),
+                                          _mm256_srl_epi32(v, cr)));
+    }
+    scalar_rotateLeft(x + i, r, out + i, n - i);
+}
+
+AVX2 static void avx2_modThree(const int *x, int *out, size_t n){
+    __m256i m16 = _mm256_set1_epi32(0xffff), m8 = _mm256_set1_epi32(0xff);
+    __m256i m4 = _mm256_set1_epi32(0xf), m2 = _mm256_set1_epi32(0x3);
+    __m256i two = _mm256_set1_epi32(2);
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8){
+        __m256i v = LOAD256(x + i);
+        __m256i a = _mm256_abs_epi32(v);
+        a = _mm256_add_epi32(_mm256_srli_epi32(a, 16), _mm256_and_si256(a, m16));
+        a = _mm256_add_epi32(_mm256_srli_epi32(a, 16), _mm256_and_si256(a, m16));
+        a = _mm256_add_epi32(_mm256_srli_epi32(a, 8), _mm256_and_si256(a, m8));
+        a = _mm256_add_epi32(_mm256_srli_epi32(a, 8), _mm256_and_si256(a, m8));
+        a = _mm256_add_epi32(_mm256_srli_epi32(a, 4), _mm256_and_si256(a, m4));
+        a = _mm256_add_epi32(_mm256_srli_epi32(a, 4), _mm256_and_si256(a, m4));
+        a = _mm256_add_epi32(_mm256_srli_epi32(a, 2), _mm256_and_si256(a, m2));
+        a = _mm256_add_epi32(_mm256_srli_epi32(a, 2), _mm256_and_si256(a, m2));
+        a = _mm256_sub_epi32(a, _mm256_and_si256(_mm256_cmpgt_epi32(a, two), m2));
+        STORE256(out + i, _mm256_sign_epi32(a, v));
+    }
+    scalar_modThree(x + i, out + i, n - i);
+}
+
+/* x % d for unsigned lanes: q = (t + ((x - t) >> 1)) >> (l - 1), t = mulhi(x, m) */
+AVX2 static inline __m256i avx2_umod_v(__m256i x, __m256i m, __m128i sh, __m256i d){
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(x, m), 32);
+    __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), m);
+    __m256i t = _mm256_blend_epi32(even, odd, 0xAA);
+    __m256i q = _mm256_srl_epi32(_mm256_add_epi32(t,
+                    _mm256_srli_epi32(_mm256_sub_epi32(x, t), 1)), sh);
+    return _mm256_sub_epi32(x, _mm256_mullo_epi32(q, d));
+}
+
+AVX2 static void avx2_mod(const int *x, const struct bl_divisor *dv,
+                          int *out, size_t n){
+    __m256i m = _mm256_set1_epi32(dv->m), d = _mm256_set1_epi32(dv->d);
+    __m128i sh = _mm_cvtsi32_si128(dv->l - 1);
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8){
+        __m256i v = LOAD256(x + i);
+        __m256i r = avx2_umod_v(_mm256_abs_epi32(v), m, sh, d);
+        STORE256(out + i, _mm256_sign_epi32(r, v));
+    }
+    scalar_mod(x + i, dv, out + i, n - i);
+}
+
+AVX2 static void avx2_umod(const unsigned *x, const struct bl_divisor *dv,
+                           unsigned *out, size_t n){
+    __m256i m = _mm256_set1_epi32(dv->m), d = _mm256_set1_epi32(dv->d);
+    __m128i sh = _mm_cvtsi32_si128(dv->l - 1);
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8)
+        STORE256(out + i, avx2_umod_v(LOAD256(x + i), m, sh, d));
+    scalar_umod(x + i, dv, out + i, n - i);
+}
+
+/* x % d == 0 iff (x * inv) rotated right by tz is at most UINT32_MAX / d */
+AVX2 static void avx2_divisible(const unsigned *x, const struct bl_divisor *dv,
+                                int *out, size_t n){
+    __m256i inv = _mm256_set1_epi32(dv->inv), lim = _mm256_set1_epi32(dv->lim);
+    __m256i one = _mm256_set1_epi32(1);
+    __m128i cr = _mm_cvtsi32_si128(dv->tz), cl = _mm_cvtsi32_si128(32 - dv->tz);
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8){
+        __m256i p = _mm256_mullo_epi32(LOAD256(x + i), inv);
+        p = _mm256_or_si256(_mm256_srl_epi32(p, cr), _mm256_sll_epi32(p, cl));
+        STORE256(out + i, _mm256_and_si256(_mm256_cmpeq_epi32(
+            _mm256_min_epu32(p, lim), p), one));
+    }
+    scalar_divisible(x + i, dv, out + i, n - i);
+}
+
+static struct bl_kernels avx2_kernels = {
+    avx2_bang, avx2_leastBitPos, avx2_fitsBits,
+    avx2_ilog2, avx2_rotateLeft, avx2_modThree,
+    avx2_mod, avx2_umod, avx2_divisible
+};
+
+/*=========================== AVX-512 (16 lanes) ===========================*/
+
+#define LOAD512(p)      _mm512_loadu_si512((const void *)(p))
+#define STORE512(p, v)  _mm512_storeu_si512((void *)(p), (v))
+
+AVX512 static void avx512_bang(const int *x, int *out, size_t n){
+    __m512i zero = _mm512_setzero_si512();
+    size_t i;
+    for(i = 0; i + 16 <= n; i += 16){
+        __mmask16 z = _mm512_cmpeq_epi32_mask(LOAD512(x + i), zero);
+        STORE512(out + i, _mm512_maskz_set1_epi32(z, 1));
+    }
+    scalar_bang(x + i, out + i, n - i);
+}
+
+AVX512 static void avx512_leastBitPos(const int *x, int *out, size_t n){
+    __m512i zero = _mm512_setzero_si512();
+    size_t i;
+    for(i = 0; i + 16 <= n; i += 16){
+        __m512i v = LOAD512(x + i);
+        STORE512(out + i, _mm512_and_si512(v, _mm512_sub_epi32(zero, v)));
+    }
+    scalar_leastBitPos(x + i, out + i, n - i);
+}
+
+AVX512 static void avx512_fitsBits(const int *x, int bits, int *out, size_t n){
+    __m128i c = _mm_cvtsi32_si128(32 - bits);
+    size_t i;
+    for(i = 0; i + 16 <= n; i += 16){
+        __m512i v = LOAD512(x + i);
+        __m512i t = _mm512_sra_epi32(_mm512_sll_epi32(v, c), c);
+        STORE512(out + i, _mm512_maskz_set1_epi32(
+            _mm512_cmpeq_epi32_mask(t, v), 1));
+    }
+    scalar_fitsBits(x + i, bits, out + i, n - i);
+}
+
+AVX512 static void avx512_ilog2(const int *x, int *out, size_t n){
+    __m512i zero = _mm512_setzero_si512(), top = _mm512_set1_epi32(31);
+    size_t i;
+    for(i = 0; i + 16 <= n; i += 16){
+        __m512i lz = _mm512_lzcnt_epi32(LOAD512(x + i));
+        STORE512(out + i, _mm512_max_epi32(_mm512_sub_epi32(top, lz), zero));
+    }
+    scalar_ilog2(x + i, out + i, n - i);
+}
+
+AVX512 static void avx512_rotateLeft(const int *x, int r, int *out, size_t n){
+    __m512i c = _mm512_set1_epi32(r);
+    size_t i;
+    for(i = 0; i + 16 <= n; i += 16)
+        STORE512(out + i, _mm512_rolv_epi32(LOAD512(x + i), c));
+    scalar_rotateLeft(x + i, r, out + i, n - i);
+}
+
+AVX512 static void avx512_modThree(const int *x, int *out, size_t n){
+    __m512i m16 = _mm512_set1_epi32(0xffff), m8 = _mm512_set1_epi32(0xff);
+    __m512i m4 = _mm512_set1_epi32(0xf), m2 = _mm512_set1_epi32(0x3);
+    __m512i zero = _mm512_setzero_si512(), two = _mm512_set1_epi32(2);
+    size_t i;
+    for(i = 0; i + 16 <= n; i += 16){
+        __m512i v = LOAD512(x + i);
+        __m512i a = _mm512_abs_epi32(v);
+        a = _mm512_add_epi32(_mm512_srli_epi32(a, 16), _mm512_and_si512(a, m16));
+        a = _mm512_add_epi32(_mm512_srli_epi32(a, 16), _mm512_and_si512(a, m16));
+        a = _mm512_add_epi32(_mm512_srli_epi32(a, 8), _mm512_and_si512(a, m8));
+        a = _mm512_add_epi32(_mm512_srli_epi32(a, 8), _mm512_and_si512(a, m8));
+        a = _mm512_add_epi32(_mm512_srli_epi32(a, 4), _mm512_and_si512(a, m4));
+        a = _mm512_add_epi32(_mm512_srli_epi32(a, 4), _mm512_and_si512(a, m4));
+        a = _mm512_add_epi32(_mm512_srli_epi32(a, 2), _mm512_and_si512(a, m2));
+        a = _mm512_add_epi32(_mm512_srli_epi32(a, 2), _mm512_and_si512(a, m2));
+        a = _mm512_mask_sub_epi32(a, _mm512_cmpgt_epi32_mask(a, two), a, m2);
+        a = _mm512_mask_sub_epi32(a, _mm512_cmplt_epi32_mask(v, zero), zero, a);
+        STORE512(out + i, a);
+    }
+    scalar_modThree(x + i, out + i, n - i);
+}
+
+AVX512 static inline __m512i avx512_umod_v(__m512i x, __m512i m, __m128i sh, __m512i d){
+    __m512i even = _mm512_srli_epi64(_mm512_mul_epu32(x, m), 32);
+    __m512i odd = _mm512_mul_epu32(_mm512_srli_epi64(x, 32), m);
+    __m512i t = _mm512_mask_blend_epi32(0xAAAA, even, odd);
+    __m512i q = _mm512_srl_epi32(_mm512_add_epi32(t,
+                    _mm512_srli_epi32(_mm512_sub_epi32(x, t), 1)), sh);
+    return _mm512_sub_epi32(x, _mm512_mullo_epi32(q, d));
+}
+
+AVX512 static void avx512_mod(const int *x, const struct bl_divisor *dv,
+                              int *out, size_t n){
+    __m512i m = _mm512_set1_epi32(dv->m), d = _mm512_set1_epi32(dv->d);
+    __m512i zero = _mm512_setzero_si512();
+    __m128i sh = _mm_cvtsi32_si128(dv->l - 1);
+    size_t i;
+    for(i = 0; i + 16 <= n; i += 16){
+        __m512i v = LOAD512(x + i);
+        __m512i r = avx512_umod_v(_mm512_abs_epi32(v), m, sh, d);
+        STORE512(out + i, _mm512_mask_sub_epi32(r,
+            _mm512_cmplt_epi32_mask(v, zero), zero, r));
+    }
+    scalar_mod(x + i, dv, out + i, n - i);
+}
+
+AVX512 static void avx512_umod(const unsigned *x, const struct bl_divisor *dv,
+                               unsigned *out, size_t n){
+    __m512i m = _mm512_set1_epi32(dv->m), d = _mm512_set1_epi32(dv->d);
+    __m128i sh = _mm_cvtsi32_si128(dv->l - 1);
+    size_t i;
+    for(i = 0; i + 16 <= n; i += 16)
+        STORE512(out + i, avx512_umod_v(LOAD512(x + i), m, sh, d));
+    scalar_umod(x + i, dv, out + i, n - i);
+}
+
+AVX512 static void avx512_divisible(const unsigned *x, const struct bl_divisor *dv,
+                                    int *out, size_t n){
+    __m512i inv = _mm512_set1_epi32(dv->inv), lim = _mm512_set1_epi32(dv->lim);
+    __m512i tz = _mm512_set1_epi32(dv->tz);
+    size_t i;
+    for(i = 0; i + 16 <= n; i += 16){
+        __m512i p = _mm512_rorv_epi32(_mm512_mullo_epi32(LOAD512(x + i), inv), tz);
+        STORE512(out + i, _mm512_maskz_set1_epi32(
+            _mm512_cmple_epu32_mask(p, lim), 1));
+    }
+    scalar_divisible(x + i, dv, out + i, n - i);
+}
+
+static struct bl_kernels avx512_kernels = {
+    avx512_bang, avx512_leastBitPos, avx512_fitsBits,
+    avx512_ilog2, avx512_rotateLeft, avx512_modThree,
+    avx512_mod, avx512_umod, avx512_divisible
+};
+#endif /* BL_X86 */
+
+/*=========================== DISPATCH ===========================*/
+
+static struct bl_kernels *kernels(int l){
+#ifdef BL_X86
+    switch(l){
+        case BL_SSE2: return &sse2_kernels;
+        case BL_AVX2: return &avx2_kernels;
+        case BL_AVX512: return &avx512_kernels;
+    }
+#endif
+    return &scalar_kernels;
+}
+
+/*
+ * bl_init - pick the best level supported by the CPU
+ */
+static void bl_init(void){
+    maxlevel = BL_SCALAR;
+#ifdef BL_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd"))
+        maxlevel = BL_AVX512;
+    else if(__builtin_cpu_supports("avx2"))
+        maxlevel = BL_AVX2;
+    else if(__builtin_cpu_supports("sse2"))
+        maxlevel = BL_SSE2;
+#endif
+    level = maxlevel;
+    impl = kernels(level);
+}
+
+int bl_level(void){
+    if(impl == 0) bl_init();
+    return level;
+}
+
+int bl_set_level(int l){
+    if(impl == 0) bl_init();
+    if(l < BL_SCALAR) l = BL_SCALAR;
+    if(l > maxlevel) l = maxlevel;
+    level = l;
+    impl = kernels(level);
+    return level;
+}
+
+void bl_bang(const int *x, int *out, size_t n){
+    if(impl == 0) bl_init();
+    impl->bang(x, out, n);
+}
+
+void bl_leastBitPos(const int *x, int *out, size_t n){
+    if(impl == 0) bl_init();
+    impl->leastBitPos(x, out, n);
+}
+
+void bl_fitsBits(const int *x, int bits, int *out, size_t n){
+    if(impl == 0) bl_init();
+    impl->fitsBits(x, bits, out, n);
+}
+
+void bl_ilog2(const int *x, int *out, size_t n){
+    if(impl == 0) bl_init();
+    impl->ilog2(x, out, n);
+}
+
+void bl_rotateLeft(const int *x, int r, int *out, size_t n){
+    if(impl == 0) bl_init();
+    impl->rotateLeft(x, r, out, n);
+}
+
+void bl_modThree(const int *x, int *out, size_t n){
+    if(impl == 0) bl_init();
+    impl->modThree(x, out, n);
+}
+
+void bl_mod(const int *x, const struct bl_divisor *dv, int *out, size_t n){
+    if(impl == 0) bl_init();
+    impl->mod(x, dv, out, n);
+}
+
+void bl_umod(const unsigned *x, const struct bl_divisor *dv,
+             unsigned *out, size_t n){
+    if(impl == 0) bl_init();
+    impl->umod(x, dv, out, n);
+}
+
+void bl_divisible(const unsigned *x, const struct bl_divisor *dv,
+                  int *out, size_t n){
+    if(impl == 0) bl_init();
+    impl->divisible(x, dv, out, n);
+}
+
+/*=========================== CHECK ===========================*/
+
+#define CHECK_BLOCK 4096    /* inputs per comparison */
+
+/* Divisors checked for bl_mod, bl_umod and bl_divisible */
+static const unsigned divisors[] = {
+    2, 3, 5, 7, 9, 10, 12, 255, 641, 1000, 65537,
+    0x7FFFFFFF, 0x80000000, 0xFFFFFFFF
+};
+#define NDIVISORS (sizeof(divisors) / sizeof(divisors[0]))
+
+struct check_arg {
+    unsigned long long lo, hi;  /* input indices [lo, hi) of this thread */
+    unsigned stride;
+    long bad;                   /* mismatches found */
+};
+
+/*
+ * compare - count lanes where got differs from want, print the first one
+ */
+static long compare(const char *name, int l, int y, const int *in,
+                    const int *got, const int *want, size_t n){
+    size_t i;
+    long bad = 0;
+    for(i = 0; i < n; i++){
+        if(got[i] != want[i]){
+            if(bad++ == 0)
+                printf("bl_check: %s level %d x=0x%x y=%d got 0x%x want 0x%x\n",
+                    name, l, (unsigned)in[i], y,
+                    (unsigned)got[i], (unsigned)want[i]);
+        }
+    }
+    return bad;
+}
+
+static void *check_thread(void *vargp){
+    struct check_arg *arg = vargp;
+    int in[CHECK_BLOCK], want[CHECK_BLOCK], got[CHECK_BLOCK];
+    struct bl_kernels *k;
+    struct bl_divisor dv;
+    unsigned long long x;
+    size_t i, j, n;
+    int l, y;
+
+    for(x = arg->lo; x < arg->hi; x += n){
+        n = (arg->hi - x < CHECK_BLOCK) ? arg->hi - x : CHECK_BLOCK;
+        for(i = 0; i < n; i++)
+            in[i] = (int)(unsigned)((x + i) * arg->stride);
+        for(l = BL_SCALAR + 1; l <= maxlevel; l++){
+            k = kernels(l);
+
+            scalar_bang(in, want, n);
+            k->bang(in, got, n);
+            arg->bad += compare("bang", l, 0, in, got, want, n);
+
+            scalar_leastBitPos(in, want, n);
+            k->leastBitPos(in, got, n);
+            arg->bad += compare("leastBitPos", l, 0, in, got, want, n);
+
+            scalar_ilog2(in, want, n);
+            k->ilog2(in, got, n);
+            arg->bad += compare("ilog2", l, 0, in, got, want, n);
+
+            scalar_modThree(in, want, n);
+            k->modThree(in, got, n);
+            arg->bad += compare("modThree", l, 0, in, got, want, n);
+
+            for(y = 1; y <= 32; y++){
+                scalar_fitsBits(in, y, want, n);
+                k->fitsBits(in, y, got, n);
+                arg->bad += compare("fitsBits", l, y, in, got, want, n);
+            }
+            for(y = 0; y <= 31; y++){
+                scalar_rotateLeft(in, y, want, n);
+                k->rotateLeft(in, y, got, n);
+                arg->bad += compare("rotateLeft", l, y, in, got, want, n);
+            }
+        }
+
+        /* Remainders against C's own %, the scalar level included */
+        for(j = 0; j < NDIVISORS; j++){
+            dv = bl_divisor(divisors[j]);
+            for(l = BL_SCALAR; l <= maxlevel; l++){
+                k = kernels(l);
+                if(dv.d <= 0x7FFFFFFF){
+                    for(i = 0; i < n; i++)
+                        want[i] = in[i] % (int)dv.d;
+                    k->mod(in, &dv, got, n);
+                    arg->bad += compare("mod", l, dv.d, in, got, want, n);
+                }
+                for(i = 0; i < n; i++)
+                    want[i] = (unsigned)in[i] % dv.d;
+                k->umod((unsigned *)in, &dv, (unsigned *)got, n);
+                arg->bad += compare("umod", l, dv.d, in, got, want, n);
+                for(i = 0; i < n; i++)
+                    want[i] = (unsigned)in[i] % dv.d == 0;
+                k->divisible((unsigned *)in, &dv, got, n);
+                arg->bad += compare("divisible", l, dv.d, in, got, want, n);
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * bl_check - compare every level against the reference
+ * Inputs are 0, stride, 2*stride, ... (mod 2^32); stride 1 is exhaustive.
+ * bl_mod, bl_umod and bl_divisible are checked against % for a set of
+ * divisors, from 2 up to UINT32_MAX.
+ * nthreads <= 0 uses one thread per online CPU.
+ * Returns the number of mismatching results.
+ */
+long bl_check(unsigned stride, int nthreads){
+    struct check_arg *args;
+    pthread_t *tids;
+    unsigned long long end;
+    long bad = 0;
+    int i;
+
+    if(impl == 0) bl_init();
+    if(stride == 0) stride = 1;
+    if(nthreads <= 0) nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(nthreads <= 0) nthreads = 1;
+    end = ((1ULL << 32) + stride - 1) / stride;
+
+    args = calloc(nthreads, sizeof(*args));
+    tids = calloc(nthreads, sizeof(*tids));
+    if(args == NULL || tids == NULL){
+        free(args);
+        free(tids);
+        return -1;
+    }
+    for(i = 0; i < nthreads; i++){
+        args[i].lo = end * i / nthreads;
+        args[i].hi = end * (i + 1) / nthreads;
+        args[i].stride = stride;
+        pthread_create(&tids[i], NULL, check_thread, &args[i]);
+    }
+    for(i = 0; i < nthreads; i++){
+        pthread_join(tids[i], NULL);
+        bad += args[i].bad;
+    }
+    free(args);
+    free(tids);
+    return bad;
+}
+
+/*=========================== BENCH ===========================*/
+
+#define BENCH_BLOCK 4096    /* inputs per kernel call */
+
+static double now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * bl_bench - print ns/op of every routine at every level
+ * Each routine converts total (rounded to whole blocks) random inputs.
+ */
+void bl_bench(size_t total){
+    static int in[BENCH_BLOCK], out[BENCH_BLOCK];
+    struct bl_kernels *k;
+    struct bl_divisor dv;
+    unsigned seed = 0x9E3779B9;
+    size_t i, j, reps;
+    char lv[32];
+    double t;
+    int l;
+
+    if(impl == 0) bl_init();
+    for(i = 0; i < BENCH_BLOCK; i++){
+        seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+        in[i] = (int)seed;
+    }
+    reps = total / BENCH_BLOCK ? total / BENCH_BLOCK : 1;
+
+/* Time reps calls of call, print ns per element under label */
+#define BENCH_AS(name, label, call) do { \
+    t = now_ns(); \
+    for(i = 0; i < reps; i++) call; \
+    t = (now_ns() - t) / ((double)reps * BENCH_BLOCK); \
+    printf("%-12s %-8s %7.3f ns/op\n", name, label, t); \
+} while(0)
+#define BENCH(name, call) do { \
+    snprintf(lv, sizeof(lv), "level %d", l); \
+    BENCH_AS(name, lv, call); \
+} while(0)
+
+    for(l = BL_SCALAR; l <= maxlevel; l++){
+        k = kernels(l);
+        BENCH("bang", k->bang(in, out, BENCH_BLOCK));
+        BENCH("leastBitPos", k->leastBitPos(in, out, BENCH_BLOCK));
+        BENCH("fitsBits", k->fitsBits(in, 1 + (int)(i & 31), out, BENCH_BLOCK));
+        BENCH("ilog2", k->ilog2(in, out, BENCH_BLOCK));
+        BENCH("rotateLeft", k->rotateLeft(in, (int)(i & 31), out, BENCH_BLOCK));
+        BENCH("modThree", k->modThree(in, out, BENCH_BLOCK));
+    }
+
+/* Compiler's % by a constant, bl_mod<d> and bl_mod at every level */
+#define BENCH_MOD(d) do { \
+    BENCH_AS("% " #d, "cc %", for(j = 0; j < BENCH_BLOCK; j++) out[j] = in[j] % d); \
+    BENCH_AS("bl_mod" #d, "inline", for(j = 0; j < BENCH_BLOCK; j++) out[j] = bl_mod##d(in[j])); \
+    dv = bl_divisor(d); \
+    for(l = BL_SCALAR; l <= maxlevel; l++) \
+        BENCH("bl_mod " #d, kernels(l)->mod(in, &dv, out, BENCH_BLOCK)); \
+} while(0)
+
+    BENCH_MOD(3);
+    BENCH_MOD(7);
+    BENCH_MOD(10);
+    BENCH_MOD(255);
+#undef BENCH_MOD
+#undef BENCH
+#undef BENCH_AS
+}
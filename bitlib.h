@@ -0,0 +1,110 @@
+/*
+ * <Eugene Yu Jun Hao 1900094810>
+ * bitlib.h - Array versions of the Data Lab bit puzzles
+ */
+#ifndef __BITLIB_H__
+#define __BITLIB_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Instruction set levels, selected at run time by CPU features */
+#define BL_SCALAR   0       /* reference Data Lab expressions */
+#define BL_SSE2     1       /* 4 lanes */
+#define BL_AVX2     2       /* 8 lanes */
+#define BL_AVX512   3       /* 16 lanes, vplzcntd, vprold */
+
+/*
+ * Each routine reads n ints from x and writes n results to out,
+ * out[i] = f(x[i]) with the same semantics as the Data Lab function.
+ * x and out may be the same array.
+ */
+void bl_bang(const int *x, int *out, size_t n);
+void bl_leastBitPos(const int *x, int *out, size_t n);
+void bl_fitsBits(const int *x, int bits, int *out, size_t n);   /* 1 <= bits <= 32 */
+void bl_ilog2(const int *x, int *out, size_t n);
+void bl_rotateLeft(const int *x, int r, int *out, size_t n);    /* 0 <= r <= 31 */
+void bl_modThree(const int *x, int *out, size_t n);
+
+/*
+ * Remainder by a divisor d >= 2 (modThree generalized)
+ *   bl_divisor(d) precomputes the constants once; with a constant d it
+ *   folds away entirely.
+ *   bl_mod:       out[i] = x[i] % d (C semantics, sign of x[i]), d <= INT_MAX
+ *   bl_umod:      out[i] = x[i] % d (unsigned)
+ *   bl_divisible: out[i] = (x[i] % d == 0) (unsigned)
+ */
+struct bl_divisor {
+    uint64_t M;         /* ceil(2^64 / d) for Lemire's fastmod */
+    uint32_t d;         /* divisor */
+    uint32_t m;         /* 2^32 * (2^l - d) / d + 1 for q = mulhi step */
+    uint32_t l;         /* ceil(log2 d) */
+    uint32_t inv;       /* inverse of the odd part of d mod 2^32 */
+    uint32_t tz;        /* trailing zero bits of d */
+    uint32_t lim;       /* UINT32_MAX / d */
+};
+
+static inline struct bl_divisor bl_divisor(uint32_t d){
+    struct bl_divisor dv;
+    uint32_t odd = d >> __builtin_ctz(d), inv = odd;
+    int i;
+
+    dv.M = UINT64_C(0xFFFFFFFFFFFFFFFF) / d + 1;
+    dv.d = d;
+    dv.l = 32 - __builtin_clz(d - 1);
+    dv.m = (uint32_t)(((((uint64_t)1 << dv.l) - d) << 32) / d + 1);
+    for(i = 0; i < 5; i++)      /* Newton: 3, 6, 12, 24, 48 good bits */
+        inv *= 2 - odd * inv;
+    dv.inv = inv;
+    dv.tz = __builtin_ctz(d);
+    dv.lim = UINT32_MAX / d;
+    return dv;
+}
+
+/* Lemire's fastmod: the low 64 bits of x * M hold the fraction x / d */
+static inline uint32_t bl_fastumod(uint32_t x, uint64_t M, uint32_t d){
+    return (uint32_t)(((__uint128_t)(M * x) * d) >> 64);
+}
+
+static inline int32_t bl_fastmod(int32_t x, uint64_t M, uint32_t d){
+    uint32_t s = -((uint32_t)x >> 31);
+    uint32_t r = bl_fastumod(((uint32_t)x ^ s) - s, M, d);
+    return (int32_t)((r ^ s) - s);
+}
+
+static inline int bl_fastdivisible(uint32_t x, uint64_t M){
+    return x * M <= M - 1;
+}
+
+/*
+ * BL_DEFINE_MOD(d) - define bl_mod<d>, bl_umod<d> and bl_divisible<d>,
+ *                    scalar remainders by the constant d
+ */
+#define BL_DEFINE_MOD(d) \
+static inline int32_t bl_mod##d(int32_t x){ \
+    return bl_fastmod(x, UINT64_C(0xFFFFFFFFFFFFFFFF) / (d) + 1, (d)); \
+} \
+static inline uint32_t bl_umod##d(uint32_t x){ \
+    return bl_fastumod(x, UINT64_C(0xFFFFFFFFFFFFFFFF) / (d) + 1, (d)); \
+} \
+static inline int bl_divisible##d(uint32_t x){ \
+    return bl_fastdivisible(x, UINT64_C(0xFFFFFFFFFFFFFFFF) / (d) + 1); \
+}
+
+BL_DEFINE_MOD(3)
+BL_DEFINE_MOD(5)
+BL_DEFINE_MOD(7)
+BL_DEFINE_MOD(9)
+BL_DEFINE_MOD(10)
+BL_DEFINE_MOD(255)
+
+void bl_mod(const int *x, const struct bl_divisor *dv, int *out, size_t n);
+void bl_umod(const unsigned *x, const struct bl_divisor *dv, unsigned *out, size_t n);
+void bl_divisible(const unsigned *x, const struct bl_divisor *dv, int *out, size_t n);
+
+int bl_level(void);             /* level in use */
+int bl_set_level(int level);    /* force a lower level, return level in use */
+long bl_check(unsigned stride, int nthreads); /* return mismatches */
+void bl_bench(size_t total);    /* print ns/op of every level */
+
+#endif /* __BITLIB_H__ */
@@ -0,0 +1,537 @@
+/*  <Eugene Yu Jun Hao 1900094810>
+ *  dlcheck.c - check every Data Lab function, and its batched versions in
+ *              bitlib and floatlib, against plain C semantics
+ *  Details:
+ *  1. datalab.c is included whole (with wrapping arithmetic, which the
+ *     lab assumes), so the solutions are tested as handed in.
+ *  2. The spec_* references are written from the lab's descriptions with
+ *     ordinary C, 64-bit arithmetic and the FPU, not from the solutions:
+ *     x ? y : z, x % 3, (float)x, ldexpf and so on. bl_check and fl_check
+ *     compare the kernels against copies of the solutions; this is the
+ *     check that the copies are right. ilog2 of x <= 0, which the lab
+ *     leaves open, is the value bitlib.c documents (31 for x < 0, 0 for 0).
+ *  3. One-argument functions (bang, leastBitPos, multFiveEighths, satMul2,
+ *     modThree, ilog2 and the four float_*) run over all 2^32 inputs
+ *     when stride is 1. The others are sampled: SAMPLES random
+ *     (x, y, z), a quarter of each drawn from the edge values, with y =
+ *     x + 1 half the time for oneMoreThan and 0/1 operands for
+ *     implication (its logical domain). bl_fitsBits and bl_rotateLeft
+ *     run every shift on each sampled block.
+ *  4. The work of a pass is split over threads. The first pass also
+ *     checks datalab.c, the inline fl_abs_fp32 and fl_ldexp_fp32 (as
+ *     float_negpwr2), and bl_mod<d>, bl_umod<d> and bl_divisible<d> of
+ *     bitlib.h against % for every BL_DEFINE_MOD divisor; then bitlib (bang, leastBitPos, fitsBits, ilog2,
+ *     rotateLeft, modThree) and floatlib (fl_i2f RNE, fl_f2i RTZ) run
+ *     once per level, floatlib at the level of the same instruction set
+ *     (it has no SSE2 level).
+ *  5. bl_check then runs every bitlib level, bl_mod, bl_umod and
+ *     bl_divisible against % for divisors 2 to UINT32_MAX included, and
+ *     fl_check every floatlib level and rounding mode against the FPU
+ *     with the fp16/bf16 utilities exhaustively (fl_check16), on the
+ *     same stride and threads.
+ *  6. -b also prints ns/op of every datalab.c function, then bl_bench and
+ *     fl_bench.
+ *  Build: gcc -O2 -pthread -o dlcheck dlcheck.c bitlib.c floatlib.c -lm
+ *  Usage: ./dlcheck [-b] [-t threads] [STRIDE] [SAMPLES]  (default 1 2^28)
+ */
+
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bitlib.h"
+#include "floatlib.h"
+
+/* The lab's style: a&b | c&d, and int compared with 0x80000000 */
+#pragma GCC push_options
+#pragma GCC optimize ("wrapv")
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wparentheses"
+#pragma GCC diagnostic ignored "-Wsign-compare"
+#include "datalab.c"
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+
+#define CHECK_BLOCK 4096    /* inputs per comparison */
+#define MAX_SEEN    64      /* functions reported in a pass */
+
+/* Edge values drawn for sampled operands */
+static const int edges[] = {
+    0, 1, 2, 3, -1, -2, -3, 7, 8, 255, 256,
+    INT_MAX, INT_MAX - 1, INT_MIN, INT_MIN + 1,
+    0x40000000, -0x40000000, 0x3FFFFFFF, -0x3FFFFFFF,
+    0x7F800000, 0x7F800001, 0x7FC00000, 0x00800000, 0x007FFFFF,
+    0x4F000000, (int)0xCF000000, 0x3F800000
+};
+#define NEDGES (sizeof(edges) / sizeof(edges[0]))
+
+struct check_arg {
+    unsigned long long lo, hi;  /* input indices [lo, hi) of this thread */
+    unsigned stride;
+    unsigned long long samples; /* sampled operand triples */
+    unsigned seed;
+    int datalab;                /* check datalab.c in this pass */
+    int bl, fl;                 /* bitlib / floatlib level, -1 : skip */
+    long bad;                   /* mismatches found */
+};
+
+/* Instruction sets of the levels of each library */
+static const char *bl_isa[] = {"scalar", "SSE2", "AVX2", "AVX-512"};
+static const char *fl_isa[] = {"scalar", "AVX2", "AVX-512"};
+
+/* Functions whose first mismatch of the pass is printed */
+static const char *seen[MAX_SEEN];
+static int nseen;
+static pthread_mutex_t seen_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*=========================== SPECIFICATION ===========================*/
+
+static unsigned fbits(float f){
+    unsigned u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static float bitsf(unsigned u){
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static int spec_minusOne(void){
+    return -1;
+}
+
+static int spec_implication(int x, int y){
+    return !x || y;
+}
+
+static int spec_leastBitPos(int x){
+    return x ? (int)(1u << __builtin_ctz(x)) : 0;
+}
+
+static int spec_rotateLeft(int x, int n){
+    unsigned u = (unsigned)x;
+    return (int)((u << n) | (u >> (31 - n) >> 1));
+}
+
+static int spec_conditional(int x, int y, int z){
+    return x ? y : z;
+}
+
+static int spec_bang(int x){
+    return x == 0;
+}
+
+static int spec_oneMoreThan(int x, int y){
+    return (long long)x + 1 == y;
+}
+
+static int spec_fitsBits(int x, int n){
+    long long half = 1LL << (n - 1);
+    return x >= -half && x < half;
+}
+
+/* x*5/8 with the product wrapping, as the lab asks */
+static int spec_multFiveEighths(int x){
+    return (int)((unsigned)x * 5u) / 8;
+}
+
+static int spec_satMul2(int x){
+    long long v = 2LL * x;
+    return v > INT_MAX ? INT_MAX : v < INT_MIN ? INT_MIN : (int)v;
+}
+
+static int spec_modThree(int x){
+    return x % 3;
+}
+
+static int spec_ilog2(int x){
+    return x > 0 ? 31 - __builtin_clz(x) : x < 0 ? 31 : 0;
+}
+
+static unsigned spec_float_abs(unsigned uf){
+    float f = bitsf(uf);
+    return isnan(f) ? uf : fbits(fabsf(f));
+}
+
+static unsigned spec_float_i2f(int x){
+    return fbits((float)x);
+}
+
+static int spec_float_f2i(unsigned uf){
+    double d = bitsf(uf);
+    if(!(d > -2147483649.0 && d < 2147483648.0))    /* NaN fails both */
+        return INT_MIN;
+    return (int)d;
+}
+
+static unsigned spec_float_negpwr2(int x){
+    long long e = -(long long)x;
+    e = e > 200 ? 200 : e < -200 ? -200 : e;    /* beyond inf and 0 */
+    return fbits(ldexpf(1.0f, (int)e));
+}
+
+/*=========================== CHECK ===========================*/
+
+/*
+ * mismatch - print the first mismatch of function name in the pass,
+ *            return 1
+ */
+static long mismatch(const char *name, int l, int x, int y, int z,
+                     int got, int want){
+    char lv[32] = "";
+    int i;
+
+    pthread_mutex_lock(&seen_lock);
+    for(i = 0; i < nseen && strcmp(seen[i], name); i++)
+        ;
+    if(i == nseen && nseen < MAX_SEEN){
+        seen[nseen++] = name;
+        if(l >= 0)
+            snprintf(lv, sizeof(lv), " level %d", l);
+        printf("dlcheck: %s%s x=0x%x y=0x%x z=0x%x got 0x%x want 0x%x\n",
+            name, lv, (unsigned)x, (unsigned)y, (unsigned)z,
+            (unsigned)got, (unsigned)want);
+    }
+    pthread_mutex_unlock(&seen_lock);
+    return 1;
+}
+
+#define EXPECT(name, l, x, y, z, got, want) do { \
+    int got_ = (int)(got), want_ = (int)(want); \
+    if(got_ != want_) arg->bad += mismatch(name, l, x, y, z, got_, want_); \
+} while(0)
+
+/* Data Lab function f of one argument on in[0..n) */
+#define UNARY(f) do { \
+    for(i = 0; i < n; i++) \
+        EXPECT(#f, -1, in[i], 0, 0, f(in[i]), spec_##f(in[i])); \
+} while(0)
+
+/* Batched g against spec_f on in[0..n), at level l, y the shared operand */
+#define ARRAY(g, l, f, y, ...) do { \
+    g(__VA_ARGS__); \
+    for(i = 0; i < n; i++) \
+        EXPECT(#g, l, in[i], y, 0, got[i], f); \
+} while(0)
+
+/* Inline remainders of bitlib.h by the constant d on in[0..n) */
+#define MODS(d) do { \
+    for(i = 0; i < n; i++){ \
+        EXPECT("bl_mod" #d, -1, in[i], d, 0, bl_mod##d(in[i]), in[i] % d); \
+        EXPECT("bl_umod" #d, -1, in[i], d, 0, bl_umod##d(uin[i]), uin[i] % d); \
+        EXPECT("bl_divisible" #d, -1, in[i], d, 0, \
+            bl_divisible##d(uin[i]), uin[i] % d == 0); \
+    } \
+} while(0)
+
+static unsigned rnd(unsigned *s){
+    *s ^= *s << 13;
+    *s ^= *s >> 17;
+    *s ^= *s << 5;
+    return *s;
+}
+
+/* Operand: an edge value a quarter of the time, else random */
+static int sample(unsigned *s){
+    unsigned r = rnd(s);
+    return (r & 3) == 0 ? edges[(r >> 2) % NEDGES] : (int)rnd(s);
+}
+
+/*
+ * exhaustive - one-argument functions on in[0..n)
+ */
+static void exhaustive(struct check_arg *arg, const int *in, size_t n){
+    static __thread int got[CHECK_BLOCK];
+    const unsigned *uin = (const unsigned *)in;
+    unsigned *ugot = (unsigned *)got;
+    int l;
+    size_t i;
+
+    if(arg->datalab){
+        UNARY(bang);
+        UNARY(leastBitPos);
+        UNARY(multFiveEighths);
+        UNARY(satMul2);
+        UNARY(modThree);
+        UNARY(ilog2);
+        UNARY(float_abs);
+        UNARY(float_i2f);
+        UNARY(float_f2i);
+        UNARY(float_negpwr2);
+        for(i = 0; i < n; i++)
+            EXPECT("fl_abs_fp32", -1, in[i], 0, 0,
+                fl_abs_fp32(uin[i]), spec_float_abs(uin[i]));
+        for(i = 0; i < n; i++)
+            EXPECT("fl_ldexp_fp32", -1, in[i], 0, 0,
+                fl_ldexp_fp32(0x3F800000, in[i] > FL_SCALE_MAX ? -FL_SCALE_MAX :
+                    in[i] < -FL_SCALE_MAX ? FL_SCALE_MAX : -in[i]),
+                spec_float_negpwr2(in[i]));
+        MODS(3);
+        MODS(5);
+        MODS(7);
+        MODS(9);
+        MODS(10);
+        MODS(255);
+    }
+    if((l = arg->bl) >= 0){
+        ARRAY(bl_bang, l, spec_bang(in[i]), 0, in, got, n);
+        ARRAY(bl_leastBitPos, l, spec_leastBitPos(in[i]), 0, in, got, n);
+        ARRAY(bl_ilog2, l, spec_ilog2(in[i]), 0, in, got, n);
+        ARRAY(bl_modThree, l, spec_modThree(in[i]), 0, in, got, n);
+    }
+    if((l = arg->fl) >= 0){
+        ARRAY(fl_i2f, l, spec_float_i2f(in[i]), 0, in, ugot, n, FL_RNE);
+        ARRAY(fl_f2i, l, spec_float_f2i(in[i]), 0, uin, got, n, FL_RTZ);
+    }
+}
+
+/*
+ * sampled - functions of more than one argument on n random operands
+ */
+static void sampled(struct check_arg *arg, unsigned *s, size_t n){
+    static __thread int in[CHECK_BLOCK], y[CHECK_BLOCK], z[CHECK_BLOCK];
+    static __thread int got[CHECK_BLOCK];
+    int l, k, a, b;
+    size_t i;
+
+    for(i = 0; i < n; i++){
+        in[i] = sample(s);
+        y[i] = sample(s);
+        z[i] = sample(s);
+    }
+    if(arg->datalab){
+        EXPECT("minusOne", -1, 0, 0, 0, minusOne(), spec_minusOne());
+        for(i = 0; i < n; i++){
+            a = in[i] & 1;
+            b = y[i] & 1;
+            EXPECT("implication", -1, a, b, 0,
+                implication(a, b), spec_implication(a, b));
+            k = (unsigned)y[i] % 32;
+            EXPECT("rotateLeft", -1, in[i], k, 0,
+                rotateLeft(in[i], k), spec_rotateLeft(in[i], k));
+            EXPECT("fitsBits", -1, in[i], k + 1, 0,
+                fitsBits(in[i], k + 1), spec_fitsBits(in[i], k + 1));
+            a = (z[i] & 3) == 0 ? 0 : in[i];
+            EXPECT("conditional", -1, a, y[i], z[i],
+                conditional(a, y[i], z[i]), spec_conditional(a, y[i], z[i]));
+            b = (z[i] & 1) ? (int)((unsigned)in[i] + 1) : y[i];
+            EXPECT("oneMoreThan", -1, in[i], b, 0,
+                oneMoreThan(in[i], b), spec_oneMoreThan(in[i], b));
+        }
+    }
+    if((l = arg->bl) >= 0){
+        for(k = 1; k <= 32; k++)
+            ARRAY(bl_fitsBits, l, spec_fitsBits(in[i], k), k, in, k, got, n);
+        for(k = 0; k <= 31; k++)
+            ARRAY(bl_rotateLeft, l, spec_rotateLeft(in[i], k), k, in, k, got, n);
+    }
+}
+
+static void *check_thread(void *vargp){
+    struct check_arg *arg = vargp;
+    static __thread int in[CHECK_BLOCK];
+    unsigned long long x, s;
+    unsigned seed = arg->seed;
+    size_t i, n;
+
+    for(x = arg->lo; x < arg->hi; x += n){
+        n = (arg->hi - x < CHECK_BLOCK) ? arg->hi - x : CHECK_BLOCK;
+        for(i = 0; i < n; i++)
+            in[i] = (int)(unsigned)((x + i) * arg->stride);
+        exhaustive(arg, in, n);
+    }
+    for(s = 0; s < arg->samples; s += n){
+        n = (arg->samples - s < CHECK_BLOCK) ? arg->samples - s : CHECK_BLOCK;
+        sampled(arg, &seed, n);
+    }
+    return NULL;
+}
+
+/*
+ * check - one pass over threads; bl, fl the levels set, -1 : skip
+ * Returns the number of mismatches.
+ */
+static long check(unsigned stride, unsigned long long samples, int nthreads,
+                  int datalab, int bl, int fl){
+    struct check_arg *args;
+    pthread_t *tids;
+    unsigned long long end = ((1ULL << 32) + stride - 1) / stride;
+    long bad = 0;
+    int i;
+
+    nseen = 0;
+    args = calloc(nthreads, sizeof(*args));
+    tids = calloc(nthreads, sizeof(*tids));
+    if(args == NULL || tids == NULL){
+        fprintf(stderr, "dlcheck: out of memory\n");
+        exit(1);
+    }
+    for(i = 0; i < nthreads; i++){
+        args[i].lo = end * i / nthreads;
+        args[i].hi = end * (i + 1) / nthreads;
+        args[i].stride = stride;
+        args[i].samples = samples * (i + 1) / nthreads - samples * i / nthreads;
+        args[i].seed = 0x9E3779B9u * (i + 1);
+        args[i].datalab = datalab;
+        args[i].bl = bl;
+        args[i].fl = fl;
+        pthread_create(&tids[i], NULL, check_thread, &args[i]);
+    }
+    for(i = 0; i < nthreads; i++){
+        pthread_join(tids[i], NULL);
+        bad += args[i].bad;
+    }
+    free(args);
+    free(tids);
+    return bad;
+}
+
+/*=========================== BENCH ===========================*/
+
+#define BENCH_BLOCK 4096    /* inputs per timed loop */
+
+static double now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * bench - print ns/op of every datalab.c function on total random inputs
+ */
+static void bench(size_t total){
+    static int in[BENCH_BLOCK], y[BENCH_BLOCK], out[BENCH_BLOCK];
+    unsigned seed = 0x9E3779B9;
+    size_t i, j, reps;
+    double t;
+
+    for(i = 0; i < BENCH_BLOCK; i++){
+        in[i] = (int)rnd(&seed);
+        y[i] = (int)(rnd(&seed) % 32);
+    }
+    reps = total / BENCH_BLOCK ? total / BENCH_BLOCK : 1;
+
+/* Time out[j] = expr over reps blocks, print ns per element */
+#define BENCH(name, expr) do { \
+    t = now_ns(); \
+    for(i = 0; i < reps; i++) \
+        for(j = 0; j < BENCH_BLOCK; j++) \
+            out[j] = (int)(expr); \
+    t = (now_ns() - t) / ((double)reps * BENCH_BLOCK); \
+    printf("%-16s %7.3f ns/op\n", name, t); \
+} while(0)
+
+    BENCH("minusOne", minusOne() + (int)j);
+    BENCH("implication", implication(in[j] & 1, y[j] & 1));
+    BENCH("leastBitPos", leastBitPos(in[j]));
+    BENCH("rotateLeft", rotateLeft(in[j], y[j]));
+    BENCH("conditional", conditional(in[j], y[j], out[j]));
+    BENCH("bang", bang(in[j]));
+    BENCH("oneMoreThan", oneMoreThan(in[j], y[j]));
+    BENCH("fitsBits", fitsBits(in[j], y[j] + 1));
+    BENCH("multFiveEighths", multFiveEighths(in[j]));
+    BENCH("satMul2", satMul2(in[j]));
+    BENCH("modThree", modThree(in[j]));
+    BENCH("ilog2", ilog2(in[j]));
+    BENCH("float_abs", float_abs(in[j]));
+    BENCH("float_i2f", float_i2f(in[j]));
+    BENCH("float_f2i", float_f2i(in[j]));
+    BENCH("float_negpwr2", float_negpwr2(in[j] % 300));
+#undef BENCH
+}
+
+/*
+ * fl_of - floatlib level of the instruction set of bitlib level bl,
+ *         -1 if floatlib has none (SSE2)
+ */
+static int fl_of(int bl){
+    switch(bl){
+        case BL_SCALAR: return FL_SCALAR;
+        case BL_AVX2: return FL_AVX2;
+        case BL_AVX512: return FL_AVX512;
+    }
+    return -1;
+}
+
+static void usage(void){
+    fprintf(stderr, "Usage: dlcheck [-b] [-t threads] [STRIDE] [SAMPLES]\n"
+                    "   -b  print ns/op of datalab.c, bitlib and floatlib\n"
+                    "   -t  threads (default: one per online CPU)\n"
+                    "   STRIDE  1 checks all 2^32 inputs (default 1)\n"
+                    "   SAMPLES random operands of the other functions"
+                    " (default 2^28)\n");
+    exit(1);
+}
+
+int main(int argc, char **argv){
+    unsigned long long samples = 1ULL << 28;
+    unsigned stride = 1;
+    int c, bench_p = 0, nthreads = 0, bl, fl, blmax, flmax;
+    long bad, total = 0;
+
+    while((c = getopt(argc, argv, "bt:")) != -1){
+        switch(c){
+        case 'b':
+            bench_p = 1;
+            break;
+        case 't':
+            nthreads = atoi(optarg);
+            break;
+        default:
+            usage();
+        }
+    }
+    if(optind < argc)
+        stride = (unsigned)strtoul(argv[optind++], NULL, 0);
+    if(optind < argc)
+        samples = strtoull(argv[optind++], NULL, 0);
+    if(optind < argc || stride == 0)
+        usage();
+    if(nthreads <= 0) nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(nthreads <= 0) nthreads = 1;
+
+    /* Levels from the best down, floatlib at the same instruction set */
+    blmax = bl_level();
+    flmax = fl_level();
+    for(bl = blmax; bl >= BL_SCALAR; bl--){
+        bl_set_level(bl);
+        fl = fl_of(bl);
+        if(fl > flmax)
+            fl = -1;
+        if(fl >= 0)
+            fl_set_level(fl);
+        bad = check(stride, samples, nthreads, bl == blmax, bl, fl);
+        printf("%sbitlib level %d (%s)", bl == blmax ? "datalab.c, " : "",
+            bl, bl_isa[bl]);
+        if(fl >= 0)
+            printf(", floatlib level %d (%s)", fl, fl_isa[fl]);
+        printf(": %ld mismatches\n", bad);
+        total += bad;
+    }
+    bl_set_level(blmax);
+    fl_set_level(flmax);
+
+    /* Every level against the copies and % for each divisor, on its own */
+    bad = bl_check(stride, nthreads);
+    printf("bl_check, all levels: %ld mismatches\n", bad);
+    total += bad < 0 ? 1 : bad;
+
+    /* Every level and rounding mode, fp16/bf16 included, on its own */
+    bad = fl_check(stride, nthreads);
+    printf("fl_check, all levels: %ld mismatches\n", bad);
+    total += bad < 0 ? 1 : bad;
+
+    if(bench_p){
+        bench(1 << 24);
+        bl_bench(1 << 24);
+        fl_bench(1 << 24);
+    }
+    return total != 0;
+}
@@ -0,0 +1,915 @@
+/*
+ * <Eugene Yu Jun Hao 1900094810>
+ * floatlib.c - Batched bit-level int <-> float conversions, and the array
+ *              versions of the format utilities of floatlib.h
+ *
+ * Details:
+ * 1. i2f - instead of the shift loop of float_i2f, |x| is normalized
+ *    with a count of leading zeros (vplzcntd on AVX-512, five
+ *    shift-if-top-is-zero steps otherwise). The exponent is added to the
+ *    24-bit mantissa including its hidden bit, so a rounding carry moves
+ *    into the exponent by itself.
+ * 2. f2i - the mantissa is shifted left or right by 150 - exp (both
+ *    clamped to 31, so tiny values leave everything in the remainder),
+ *    the remainder decides the rounding increment, then the sign is put
+ *    back and exp >= 158 (|f| >= 2^31, inf, NaN) gives 0x80000000.
+ * 3. Rounding - the increment is
+ *        RNE: rem > half, or rem == half and the result is odd
+ *        RTZ: never
+ *        RDN/RUP: rem != 0 and the sign points away from the direction
+ *    and is computed with masks, so no kernel branches on the data.
+ * 4. fl_check - compares every level and mode against a reference over
+ *    all 2^32 inputs (stride 1) in both directions, split over threads.
+ *    The reference is float_i2f (RNE) and float_f2i (RTZ) of the Data
+ *    Lab; the other modes are checked against the x86 conversion
+ *    instructions under the matching MXCSR rounding mode. dlcheck.c
+ *    checks the Data Lab versions and RNE/RTZ against (float)x and (int)f.
+ *    fl_bench - ns/op of every level and mode next to the Data Lab
+ *    versions, to catch speed regressions next to correctness ones.
+ * 5. Formats - fp16, bf16, fp32 and fp64 share one implementation in
+ *    floatlib.h, macros over the layout (exponent and fraction bits) so
+ *    every mask and shift is a constant. Values are unpacked into a
+ *    significand with its leading one at a fixed bit (subnormals
+ *    normalized with a step clz) and an exponent, and packed back with
+ *    the rounding of i2f; ldexp and every conversion are unpack, add,
+ *    pack. The arrays are plain loops over them, built with
+ *    tree-vectorize once per level.
+ * 6. fl_check16 - every fp16 and bf16 input, at every scale for ldexp,
+ *    against the value computed by the FPU in double; fl_check covers
+ *    fp32 (float_abs, float_negpwr2 and the FPU) and fp64 (libm ldexp and
+ *    the conversion instructions) on its 2^32 inputs.
+ *
+ * Build: gcc -O2 -pthread -c floatlib.c
+ */
+
+#include <math.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "floatlib.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FL_X86
+#include <immintrin.h>
+#define AVX2   __attribute__((target("avx2")))
+#define AVX512 __attribute__((target("avx512f,avx512cd")))
+#endif
+
+typedef void i2f_t(const int *x, unsigned *out, size_t n, int mode);
+typedef void f2i_t(const unsigned *uf, int *out, size_t n, int mode);
+typedef int convert_t(const void *x, int from, void *out, int to, size_t n);
+typedef void scale_t(const void *x, int fmt, int k, void *out, size_t n);
+
+struct fl_kernels {
+    i2f_t *i2f;
+    f2i_t *f2i;
+    convert_t *convert;
+    scale_t *scale;
+};
+
+static struct fl_kernels *impl = 0;  /* kernels in use */
+static int level = -1;               /* level in use */
+static int maxlevel = -1;            /* best level of this CPU */
+
+/*
+ * Rounding mode as lane masks (all ones or zero):
+ *   ne: round to nearest even, dir: directed, up: toward +inf
+ */
+#define MODE_NE(mode)   (-(unsigned)((mode) == FL_RNE))
+#define MODE_DIR(mode)  (-(unsigned)((mode) == FL_RDN || (mode) == FL_RUP))
+#define MODE_UP(mode)   (-(unsigned)((mode) == FL_RUP))
+
+/*
+ * FL_ARRAY_KERNELS(pfx, attr) - define pfx_convert and pfx_scale, loops
+ * over the branch-free inline utilities of floatlib.h that the compiler
+ * vectorizes for the instruction set of attr
+ */
+#define CONVERT_LOOP(FROM, from, TF, TO, to, TT) \
+    case FL_FMT_##FROM * 4 + FL_FMT_##TO: { \
+        const TF *x_ = x; TT *out_ = out; size_t i_; \
+        for(i_ = 0; i_ < n; i_++) out_[i_] = fl_##from##_to_##to(x_[i_]); \
+        return 0; \
+    }
+#define SCALE_LOOP(F, f, T) \
+    case FL_FMT_##F: { \
+        const T *x_ = x; T *out_ = out; size_t i_; \
+        for(i_ = 0; i_ < n; i_++) out_[i_] = fl_ldexp_##f(x_[i_], k); \
+        return; \
+    }
+#define FL_ARRAY_KERNELS(pfx, attr) \
+attr static int pfx##_convert(const void *x, int from, void *out, int to, size_t n){ \
+    switch(from * 4 + to){ \
+    CONVERT_LOOP(FP32, fp32, uint32_t, FP16, fp16, uint16_t) \
+    CONVERT_LOOP(FP16, fp16, uint16_t, FP32, fp32, uint32_t) \
+    CONVERT_LOOP(FP32, fp32, uint32_t, BF16, bf16, uint16_t) \
+    CONVERT_LOOP(BF16, bf16, uint16_t, FP32, fp32, uint32_t) \
+    CONVERT_LOOP(FP32, fp32, uint32_t, FP64, fp64, uint64_t) \
+    CONVERT_LOOP(FP64, fp64, uint64_t, FP32, fp32, uint32_t) \
+    } \
+    return -1; \
+} \
+attr static void pfx##_scale(const void *x, int fmt, int k, void *out, size_t n){ \
+    switch(fmt){ \
+    SCALE_LOOP(FP16, fp16, uint16_t) \
+    SCALE_LOOP(BF16, bf16, uint16_t) \
+    SCALE_LOOP(FP32, fp32, uint32_t) \
+    SCALE_LOOP(FP64, fp64, uint64_t) \
+    } \
+}
+
+/*=========================== SCALAR ===========================*/
+
+static unsigned i2f_bits(int x, unsigned ne, unsigned dir, unsigned up){
+    unsigned s = (unsigned)x >> 31;
+    unsigned a = ((unsigned)x ^ -s) + s;        /* |x|, Tmin -> 2^31 */
+    unsigned nz = -(unsigned)(a != 0);
+    int lz = __builtin_clz(a | 1);
+    unsigned norm = a << lz;                    /* leading 1 at bit 31 */
+    unsigned r = norm & 0xFF;                   /* bits rounded off */
+    unsigned bits = ((unsigned)(157 - lz) << 23) + (norm >> 8);
+    unsigned inc = (ne & -(unsigned)(r + ((norm >> 8) & 1) > 0x80))
+                 | (dir & -(unsigned)(r != 0) & (-s ^ up));
+    return ((bits + (inc & 1)) & nz) | (s << 31);
+}
+
+static int f2i_bits(unsigned uf, unsigned ne, unsigned dir, unsigned up){
+    unsigned s = uf >> 31;
+    unsigned exp = (uf >> 23) & 0xFF;
+    unsigned frac = (uf & 0x7FFFFF) | ((unsigned)(exp != 0) << 23);
+    int sh = 150 - (int)exp;
+    int left = sh < 0 ? (-sh > 31 ? 31 : -sh) : 0;
+    int right = sh > 0 ? (sh > 31 ? 31 : sh) : 0;
+    unsigned q = (frac << left) >> right;
+    unsigned rem = frac & ((1u << right) - 1);
+    unsigned half = (1u << right) >> 1;
+    unsigned inc = (ne & -(unsigned)(rem > half || (rem == half && rem && (q & 1))))
+                 | (dir & -(unsigned)(rem != 0) & (-s ^ up));
+    unsigned mag = q + (inc & 1);
+    unsigned ovf = -(unsigned)(exp >= 158);
+    return (int)((((mag ^ -s) + s) & ~ovf) | (0x80000000u & ovf));
+}
+
+static void scalar_i2f(const int *x, unsigned *out, size_t n, int mode){
+    unsigned ne = MODE_NE(mode), dir = MODE_DIR(mode), up = MODE_UP(mode);
+    size_t i;
+    for(i = 0; i < n; i++) out[i] = i2f_bits(x[i], ne, dir, up);
+}
+
+static void scalar_f2i(const unsigned *uf, int *out, size_t n, int mode){
+    unsigned ne = MODE_NE(mode), dir = MODE_DIR(mode), up = MODE_UP(mode);
+    size_t i;
+    for(i = 0; i < n; i++) out[i] = f2i_bits(uf[i], ne, dir, up);
+}
+
+#pragma GCC push_options
+#pragma GCC optimize("tree-vectorize")
+FL_ARRAY_KERNELS(scalar, )
+#pragma GCC pop_options
+
+static struct fl_kernels scalar_kernels = {
+    scalar_i2f, scalar_f2i, scalar_convert, scalar_scale
+};
+
+#ifdef FL_X86
+/*=========================== AVX2 (8 lanes) ===========================*/
+
+#define LOAD256(p)      _mm256_loadu_si256((const __m256i *)(p))
+#define STORE256(p, v)  _mm256_storeu_si256((__m256i *)(p), (v))
+
+/* Shift a left by k when its top k bits are zero, count k into lz */
+#define NORM256(a, lz, k) do { \
+    __m256i m_ = _mm256_cmpeq_epi32(_mm256_srli_epi32(a, 32 - (k)), zero); \
+    a = _mm256_blendv_epi8(a, _mm256_slli_epi32(a, k), m_); \
+    lz = _mm256_add_epi32(lz, _mm256_and_si256(m_, _mm256_set1_epi32(k))); \
+} while(0)
+
+AVX2 static void avx2_i2f(const int *x, unsigned *out, size_t n, int mode){
+    __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi32(1);
+    __m256i ne = _mm256_set1_epi32(MODE_NE(mode));
+    __m256i dir = _mm256_set1_epi32(MODE_DIR(mode));
+    __m256i up = _mm256_set1_epi32(MODE_UP(mode));
+    __m256i e157 = _mm256_set1_epi32(157), ff = _mm256_set1_epi32(0xFF);
+    __m256i h80 = _mm256_set1_epi32(0x80);
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8){
+        __m256i v = LOAD256(x + i);
+        __m256i neg = _mm256_srai_epi32(v, 31);
+        __m256i a = _mm256_abs_epi32(v), lz = zero;
+        __m256i nz = _mm256_andnot_si256(_mm256_cmpeq_epi32(a, zero),
+                                         _mm256_set1_epi32(-1));
+        __m256i bits, r, inc;
+        NORM256(a, lz, 16);
+        NORM256(a, lz, 8);
+        NORM256(a, lz, 4);
+        NORM256(a, lz, 2);
+        NORM256(a, lz, 1);
+        bits = _mm256_add_epi32(_mm256_slli_epi32(_mm256_sub_epi32(e157, lz), 23),
+                                _mm256_srli_epi32(a, 8));
+        r = _mm256_and_si256(a, ff);
+        inc = _mm256_and_si256(ne, _mm256_cmpgt_epi32(_mm256_add_epi32(r,
+                  _mm256_and_si256(_mm256_srli_epi32(a, 8), one)), h80));
+        inc = _mm256_or_si256(inc, _mm256_andnot_si256(_mm256_cmpeq_epi32(r, zero),
+                  _mm256_and_si256(_mm256_xor_si256(neg, up), dir)));
+        bits = _mm256_and_si256(_mm256_sub_epi32(bits, inc), nz);
+        STORE256(out + i, _mm256_or_si256(bits, _mm256_slli_epi32(neg, 31)));
+    }
+    scalar_i2f(x + i, out + i, n - i, mode);
+}
+
+AVX2 static void avx2_f2i(const unsigned *uf, int *out, size_t n, int mode){
+    __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi32(1);
+    __m256i ne = _mm256_set1_epi32(MODE_NE(mode));
+    __m256i dir = _mm256_set1_epi32(MODE_DIR(mode));
+    __m256i up = _mm256_set1_epi32(MODE_UP(mode));
+    __m256i e150 = _mm256_set1_epi32(150), e157 = _mm256_set1_epi32(157);
+    __m256i c31 = _mm256_set1_epi32(31), ff = _mm256_set1_epi32(0xFF);
+    __m256i man = _mm256_set1_epi32(0x7FFFFF), tmin = _mm256_set1_epi32(0x80000000);
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8){
+        __m256i u = LOAD256(uf + i);
+        __m256i neg = _mm256_srai_epi32(u, 31);
+        __m256i exp = _mm256_and_si256(_mm256_srli_epi32(u, 23), ff);
+        __m256i frac = _mm256_or_si256(_mm256_and_si256(u, man),
+            _mm256_andnot_si256(_mm256_cmpeq_epi32(exp, zero), _mm256_set1_epi32(0x800000)));
+        __m256i sh = _mm256_sub_epi32(e150, exp);
+        __m256i left = _mm256_min_epi32(_mm256_max_epi32(_mm256_sub_epi32(zero, sh), zero), c31);
+        __m256i right = _mm256_min_epi32(_mm256_max_epi32(sh, zero), c31);
+        __m256i q = _mm256_srlv_epi32(_mm256_sllv_epi32(frac, left), right);
+        __m256i bit = _mm256_sllv_epi32(one, right);
+        __m256i rem = _mm256_and_si256(frac, _mm256_sub_epi32(bit, one));
+        __m256i half = _mm256_srli_epi32(bit, 1);
+        __m256i tie = _mm256_andnot_si256(_mm256_cmpeq_epi32(rem, zero),
+            _mm256_and_si256(_mm256_cmpeq_epi32(rem, half),
+                             _mm256_cmpeq_epi32(_mm256_and_si256(q, one), one)));
+        __m256i inc = _mm256_and_si256(ne, _mm256_or_si256(tie, _mm256_cmpgt_epi32(rem, half)));
+        __m256i ovf = _mm256_cmpgt_epi32(exp, e157);
+        inc = _mm256_or_si256(inc, _mm256_andnot_si256(_mm256_cmpeq_epi32(rem, zero),
+                  _mm256_and_si256(_mm256_xor_si256(neg, up), dir)));
+        q = _mm256_sub_epi32(q, inc);
+        q = _mm256_sub_epi32(_mm256_xor_si256(q, neg), neg);
+        STORE256(out + i, _mm256_blendv_epi8(q, tmin, ovf));
+    }
+    scalar_f2i(uf + i, out + i, n - i, mode);
+}
+
+#pragma GCC push_options
+#pragma GCC optimize("tree-vectorize")
+FL_ARRAY_KERNELS(avx2, AVX2)
+#pragma GCC pop_options
+
+static struct fl_kernels avx2_kernels = {
+    avx2_i2f, avx2_f2i, avx2_convert, avx2_scale
+};
+
+/*=========================== AVX-512 (16 lanes) ===========================*/
+
+#define LOAD512(p)      _mm512_loadu_si512((const void *)(p))
+#define STORE512(p, v)  _mm512_storeu_si512((void *)(p), (v))
+
+AVX512 static void avx512_i2f(const int *x, unsigned *out, size_t n, int mode){
+    __m512i zero = _mm512_setzero_si512(), one = _mm512_set1_epi32(1);
+    __m512i e157 = _mm512_set1_epi32(157), ff = _mm512_set1_epi32(0xFF);
+    __m512i h80 = _mm512_set1_epi32(0x80);
+    __mmask16 ne = (__mmask16)MODE_NE(mode), dir = (__mmask16)MODE_DIR(mode);
+    __mmask16 up = (__mmask16)MODE_UP(mode);
+    size_t i;
+    for(i = 0; i + 16 <= n; i += 16){
+        __m512i v = LOAD512(x + i);
+        __m512i a = _mm512_abs_epi32(v);
+        __m512i lz = _mm512_lzcnt_epi32(a);
+        __m512i norm = _mm512_sllv_epi32(a, lz);
+        __m512i r = _mm512_and_si512(norm, ff);
+        __mmask16 neg = _mm512_cmplt_epi32_mask(v, zero);
+        __mmask16 inc = (ne & _mm512_cmpgt_epi32_mask(_mm512_add_epi32(r,
+                            _mm512_and_si512(_mm512_srli_epi32(norm, 8), one)), h80))
+                      | (dir & _mm512_test_epi32_mask(r, r) & (neg ^ up));
+        __m512i bits = _mm512_add_epi32(_mm512_slli_epi32(_mm512_sub_epi32(e157, lz), 23),
+                                        _mm512_srli_epi32(norm, 8));
+        bits = _mm512_mask_add_epi32(bits, inc, bits, one);
+        bits = _mm512_maskz_mov_epi32(_mm512_test_epi32_mask(a, a), bits);
+        STORE512(out + i, _mm512_or_si512(bits, _mm512_slli_epi32(
+            _mm512_srli_epi32(v, 31), 31)));
+    }
+    scalar_i2f(x + i, out + i, n - i, mode);
+}
+
+AVX512 static void avx512_f2i(const unsigned *uf, int *out, size_t n, int mode){
+    __m512i zero = _mm512_setzero_si512(), one = _mm512_set1_epi32(1);
+    __m512i e150 = _mm512_set1_epi32(150), c31 = _mm512_set1_epi32(31);
+    __m512i ff = _mm512_set1_epi32(0xFF), man = _mm512_set1_epi32(0x7FFFFF);
+    __m512i tmin = _mm512_set1_epi32(0x80000000);
+    __mmask16 ne = (__mmask16)MODE_NE(mode), dir = (__mmask16)MODE_DIR(mode);
+    __mmask16 up = (__mmask16)MODE_UP(mode);
+    size_t i;
+    for(i = 0; i + 16 <= n; i += 16){
+        __m512i u = LOAD512(uf + i);
+        __m512i exp = _mm512_and_si512(_mm512_srli_epi32(u, 23), ff);
+        __m512i frac = _mm512_mask_or_epi32(_mm512_and_si512(u, man),
+            _mm512_test_epi32_mask(exp, exp), _mm512_and_si512(u, man),
+            _mm512_set1_epi32(0x800000));
+        __m512i sh = _mm512_sub_epi32(e150, exp);
+        __m512i left = _mm512_min_epi32(_mm512_max_epi32(_mm512_sub_epi32(zero, sh), zero), c31);
+        __m512i right = _mm512_min_epi32(_mm512_max_epi32(sh, zero), c31);
+        __m512i q = _mm512_srlv_epi32(_mm512_sllv_epi32(frac, left), right);
+        __m512i bit = _mm512_sllv_epi32(one, right);
+        __m512i rem = _mm512_and_si512(frac, _mm512_sub_epi32(bit, one));
+        __m512i half = _mm512_srli_epi32(bit, 1);
+        __mmask16 neg = _mm512_cmplt_epi32_mask(u, zero);
+        __mmask16 nzrem = _mm512_test_epi32_mask(rem, rem);
+        __mmask16 inc = (ne & (_mm512_cmpgt_epi32_mask(rem, half)
+                              | (nzrem & _mm512_cmpeq_epi32_mask(rem, half)
+                                 & _mm512_test_epi32_mask(q, one))))
+                      | (dir & nzrem & (neg ^ up));
+        q = _mm512_mask_add_epi32(q, inc, q, one);
+        q = _mm512_mask_sub_epi32(q, neg, zero, q);
+        q = _mm512_mask_mov_epi32(q, _mm512_cmpgt_epi32_mask(exp, _mm512_set1_epi32(157)), tmin);
+        STORE512(out + i, q);
+    }
+    scalar_f2i(uf + i, out + i, n - i, mode);
+}
+
+#pragma GCC push_options
+#pragma GCC optimize("tree-vectorize")
+FL_ARRAY_KERNELS(avx512, AVX512)
+#pragma GCC pop_options
+
+static struct fl_kernels avx512_kernels = {
+    avx512_i2f, avx512_f2i, avx512_convert, avx512_scale
+};
+#endif /* FL_X86 */
+
+/*=========================== DISPATCH ===========================*/
+
+static struct fl_kernels *kernels(int l){
+#ifdef FL_X86
+    switch(l){
+        case FL_AVX2: return &avx2_kernels;
+        case FL_AVX512: return &avx512_kernels;
+    }
+#endif
+    return &scalar_kernels;
+}
+
+/*
+ * fl_init - pick the best level supported by the CPU
+ */
+static void fl_init(void){
+    maxlevel = FL_SCALAR;
+#ifdef FL_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd"))
+        maxlevel = FL_AVX512;
+    else if(__builtin_cpu_supports("avx2"))
+        maxlevel = FL_AVX2;
+#endif
+    level = maxlevel;
+    impl = kernels(level);
+}
+
+int fl_level(void){
+    if(impl == 0) fl_init();
+    return level;
+}
+
+int fl_set_level(int l){
+    if(impl == 0) fl_init();
+    if(l < FL_SCALAR) l = FL_SCALAR;
+    if(l > maxlevel) l = maxlevel;
+    level = l;
+    impl = kernels(level);
+    return level;
+}
+
+void fl_i2f(const int *x, unsigned *out, size_t n, int mode){
+    if(impl == 0) fl_init();
+    impl->i2f(x, out, n, mode);
+}
+
+void fl_f2i(const unsigned *uf, int *out, size_t n, int mode){
+    if(impl == 0) fl_init();
+    impl->f2i(uf, out, n, mode);
+}
+
+int fl_convert(const void *x, int from, void *out, int to, size_t n){
+    if(impl == 0) fl_init();
+    return impl->convert(x, from, out, to, n);
+}
+
+void fl_scale(const void *x, int fmt, int k, void *out, size_t n){
+    if(impl == 0) fl_init();
+    impl->scale(x, fmt, k, out, n);
+}
+
+/*=========================== REFERENCE (datalab.c) ===========================*/
+/* Verbatim, int compared with 0x80000000 included */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-compare"
+
+static unsigned float_i2f(int x) {
+  //float:1,8,23
+  unsigned tmin = 0x80000000;
+  unsigned sign = 0;
+  unsigned frac = x;
+  unsigned exp = 0;
+  unsigned bias = 0x7F;
+  unsigned shift = 0;
+  unsigned carry = 0;
+  unsigned tail = 0;
+  unsigned ditch = 0;
+  unsigned res = 0;
+  if(x == 0)return 0;
+  else if(x == tmin)return 0xCF000000;
+  if(x & tmin){
+    sign = 1;
+    frac = -x ;
+  }
+  while(!(frac & tmin)){
+    shift += 1;
+    frac <<= 1;
+  }
+  exp = 31-shift+bias;
+  tail = (frac&0x100)>>8;
+  ditch = frac&0xff;
+  if((ditch > 0x80) || (ditch == 0x80 && tail == 1))carry=1;
+  res |= (sign << 31) | (exp<<23) | ((frac>>8) & 0x7FFFFF);
+  res += carry;
+  return res;
+}
+
+static int float_f2i(unsigned uf) {
+  //float: 1,8,23
+  unsigned sign = (uf >> 31) & 1;
+  unsigned exp = (uf >> 23) & 0xFF;
+  unsigned frac = uf & 0x7FFFFF;
+  unsigned bias = 0x7F;
+  unsigned E;
+  unsigned inf = 0x80000000u;
+  int shift;
+  if(exp == 0xFF)return inf;
+  else if(exp < bias)return 0;
+  else{
+    E = exp - bias;
+    if(E >= 31)return inf;
+    frac |= 0x800000;
+    shift = 23-E;
+    if(shift >= 0)frac = frac >> shift;
+    else frac = frac << -shift;
+    if(sign)frac = -frac;
+    return frac;
+  }
+}
+
+static unsigned float_abs(unsigned uf) {
+  //single-precision : 1,8,23 ; double-precision: 1,11,52
+  //minNaN s111 1111 1000 0000 0001
+  unsigned minNaN = 0x7F800001;
+  unsigned res = uf & 0x7FFFFFFF;
+  if(res >= minNaN)return uf;
+  else return res;
+}
+
+static unsigned float_negpwr2(int x) {
+    unsigned inf = 0xFF<<23;
+    unsigned res = 0;
+    if(x == 0x80000000)return inf;
+    x = -x;
+    if(x > 127)return inf;
+    else if(x <= 127 && x >= -126){
+      res = (x + 127) << 23;
+    }
+    else if(x < -126 && x >= -149){
+      res = 1 << (23+126+x);
+    }
+    else if(x < -149)res = 0;
+    return res;
+}
+#pragma GCC diagnostic pop
+
+/*
+ * ref_value - the value of x in layout eb,mb as a double (exact for the
+ *             16- and 32-bit formats)
+ * ref_round - the bits in layout eb,mb of v (not NaN) rounded to nearest
+ *             even by the FPU
+ * ref_nan   - the quiet NaN in layout ebt,mbt converted from the NaN x
+ * ref_class - the FL_* class of v in a format with bias bias
+ */
+static double ref_value(uint64_t x, int eb, int mb){
+    uint64_t emax = (1ULL << eb) - 1;
+    uint64_t exp = (x >> mb) & emax, frac = x & ((1ULL << mb) - 1);
+    int bias = (int)(emax >> 1);
+    double v;
+
+    if(exp == emax) v = frac ? NAN : INFINITY;
+    else if(exp == 0) v = ldexp((double)frac, 1 - bias - mb);
+    else v = ldexp((double)(frac | 1ULL << mb), (int)exp - bias - mb);
+    return ((x >> (eb + mb)) & 1) ? -v : v;
+}
+
+static uint64_t ref_round(double v, int eb, int mb){
+    uint64_t s = signbit(v) ? 1ULL << (eb + mb) : 0;
+    uint64_t inf = ((1ULL << eb) - 1) << mb, mag;
+    int bias = (1 << (eb - 1)) - 1, k, ue;
+    double a = fabs(v);
+
+    if(a == 0) return s;
+    if(isinf(a)) return s | inf;
+    frexp(a, &k);                               /* 2^(k-1) <= a < 2^k */
+    ue = (k - 1 < 1 - bias ? 1 - bias : k - 1) - mb;  /* weight of the last bit */
+    mag = (uint64_t)nearbyint(ldexp(a, -ue));
+    if(k - 1 >= 1 - bias)
+        mag += ((uint64_t)(k - 1 + bias) << mb) - (1ULL << mb);
+    return s | (mag >= inf ? inf : mag);
+}
+
+static uint64_t ref_nan(uint64_t x, int ebf, int mbf, int ebt, int mbt){
+    uint64_t frac = x & ((1ULL << mbf) - 1);
+    uint64_t s = (x >> (ebf + mbf)) << (ebt + mbt);
+    if(mbt >= mbf) frac <<= mbt - mbf;
+    else frac >>= mbf - mbt;
+    return s | ((1ULL << ebt) - 1) << mbt | 1ULL << (mbt - 1) | (frac & ((1ULL << mbt) - 1));
+}
+
+static int ref_class(double v, int bias){
+    if(isnan(v)) return FL_NAN;
+    if(isinf(v)) return FL_INFINITE;
+    if(v == 0) return FL_ZERO;
+    if(fabs(v) < ldexp(1.0, 1 - bias)) return FL_SUBNORMAL;
+    return FL_NORMAL;
+}
+
+/*
+ * ref_i2f, ref_f2i - reference conversion in rounding mode mode,
+ *                    return 0 if there is none on this machine
+ */
+static int ref_i2f(const int *x, unsigned *out, size_t n, int mode){
+    size_t i;
+    if(mode == FL_RNE){
+        for(i = 0; i < n; i++) out[i] = float_i2f(x[i]);
+        return 1;
+    }
+#ifdef FL_X86
+    for(i = 0; i < n; i++)
+        out[i] = _mm_cvtsi128_si32(_mm_castps_si128(
+            _mm_cvtsi32_ss(_mm_setzero_ps(), x[i])));
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+static int ref_f2i(const unsigned *uf, int *out, size_t n, int mode){
+    size_t i;
+    if(mode == FL_RTZ){
+        for(i = 0; i < n; i++) out[i] = float_f2i(uf[i]);
+        return 1;
+    }
+#ifdef FL_X86
+    for(i = 0; i < n; i++)
+        out[i] = _mm_cvtss_si32(_mm_castsi128_ps(_mm_cvtsi32_si128(uf[i])));
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/*=========================== CHECK ===========================*/
+
+#define CHECK_BLOCK 4096    /* inputs per comparison */
+
+struct check_arg {
+    unsigned long long lo, hi;  /* input indices [lo, hi) of this thread */
+    unsigned stride;
+    long bad;                   /* mismatches found */
+};
+
+/*
+ * compare - count lanes where got differs from want, print the first one
+ */
+static long compare(const char *name, int l, int mode, const unsigned *in,
+                    const unsigned *got, const unsigned *want, size_t n){
+    size_t i;
+    long bad = 0;
+    for(i = 0; i < n; i++){
+        if(got[i] != want[i]){
+            if(bad++ == 0)
+                printf("fl_check: %s level %d mode %d x=0x%x got 0x%x want 0x%x\n",
+                    name, l, mode, in[i], got[i], want[i]);
+        }
+    }
+    return bad;
+}
+
+/*
+ * report - print the first few mismatches of the format utilities (at
+ *          level -1 for the inline functions), return 1
+ */
+static int report(const char *name, int l, uint64_t x, uint64_t got, uint64_t want){
+    static int reported = 0;
+    if(__sync_fetch_and_add(&reported, 1) < 10)
+        printf("fl_check: %s level %d x=0x%llx got 0x%llx want 0x%llx\n", name, l,
+            (unsigned long long)x, (unsigned long long)got, (unsigned long long)want);
+    return 1;
+}
+
+#define EXPECT(name, l, x, got, want) do { \
+    uint64_t got_ = (got), want_ = (want); \
+    if(got_ != want_) bad += report(name, l, x, got_, want_); \
+} while(0)
+
+static uint64_t bits64(double d){
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    return u;
+}
+
+static uint32_t bits32(float f){
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+/*
+ * check_formats - check the fp32 and fp64 utilities on the fp32 inputs in
+ * and on as many fp64 inputs spread from them, against float_abs,
+ * float_negpwr2, the FPU and libm; then the array kernels of every level
+ * against the inline functions
+ */
+static long check_formats(const unsigned *in, size_t n){
+    static const int k32[] = { -300, -160, -150, -149, -127, -126, -24, -1,
+                               1, 24, 127, 128, 160, 300 };
+    static const int k64[] = { -2200, -1100, -1075, -1074, -1023, -1022, -53,
+                               -1, 1, 53, 1023, 1024, 2200 };
+    uint16_t h[CHECK_BLOCK], b[CHECK_BLOCK];
+    uint32_t f[CHECK_BLOCK], s32[CHECK_BLOCK];
+    uint64_t y[CHECK_BLOCK], d[CHECK_BLOCK], s64[CHECK_BLOCK], got[CHECK_BLOCK];
+    size_t i, j;
+    long bad = 0;
+    int l;
+
+    for(i = 0; i < n; i++){
+        unsigned x = in[i];
+        int nx = (int)x == INT_MIN ? INT_MAX : -(int)x;
+        double v = ref_value(x, 8, 23), dy;
+        float fx;
+
+        memcpy(&fx, &x, sizeof(fx));
+        y[i] = (uint64_t)x * 0x9E3779B97F4A7C15ULL;
+        memcpy(&dy, &y[i], sizeof(dy));
+        h[i] = fl_fp32_to_fp16(x);
+        b[i] = fl_fp32_to_bf16(x);
+        d[i] = fl_fp32_to_fp64(x);
+        f[i] = fl_fp64_to_fp32(y[i]);
+        s32[i] = fl_ldexp_fp32(x, -130);
+        s64[i] = fl_ldexp_fp64(y[i], -1030);
+
+        EXPECT("abs_fp32", -1, x, fl_abs_fp32(x), float_abs(x));
+        EXPECT("negpwr2", -1, x, fl_ldexp_fp32(0x3F800000, nx), float_negpwr2((int)x));
+        EXPECT("classify_fp32", -1, x, fl_classify_fp32(x), ref_class(v, 127));
+        EXPECT("neg_fp32", -1, x, fl_neg_fp32(x), isnan(v) ? x : ref_round(-v, 8, 23));
+        for(j = 0; j < sizeof(k32) / sizeof(k32[0]); j++)
+            EXPECT("ldexp_fp32", -1, x, fl_ldexp_fp32(x, k32[j]),
+                isnan(v) ? x : ref_round(ldexp(v, k32[j]), 8, 23));
+        EXPECT("fp32_to_fp16", -1, x, h[i],
+            isnan(v) ? ref_nan(x, 8, 23, 5, 10) : ref_round(v, 5, 10));
+        EXPECT("fp32_to_bf16", -1, x, b[i],
+            isnan(v) ? ref_nan(x, 8, 23, 8, 7) : ref_round(v, 8, 7));
+        EXPECT("fp32_to_fp64", -1, x, d[i], bits64(fx));
+        EXPECT("fp64_to_fp32", -1, y[i], f[i], bits32((float)dy));
+        EXPECT("classify_fp64", -1, y[i], fl_classify_fp64(y[i]), ref_class(dy, 1023));
+        EXPECT("abs_fp64", -1, y[i], fl_abs_fp64(y[i]), isnan(dy) ? y[i] : bits64(fabs(dy)));
+        for(j = 0; j < sizeof(k64) / sizeof(k64[0]); j++)
+            EXPECT("ldexp_fp64", -1, y[i], fl_ldexp_fp64(y[i], k64[j]),
+                isnan(dy) ? y[i] : bits64(ldexp(dy, k64[j])));
+    }
+
+    for(l = FL_SCALAR; l <= maxlevel; l++){
+        uint16_t *g16 = (uint16_t *)got;
+        uint32_t *g32 = (uint32_t *)got;
+
+        kernels(l)->convert(in, FL_FMT_FP32, g16, FL_FMT_FP16, n);
+        for(i = 0; i < n; i++) EXPECT("fp32_to_fp16", l, in[i], g16[i], h[i]);
+        kernels(l)->convert(in, FL_FMT_FP32, g16, FL_FMT_BF16, n);
+        for(i = 0; i < n; i++) EXPECT("fp32_to_bf16", l, in[i], g16[i], b[i]);
+        kernels(l)->convert(in, FL_FMT_FP32, got, FL_FMT_FP64, n);
+        for(i = 0; i < n; i++) EXPECT("fp32_to_fp64", l, in[i], got[i], d[i]);
+        kernels(l)->convert(y, FL_FMT_FP64, g32, FL_FMT_FP32, n);
+        for(i = 0; i < n; i++) EXPECT("fp64_to_fp32", l, y[i], g32[i], f[i]);
+        kernels(l)->scale(in, FL_FMT_FP32, -130, g32, n);
+        for(i = 0; i < n; i++) EXPECT("ldexp_fp32", l, in[i], g32[i], s32[i]);
+        kernels(l)->scale(y, FL_FMT_FP64, -1030, got, n);
+        for(i = 0; i < n; i++) EXPECT("ldexp_fp64", l, y[i], got[i], s64[i]);
+    }
+    return bad;
+}
+
+static void *check_thread(void *vargp){
+    struct check_arg *arg = vargp;
+    unsigned in[CHECK_BLOCK], want[CHECK_BLOCK], got[CHECK_BLOCK];
+    unsigned long long x;
+    size_t i, n;
+    int l, mode;
+#ifdef FL_X86
+    static const unsigned mxcsr[4] = { _MM_ROUND_NEAREST, _MM_ROUND_TOWARD_ZERO,
+                                       _MM_ROUND_DOWN, _MM_ROUND_UP };
+#endif
+
+    for(x = arg->lo; x < arg->hi; x += n){
+        n = (arg->hi - x < CHECK_BLOCK) ? arg->hi - x : CHECK_BLOCK;
+        for(i = 0; i < n; i++)
+            in[i] = (unsigned)((x + i) * arg->stride);
+        for(mode = FL_RNE; mode <= FL_RUP; mode++){
+#ifdef FL_X86
+            _MM_SET_ROUNDING_MODE(mxcsr[mode]);
+#endif
+            if(ref_i2f((int *)in, want, n, mode)){
+                for(l = FL_SCALAR; l <= maxlevel; l++){
+                    kernels(l)->i2f((int *)in, got, n, mode);
+                    arg->bad += compare("i2f", l, mode, in, got, want, n);
+                }
+            }
+            if(ref_f2i(in, (int *)want, n, mode)){
+                for(l = FL_SCALAR; l <= maxlevel; l++){
+                    kernels(l)->f2i(in, (int *)got, n, mode);
+                    arg->bad += compare("f2i", l, mode, in, got, want, n);
+                }
+            }
+        }
+#ifdef FL_X86
+        _MM_SET_ROUNDING_MODE(_MM_ROUND_NEAREST);
+#endif
+        arg->bad += check_formats(in, n);
+    }
+#ifdef FL_X86
+    _MM_SET_ROUNDING_MODE(_MM_ROUND_NEAREST);
+#endif
+    return NULL;
+}
+
+/*
+ * fl_check16 - check the fp16 and bf16 utilities on all 2^16 inputs (every
+ *              scale that matters for ldexp) against the FPU, then the
+ *              array kernels of every level against the inline functions
+ */
+long fl_check16(void){
+    static uint16_t in[1 << 16], got[1 << 16];
+    static uint32_t want32[1 << 16], got32[1 << 16];
+    long bad = 0;
+    int x, k, kmax, l;
+
+    if(impl == 0) fl_init();
+    for(x = 0; x < (1 << 16); x++)
+        in[x] = (uint16_t)x;
+
+/* Check format f (layout eb,mb, array format fmt) */
+#define CHECK16(f, fmt, eb, mb) do { \
+    kmax = (1 << (eb)) + (mb) + 2; \
+    for(x = 0; x < (1 << 16); x++){ \
+        double v = ref_value(x, eb, mb); \
+        EXPECT("classify_" #f, -1, x, fl_classify_##f(x), ref_class(v, (1 << ((eb) - 1)) - 1)); \
+        EXPECT("abs_" #f, -1, x, fl_abs_##f(x), isnan(v) ? (uint64_t)x : ref_round(fabs(v), eb, mb)); \
+        EXPECT("neg_" #f, -1, x, fl_neg_##f(x), isnan(v) ? (uint64_t)x : ref_round(-v, eb, mb)); \
+        want32[x] = fl_##f##_to_fp32(x); \
+        EXPECT(#f "_to_fp32", -1, x, want32[x], \
+            isnan(v) ? ref_nan(x, eb, mb, 8, 23) : ref_round(v, 8, 23)); \
+        for(k = -kmax; k <= kmax; k++) \
+            EXPECT("ldexp_" #f, -1, x, fl_ldexp_##f(x, k), \
+                isnan(v) ? (uint64_t)x : ref_round(ldexp(v, k), eb, mb)); \
+    } \
+    for(l = FL_SCALAR; l <= maxlevel; l++){ \
+        kernels(l)->convert(in, fmt, got32, FL_FMT_FP32, 1 << 16); \
+        for(x = 0; x < (1 << 16); x++) \
+            EXPECT(#f "_to_fp32", l, x, got32[x], want32[x]); \
+        for(k = -kmax; k <= kmax; k++){ \
+            kernels(l)->scale(in, fmt, k, got, 1 << 16); \
+            for(x = 0; x < (1 << 16); x++) \
+                EXPECT("ldexp_" #f, l, x, got[x], fl_ldexp_##f(x, k)); \
+        } \
+    } \
+} while(0)
+
+    CHECK16(fp16, FL_FMT_FP16, 5, 10);
+    CHECK16(bf16, FL_FMT_BF16, 8, 7);
+#undef CHECK16
+    return bad;
+}
+
+/*
+ * fl_check - compare every level and rounding mode against the reference
+ * Inputs are 0, stride, 2*stride, ... (mod 2^32); stride 1 is exhaustive.
+ * nthreads <= 0 uses one thread per online CPU.
+ * Returns the number of mismatching results.
+ */
+long fl_check(unsigned stride, int nthreads){
+    struct check_arg *args;
+    pthread_t *tids;
+    unsigned long long end;
+    long bad = 0;
+    int i;
+
+    if(impl == 0) fl_init();
+    if(stride == 0) stride = 1;
+    if(nthreads <= 0) nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(nthreads <= 0) nthreads = 1;
+    end = ((1ULL << 32) + stride - 1) / stride;
+
+    args = calloc(nthreads, sizeof(*args));
+    tids = calloc(nthreads, sizeof(*tids));
+    if(args == NULL || tids == NULL){
+        free(args);
+        free(tids);
+        return -1;
+    }
+    for(i = 0; i < nthreads; i++){
+        args[i].lo = end * i / nthreads;
+        args[i].hi = end * (i + 1) / nthreads;
+        args[i].stride = stride;
+        pthread_create(&tids[i], NULL, check_thread, &args[i]);
+    }
+    bad += fl_check16();
+    for(i = 0; i < nthreads; i++){
+        pthread_join(tids[i], NULL);
+        bad += args[i].bad;
+    }
+    free(args);
+    free(tids);
+    return bad;
+}
+
+/*=========================== BENCH ===========================*/
+
+#define BENCH_BLOCK 4096    /* inputs per kernel call */
+
+static double now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * fl_bench - print ns/op of every conversion at every level and mode,
+ *            and of float_i2f/float_f2i of the Data Lab
+ * Each conversion handles total (rounded to whole blocks) random inputs.
+ */
+void fl_bench(size_t total){
+    static unsigned in[BENCH_BLOCK], out[BENCH_BLOCK];
+    unsigned seed = 0x9E3779B9;
+    size_t i, j, reps;
+    char lv[32];
+    double t;
+    int l, mode;
+
+    if(impl == 0) fl_init();
+    for(i = 0; i < BENCH_BLOCK; i++){
+        seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+        in[i] = seed;
+    }
+    reps = total / BENCH_BLOCK ? total / BENCH_BLOCK : 1;
+
+/* Time reps calls of call on count elements, print ns per element */
+#define BENCH_AS(name, label, mode, count, call) do { \
+    t = now_ns(); \
+    for(i = 0; i < reps; i++) call; \
+    t = (now_ns() - t) / ((double)reps * (count)); \
+    printf("%-13s %-8s mode %d %7.3f ns/op\n", name, label, mode, t); \
+} while(0)
+#define BENCH_N(name, l, mode, count, call) do { \
+    snprintf(lv, sizeof(lv), "level %d", l); \
+    BENCH_AS(name, lv, mode, count, call); \
+} while(0)
+#define BENCH(name, l, mode, call) BENCH_N(name, l, mode, BENCH_BLOCK, call)
+
+    BENCH_AS("float_i2f", "datalab", FL_RNE, BENCH_BLOCK,
+        for(j = 0; j < BENCH_BLOCK; j++) out[j] = float_i2f((int)in[j]));
+    BENCH_AS("float_f2i", "datalab", FL_RTZ, BENCH_BLOCK,
+        for(j = 0; j < BENCH_BLOCK; j++) out[j] = float_f2i(in[j]));
+    BENCH_AS("float_abs", "datalab", FL_RNE, BENCH_BLOCK,
+        for(j = 0; j < BENCH_BLOCK; j++) out[j] = float_abs(in[j]));
+    BENCH_AS("float_negpwr2", "datalab", FL_RNE, BENCH_BLOCK,
+        for(j = 0; j < BENCH_BLOCK; j++) out[j] = float_negpwr2((int)in[j] >> 24));
+    for(l = FL_SCALAR; l <= maxlevel; l++){
+        for(mode = FL_RNE; mode <= FL_RUP; mode++){
+            BENCH("i2f", l, mode, kernels(l)->i2f((int *)in, out, BENCH_BLOCK, mode));
+            BENCH("f2i", l, mode, kernels(l)->f2i(in, (int *)out, BENCH_BLOCK, mode));
+        }
+        BENCH("fp32->fp16", l, FL_RNE,
+            kernels(l)->convert(in, FL_FMT_FP32, out, FL_FMT_FP16, BENCH_BLOCK));
+        BENCH("fp16->fp32", l, FL_RNE,
+            kernels(l)->convert(in, FL_FMT_FP16, out, FL_FMT_FP32, BENCH_BLOCK));
+        BENCH("fp32->bf16", l, FL_RNE,
+            kernels(l)->convert(in, FL_FMT_FP32, out, FL_FMT_BF16, BENCH_BLOCK));
+        BENCH("ldexp fp32", l, FL_RNE,
+            kernels(l)->scale(in, FL_FMT_FP32, -130, out, BENCH_BLOCK));
+        BENCH("ldexp fp16", l, FL_RNE,
+            kernels(l)->scale(in, FL_FMT_FP16, -20, out, BENCH_BLOCK));
+        BENCH_N("ldexp fp64", l, FL_RNE, BENCH_BLOCK / 2,
+            kernels(l)->scale(in, FL_FMT_FP64, -1030, out, BENCH_BLOCK / 2));
+    }
+#undef BENCH
+#undef BENCH_N
+#undef BENCH_AS
+}
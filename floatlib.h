@@ -0,0 +1,224 @@
+/*
+ * <Eugene Yu Jun Hao 1900094810>
+ * floatlib.h - Batched bit-level int <-> float conversions (float_i2f,
+ *              float_f2i of the Data Lab) and bit utilities for the
+ *              fp16, bf16, fp32 and fp64 formats (float_abs,
+ *              float_negpwr2 generalized)
+ */
+#ifndef __FLOATLIB_H__
+#define __FLOATLIB_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Instruction set levels, selected at run time by CPU features */
+#define FL_SCALAR   0       /* branch-free C */
+#define FL_AVX2     1       /* 8 lanes, vpsllvd/vpsrlvd */
+#define FL_AVX512   2       /* 16 lanes, vplzcntd */
+
+/* Rounding modes */
+#define FL_RNE      0       /* to nearest, ties to even (float_i2f) */
+#define FL_RTZ      1       /* toward zero (float_f2i) */
+#define FL_RDN      2       /* toward -inf */
+#define FL_RUP      3       /* toward +inf */
+
+/*
+ * fl_i2f - out[i] = bits of (float) x[i], rounded by mode
+ * fl_f2i - out[i] = (int) of the float with bits uf[i], rounded by mode,
+ *          0x80000000 when out of range (including NaN and infinity)
+ */
+void fl_i2f(const int *x, unsigned *out, size_t n, int mode);
+void fl_f2i(const unsigned *uf, int *out, size_t n, int mode);
+
+/*
+ * Bit utilities, integer-only and branch-free (the selects compile to
+ * cmov or vector blends), for the formats
+ *   format  type      sign,exp,frac
+ *   fp16    uint16_t  1,5,10
+ *   bf16    uint16_t  1,8,7
+ *   fp32    uint32_t  1,8,23
+ *   fp64    uint64_t  1,11,52
+ * For each format f:
+ *   fl_classify_f(x)   FL_ZERO, FL_SUBNORMAL, FL_NORMAL, FL_INFINITE or FL_NAN
+ *   fl_abs_f(x)        |x|, NaN returned as is (float_abs)
+ *   fl_neg_f(x)        -x, NaN returned as is
+ *   fl_ldexp_f(x, n)   x * 2^n rounded to nearest even, NaN and infinity
+ *                      returned as is; float_negpwr2(x) is
+ *                      fl_ldexp_fp32(0x3F800000, -x)
+ * and fl_<from>_to_<to>(x) converts between fp32 and the other formats,
+ * rounding to nearest even. A NaN stays a NaN of the same sign, quieted,
+ * with the top bits of its payload.
+ */
+#define FL_ZERO         0
+#define FL_SUBNORMAL    1
+#define FL_NORMAL       2
+#define FL_INFINITE     3
+#define FL_NAN          4
+
+/* Layouts: type, exponent bits, fraction bits, width of the arithmetic */
+#define FL_FP16_LAYOUT  uint16_t, 5, 10, 32
+#define FL_BF16_LAYOUT  uint16_t, 8, 7, 32
+#define FL_FP32_LAYOUT  uint32_t, 8, 23, 32
+#define FL_FP64_LAYOUT  uint64_t, 11, 52, 64
+
+#define FL_SIGN(w, eb, mb)  ((uint##w##_t)1 << ((eb) + (mb)))           /* sign bit */
+#define FL_INF(w, eb, mb)   ((((uint##w##_t)1 << (eb)) - 1) << (mb))    /* +infinity */
+#define FL_FRAC(w, mb)      (((uint##w##_t)1 << (mb)) - 1)              /* fraction mask */
+#define FL_SCALE_MAX        4096    /* |n| of ldexp beyond every range */
+
+/*
+ * fl_clz32, fl_clz64 - leading zeros of x != 0 in shift-if-top-is-zero
+ *                      steps, which vectorize where a clz instruction does not
+ */
+#define FL_CLZ_STEP(w, k) do { \
+    m = (x >> ((w) - (k))) == 0; \
+    x = m ? x << (k) : x; \
+    n += m ? (k) : 0; \
+} while(0)
+
+static inline int32_t fl_clz32(uint32_t x){
+    int32_t n = 0, m;
+    FL_CLZ_STEP(32, 16);
+    FL_CLZ_STEP(32, 8);
+    FL_CLZ_STEP(32, 4);
+    FL_CLZ_STEP(32, 2);
+    FL_CLZ_STEP(32, 1);
+    return n;
+}
+
+static inline int64_t fl_clz64(uint64_t x){
+    int64_t n = 0, m;
+    FL_CLZ_STEP(64, 32);
+    FL_CLZ_STEP(64, 16);
+    FL_CLZ_STEP(64, 8);
+    FL_CLZ_STEP(64, 4);
+    FL_CLZ_STEP(64, 2);
+    FL_CLZ_STEP(64, 1);
+    return n;
+}
+
+/*
+ * FL_DEFINE_CORE(w) - define the w-bit helpers
+ *   fl_shift<w>(x, k) x << k, or x >> -k for k < 0
+ *   fl_unpack<w>(x, eb, mb, e)
+ *                     significand of the finite value x of layout eb,mb
+ *                     with its leading one at bit mb (subnormals are
+ *                     normalized, zero gives 0), *e set to its unbiased
+ *                     exponent
+ *   fl_pack<w>(sig, e, p, eb, mb)
+ *                     magnitude bits in layout eb,mb of sig * 2^(e - p),
+ *                     sig having its leading one at bit p (or being 0),
+ *                     rounded to nearest even; too large gives infinity
+ * fl_pack adds the biased exponent minus one to the significand including
+ * its leading one, so a rounding carry moves into the exponent by itself
+ * and a subnormal rounded up to 2^mb becomes the smallest normal.
+ */
+#define FL_DEFINE_CORE(w) \
+static inline uint##w##_t fl_shift##w(uint##w##_t x, int k){ \
+    return (x << (k > 0 ? k : 0)) >> (k < 0 ? -k : 0); \
+} \
+static inline uint##w##_t fl_unpack##w(uint##w##_t x, int eb, int mb, int##w##_t *e){ \
+    int##w##_t bias = ((int##w##_t)1 << (eb - 1)) - 1; \
+    uint##w##_t exp = (x >> mb) & (((uint##w##_t)1 << eb) - 1); \
+    uint##w##_t frac = x & (((uint##w##_t)1 << mb) - 1); \
+    int##w##_t lz = fl_clz##w(frac | 1) - ((w) - 1) + mb; /* shift up to bit mb */ \
+    int##w##_t sub = (exp == 0); \
+    *e = sub ? 1 - bias - lz : (int##w##_t)exp - bias; \
+    return sub ? frac << lz : frac | ((uint##w##_t)1 << mb); \
+} \
+static inline uint##w##_t fl_pack##w(uint##w##_t sig, int##w##_t e, int p, int eb, int mb){ \
+    int##w##_t emax = ((int##w##_t)1 << eb) - 1, be = e + (emax >> 1); \
+    int##w##_t sh = p - mb + (be < 1 ? 1 - be : 0);     /* bits to drop */ \
+    int##w##_t r = sh < 0 ? 0 : sh > p + 2 ? p + 2 : sh; \
+    uint##w##_t one = 1, inf = (uint##w##_t)emax << mb; \
+    uint##w##_t q = (sig << (sh < 0 ? -sh : 0)) >> r; \
+    uint##w##_t rem = sig & ((one << r) - 1), half = (one << r) >> 1; \
+    uint##w##_t mag; \
+    q += (uint##w##_t)(rem > half) \
+       | ((uint##w##_t)(rem == half) & (uint##w##_t)(half != 0) & q); \
+    mag = (be < 1 ? 0 : (uint##w##_t)(be - 1) << mb) + q; \
+    mag = ((be >= emax) | (mag >= inf)) ? inf : mag; \
+    return sig ? mag : 0; \
+}
+
+FL_DEFINE_CORE(32)
+FL_DEFINE_CORE(64)
+
+/*
+ * FL_DEFINE_FORMAT(f, layout) - define fl_classify_f, fl_abs_f, fl_neg_f
+ *                               and fl_ldexp_f
+ * FL_DEFINE_CONVERT(from, from_layout, to, to_layout, w)
+ *                             - define fl_from_to_to, computed in w bits
+ */
+#define FL_DEFINE_FORMAT(f, layout) FL_FORMAT_(f, layout)
+#define FL_FORMAT_(f, T, eb, mb, w) \
+static inline int fl_classify_##f(T x){ \
+    uint##w##_t a = x & (FL_SIGN(w, eb, mb) - 1); \
+    return (a != 0) + (a > FL_FRAC(w, mb)) \
+         + (a >= FL_INF(w, eb, mb)) + (a > FL_INF(w, eb, mb)); \
+} \
+static inline T fl_abs_##f(T x){ \
+    uint##w##_t a = x & (FL_SIGN(w, eb, mb) - 1); \
+    return (T)(a > FL_INF(w, eb, mb) ? x : a); \
+} \
+static inline T fl_neg_##f(T x){ \
+    uint##w##_t a = x & (FL_SIGN(w, eb, mb) - 1); \
+    return (T)(a > FL_INF(w, eb, mb) ? x : x ^ FL_SIGN(w, eb, mb)); \
+} \
+static inline T fl_ldexp_##f(T x, int n){ \
+    int##w##_t e, k = n < -FL_SCALE_MAX ? -FL_SCALE_MAX : n > FL_SCALE_MAX ? FL_SCALE_MAX : n; \
+    uint##w##_t a = x & (FL_SIGN(w, eb, mb) - 1); \
+    uint##w##_t sig = fl_unpack##w(x, eb, mb, &e); \
+    uint##w##_t r = (x & FL_SIGN(w, eb, mb)) | fl_pack##w(sig, e + k, mb, eb, mb); \
+    return (T)(a >= FL_INF(w, eb, mb) ? x : r); \
+}
+
+#define FL_DEFINE_CONVERT(from, from_layout, to, to_layout, w) \
+    FL_CONVERT_(from, from_layout, to, to_layout, w)
+#define FL_CONVERT_(from, TF, ebf, mbf, wf, to, TT, ebt, mbt, wt, w) \
+static inline TT fl_##from##_to_##to(TF x){ \
+    int##w##_t e; \
+    uint##w##_t a = x & (FL_SIGN(w, ebf, mbf) - 1); \
+    uint##w##_t s = (uint##w##_t)(x >> (ebf + mbf)) << (ebt + mbt); \
+    uint##w##_t sig = fl_unpack##w(x, ebf, mbf, &e); \
+    uint##w##_t nan = FL_INF(w, ebt, mbt) | ((uint##w##_t)1 << (mbt - 1)) \
+                    | (fl_shift##w(a & FL_FRAC(w, mbf), mbt - mbf) & FL_FRAC(w, mbt)); \
+    uint##w##_t r = a > FL_INF(w, ebf, mbf) ? nan \
+                  : a == FL_INF(w, ebf, mbf) ? FL_INF(w, ebt, mbt) \
+                  : fl_pack##w(sig, e, mbf, ebt, mbt); \
+    return (TT)(s | r); \
+}
+
+FL_DEFINE_FORMAT(fp16, FL_FP16_LAYOUT)
+FL_DEFINE_FORMAT(bf16, FL_BF16_LAYOUT)
+FL_DEFINE_FORMAT(fp32, FL_FP32_LAYOUT)
+FL_DEFINE_FORMAT(fp64, FL_FP64_LAYOUT)
+FL_DEFINE_CONVERT(fp32, FL_FP32_LAYOUT, fp16, FL_FP16_LAYOUT, 32)
+FL_DEFINE_CONVERT(fp16, FL_FP16_LAYOUT, fp32, FL_FP32_LAYOUT, 32)
+FL_DEFINE_CONVERT(fp32, FL_FP32_LAYOUT, bf16, FL_BF16_LAYOUT, 32)
+FL_DEFINE_CONVERT(bf16, FL_BF16_LAYOUT, fp32, FL_FP32_LAYOUT, 32)
+FL_DEFINE_CONVERT(fp32, FL_FP32_LAYOUT, fp64, FL_FP64_LAYOUT, 64)
+FL_DEFINE_CONVERT(fp64, FL_FP64_LAYOUT, fp32, FL_FP32_LAYOUT, 64)
+
+/*
+ * Array versions, vectorized at every level:
+ *   fl_convert - out[i] = x[i] converted from format from to format to
+ *                (one of the pairs above, otherwise return -1)
+ *   fl_scale   - out[i] = fl_ldexp_fmt(x[i], k)
+ * x and out point to arrays of the type of the format.
+ */
+#define FL_FMT_FP16     0
+#define FL_FMT_BF16     1
+#define FL_FMT_FP32     2
+#define FL_FMT_FP64     3
+
+int fl_convert(const void *x, int from, void *out, int to, size_t n);
+void fl_scale(const void *x, int fmt, int k, void *out, size_t n);
+
+int fl_level(void);             /* level in use */
+int fl_set_level(int level);    /* force a lower level, return level in use */
+long fl_check(unsigned stride, int nthreads); /* return mismatches */
+long fl_check16(void);           /* 16-bit formats exhaustively, return mismatches */
+void fl_bench(size_t total);    /* print ns/op of every level and mode */
+
+#endif /* __FLOATLIB_H__ */
@@ -0,0 +1,841 @@
+/*
+ * <Eugene Yu Jun Hao 1900094810>
+ * hcl2c.c - Optimizing compiler from the HCL of seq-full.hcl and
+ *           pipe-full.hcl to C
+ *
+ * Details:
+ * 1. Input - the HCL of the Arch Lab: quote 'text', boolsig and wordsig
+ *    declarations binding a signal to a C expression, and bool and word
+ *    definitions over case expressions [ c : v; ... ], x in { ... },
+ *    &&, ||, !, comparisons, numbers and parentheses.
+ * 2. hcl2c form (-n) - gen_<name>() for every definition, returning its
+ *    expression. A defined signal that is not declared is a call of its
+ *    gen_ function wherever it is used, and x in { a, b } tests x once
+ *    per member, so a chain such as d_valA evaluates its operands again
+ *    on every call. hcl_eval() calls them through pointers, as the
+ *    simulator does from another file.
+ * 3. Optimized form (default) - one hcl_eval() computing every defined
+ *    signal once per cycle:
+ *    - definitions in topological order of their uses, each a local
+ *      that every use of the signal reads
+ *    - identical subexpressions are one node (hash-consed as parsed);
+ *      one with two or more uses is computed once into a temporary
+ *    - x in { ... } over constants tests bit x of a mask the C compiler
+ *      folds
+ *    - a case is a chain of hcl_sel() from the last arm up, which the C
+ *      compiler makes conditional moves, and && and || are & and | of
+ *      0/1 values, so the function is almost free of branches
+ *    A signal both declared and defined also has its value stored to its
+ *    C expression, as the simulator stages do with gen_ results. Every
+ *    definition is left in hcl_sig and gen_<name>() returns it.
+ * 4. Test form (-i) - the quotes are dropped, the constants of isa.h are
+ *    defined, and every declared signal that is not a constant (an upper
+ *    case C identifier or a number) reads hcl_in.<name>. With -m a main()
+ *    is added that evaluates random inputs, prints a checksum of all
+ *    signals and the ns per hcl_eval(), so -n and the default can be
+ *    checked against each other and timed.
+ *
+ * Usage: hcl2c [-n] [-i [-m]] file.hcl > file.c
+ * Build: gcc -O2 -o hcl2c hcl2c.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+
+/* Misc manifest constants */
+#define MAXSIGS     1024        /* signals of a file */
+#define MAXNODES    65536       /* expression nodes */
+#define MAXKIDS     262144      /* operands of all nodes */
+#define MAXQUOTES   256         /* quote lines */
+#define MAXNAME     64          /* length of a signal name */
+#define MAXCEXPR    256         /* length of a C expression */
+#define HASHSIZE    131072      /* hash-consing table, a power of 2 */
+
+/* Kinds of expression nodes */
+#define N_NUM       0           /* number */
+#define N_SIG       1           /* signal */
+#define N_NOT       2           /* !a */
+#define N_AND       3           /* a && b */
+#define N_OR        4           /* a || b */
+#define N_CMP       5           /* a op b */
+#define N_IN        6           /* a in { b, ... } */
+#define N_CASE      7           /* [ c : v; ... ], kids c0 v0 c1 v1 ... */
+
+/* Comparison operators of N_CMP */
+static const char *cmp_ops[6] = { "==", "!=", "<", "<=", ">", ">=" };
+
+/* An expression node, shared by every identical subexpression */
+struct node {
+    int kind, op, sig;
+    long long num;
+    int kid, nkid;              /* operands kids[kid .. kid + nkid - 1] */
+    int uses;                   /* parents plus definitions using it */
+    int temp;                   /* temporary holding it, or -1 */
+};
+
+/* A signal, declared by boolsig/wordsig and/or defined by bool/word */
+struct sig {
+    char name[MAXNAME];
+    char cexpr[MAXCEXPR];       /* C expression of the declaration */
+    int declared, defined;
+    int isbool;                 /* defined (else declared) as bool */
+    int constant;               /* declared as an upper case C name or a number */
+    int def;                    /* node of the definition */
+    int mark;                   /* 0 new, 1 visiting, 2 ordered */
+};
+
+/* Constants of isa.h, defined in the test form */
+static const struct {
+    const char *name;
+    int value;
+} isa_consts[] = {
+    { "I_HALT", 0 }, { "I_NOP", 1 }, { "I_RRMOVQ", 2 }, { "I_IRMOVQ", 3 },
+    { "I_RMMOVQ", 4 }, { "I_MRMOVQ", 5 }, { "I_ALU", 6 }, { "I_JMP", 7 },
+    { "I_CALL", 8 }, { "I_RET", 9 }, { "I_PUSHQ", 10 }, { "I_POPQ", 11 },
+    { "I_IADDQ", 12 }, { "F_NONE", 0 }, { "A_ADD", 0 }, { "A_SUB", 1 },
+    { "A_AND", 2 }, { "A_XOR", 3 }, { "REG_RSP", 4 }, { "REG_NONE", 15 },
+    { "STAT_BUB", 0 }, { "STAT_AOK", 1 }, { "STAT_HLT", 2 }, { "STAT_ADR", 3 },
+    { "STAT_INS", 4 }, { "STAT_PIP", 5 },
+};
+#define NCONSTS     (int)(sizeof(isa_consts) / sizeof(isa_consts[0]))
+
+/* Global variables */
+static struct node nodes[MAXNODES];
+static int nnodes;
+static int kids[MAXKIDS];
+static int nkids;
+static int hash[HASHSIZE];      /* node + 1, 0 empty */
+static struct sig sigs[MAXSIGS];
+static int nsigs;
+static int order[MAXSIGS];      /* defined signals, topological order */
+static int norder;
+static char *quotes[MAXQUOTES];
+static int nquotes;
+static int ntemps;
+static int naive;               /* -n: the form of hcl2c */
+static int test;                /* -i: inputs from hcl_in */
+
+/* Tokenizer state */
+static const char *src;         /* text being parsed */
+static const char *file;
+static int lineno = 1;
+static char tok[MAXCEXPR];      /* current token */
+static int toktype;             /* T_* */
+
+#define T_EOF       0
+#define T_NAME      1
+#define T_NUM       2
+#define T_QUOTE     3
+#define T_PUNCT     4
+
+/* Function prototypes */
+static void usage(char *argv0);
+static void error(const char *msg, const char *arg);
+static void next(void);
+static void parse(void);
+static int parse_expr(void);
+static void toposort(void);
+static void emit(void);
+
+/*
+ * main - parse the file, order the signals, print the C
+ */
+int main(int argc, char **argv){
+    FILE *fp;
+    char *text;
+    long n;
+    int c, main_too = 0;
+
+    while((c = getopt(argc, argv, "hnim")) != EOF){
+        switch(c){
+            case 'n': naive = 1; break;
+            case 'i': test = 1; break;
+            case 'm': main_too = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    if(optind != argc - 1 || (main_too && !test))
+        usage(argv[0]);
+    file = argv[optind];
+    if((fp = fopen(file, "r")) == NULL){
+        fprintf(stderr, "%s: cannot open\n", file);
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    n = ftell(fp);
+    rewind(fp);
+    text = malloc(n + 1);
+    if(text == NULL || fread(text, 1, n, fp) != (size_t)n){
+        fprintf(stderr, "%s: cannot read\n", file);
+        return 1;
+    }
+    text[n] = '\0';
+    fclose(fp);
+
+    src = text;
+    next();
+    parse();
+    toposort();
+    emit();
+    if(main_too){
+        printf("\n#include <string.h>\n#include <time.h>\n\n"
+            "/* main - evaluate random inputs, print a checksum and the ns per hcl_eval */\n"
+            "int main(int argc, char **argv){\n"
+            "    static struct hcl_inputs sets[1024];\n"
+            "    long n = argc > 1 ? atol(argv[1]) : 1000000, i;\n"
+            "    unsigned long long x = 88172645463325252ULL, sum = 0;\n"
+            "    long long *in = (long long *)sets, *out = (long long *)&hcl_sig;\n"
+            "    struct timespec t0, t1;\n"
+            "    size_t j;\n\n"
+            "    for(j = 0; j < 1024 * (sizeof(hcl_in) / sizeof(long long)); j++){\n"
+            "        x ^= x << 13; x ^= x >> 7; x ^= x << 17;\n"
+            "        in[j] = x & 15;\n"
+            "    }\n"
+            "    for(i = 0; i < 1024; i++){\n"
+            "        memcpy(&hcl_in, &sets[i], sizeof(hcl_in));\n"
+            "        hcl_eval();\n"
+            "        for(j = 0; j < sizeof(hcl_sig) / sizeof(*out); j++)\n"
+            "            sum = sum * 31 + out[j];\n"
+            "    }\n"
+            "    clock_gettime(CLOCK_MONOTONIC, &t0);\n"
+            "    for(i = 0; i < n; i++){\n"
+            "        memcpy(&hcl_in, &sets[i & 1023], sizeof(hcl_in));\n"
+            "        hcl_eval();\n"
+            "    }\n"
+            "    clock_gettime(CLOCK_MONOTONIC, &t1);\n"
+            "    printf(\"checksum %%016llx, %%.1f ns per hcl_eval\\n\", sum,\n"
+            "        ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / n);\n"
+            "    return 0;\n"
+            "}\n");
+    }
+    free(text);
+    return 0;
+}
+
+/*
+ * usage - print a help message
+ */
+static void usage(char *argv0){
+    printf("Usage: %s [-n] [-i [-m]] file.hcl > file.c\n", argv0);
+    printf("   -n          the form of hcl2c, a function per signal\n");
+    printf("   -i          declared signals read hcl_in, for testing\n");
+    printf("   -m          with -i, add a main() that checks and times hcl_eval\n");
+    exit(1);
+}
+
+static void error(const char *msg, const char *arg){
+    fprintf(stderr, "%s:%d: %s '%s'\n", file, lineno, msg, arg);
+    exit(1);
+}
+
+/*=========================== PARSER ===========================*/
+
+/*
+ * next - read the next token into tok
+ */
+static void next(void){
+    int n = 0;
+
+    for(;;){
+        while(isspace((unsigned char)*src))
+            if(*src++ == '\n')
+                lineno++;
+        if(*src != '#')
+            break;
+        while(*src && *src != '\n')
+            src++;
+    }
+    if(*src == '\0'){
+        toktype = T_EOF;
+        strcpy(tok, "end of file");
+        return;
+    }
+    if(isalpha((unsigned char)*src) || *src == '_'){
+        while((isalnum((unsigned char)*src) || *src == '_') && n < MAXNAME - 1)
+            tok[n++] = *src++;
+        toktype = T_NAME;
+    }
+    else if(isdigit((unsigned char)*src)){
+        while(isalnum((unsigned char)*src) && n < MAXNAME - 1)
+            tok[n++] = *src++;
+        toktype = T_NUM;
+    }
+    else if(*src == '\''){
+        src++;
+        while(*src && *src != '\'' && n < MAXCEXPR - 1){
+            if(*src == '\n')
+                lineno++;
+            tok[n++] = *src++;
+        }
+        if(*src++ != '\'')
+            error("unterminated quote", "'");
+        toktype = T_QUOTE;
+    }
+    else{
+        tok[n++] = *src++;
+        if((tok[0] == '=' || tok[0] == '!' || tok[0] == '<' || tok[0] == '>') && *src == '=')
+            tok[n++] = *src++;
+        else if((tok[0] == '&' || tok[0] == '|') && *src == tok[0])
+            tok[n++] = *src++;
+        toktype = T_PUNCT;
+    }
+    tok[n] = '\0';
+}
+
+static int is(const char *s){
+    return toktype != T_QUOTE && strcmp(tok, s) == 0;
+}
+
+static void expect(const char *s){
+    if(!is(s))
+        error(s[0] == ';' ? "expected ';' before" : "unexpected", tok);
+    next();
+}
+
+/*
+ * lookup - the signal named name, added if new
+ */
+static int lookup(const char *name){
+    int i;
+    for(i = 0; i < nsigs; i++)
+        if(strcmp(sigs[i].name, name) == 0)
+            return i;
+    if(nsigs == MAXSIGS)
+        error("too many signals at", name);
+    strcpy(sigs[nsigs].name, name);
+    return nsigs++;
+}
+
+/*
+ * mknode - the node of the given fields, shared with an identical one
+ *          made before; operands are kids[k .. k + nk - 1], freshly
+ *          pushed, and dropped again when the node already exists
+ */
+static int mknode(int kind, int op, int sig, long long num, int k, int nk){
+    unsigned h = (unsigned)kind * 31 + (unsigned)op * 131 + (unsigned)sig * 1031
+        + (unsigned)num * 2654435761u + (unsigned)nk;
+    int i, n;
+
+    for(i = 0; i < nk; i++)
+        h = h * 16777619u ^ (unsigned)kids[k + i];
+    for(h &= HASHSIZE - 1; hash[h]; h = (h + 1) & (HASHSIZE - 1)){
+        struct node *p = &nodes[hash[h] - 1];
+        if(p->kind == kind && p->op == op && p->sig == sig && p->num == num && p->nkid == nk
+           && memcmp(&kids[p->kid], &kids[k], nk * sizeof(int)) == 0){
+            nkids = k;
+            return hash[h] - 1;
+        }
+    }
+    if(nnodes == MAXNODES || nnodes >= HASHSIZE / 2)
+        error("expressions too large at", tok);
+    n = nnodes++;
+    nodes[n].kind = kind;
+    nodes[n].op = op;
+    nodes[n].sig = sig;
+    nodes[n].num = num;
+    nodes[n].kid = k;
+    nodes[n].nkid = nk;
+    nodes[n].temp = -1;
+    hash[h] = n + 1;
+    return n;
+}
+
+static int push(int n){
+    if(nkids == MAXKIDS)
+        error("expressions too large at", tok);
+    kids[nkids++] = n;
+    return nkids - 1;
+}
+
+static int node2(int kind, int op, int a, int b){
+    int k = push(a);
+    push(b);
+    return mknode(kind, op, -1, 0, k, 2);
+}
+
+/*
+ * Operands of a node with several, such as in and case, are parsed onto
+ * a local list first: kids of the nested expressions are pushed while
+ * they are parsed and must not interleave.
+ */
+static int node_list(int kind, const int *list, int n){
+    int i, k = nkids;
+    for(i = 0; i < n; i++)
+        push(list[i]);
+    return mknode(kind, 0, -1, 0, k, n);
+}
+
+/* primary: number | -number | name | ( expr ) | [ c : v ; ... ] */
+static int parse_primary(void){
+    int list[512], n = 0, neg = 0, s;
+    long long v;
+    char *end;
+
+    if(is("(")){
+        next();
+        n = parse_expr();
+        expect(")");
+        return n;
+    }
+    if(is("[")){
+        next();
+        while(!is("]")){
+            if(n + 2 > (int)(sizeof(list) / sizeof(list[0])))
+                error("case too long at", tok);
+            list[n++] = parse_expr();
+            expect(":");
+            list[n++] = parse_expr();
+            expect(";");
+        }
+        next();
+        return node_list(N_CASE, list, n);
+    }
+    if(is("-")){
+        neg = 1;
+        next();
+    }
+    if(toktype == T_NUM){
+        v = strtoll(tok, &end, 0);
+        if(*end)
+            error("bad number", tok);
+        next();
+        return mknode(N_NUM, 0, -1, neg ? -v : v, nkids, 0);
+    }
+    if(toktype == T_NAME && !neg){
+        s = lookup(tok);
+        next();
+        return mknode(N_SIG, 0, s, 0, nkids, 0);
+    }
+    error("unexpected", tok);
+    return -1;
+}
+
+/* cmp: primary [ op primary | in { expr, ... } ] */
+static int parse_cmp(void){
+    int list[512], n = 1, a = parse_primary(), i;
+
+    for(i = 0; i < 6; i++){
+        if(is(cmp_ops[i])){
+            next();
+            return node2(N_CMP, i, a, parse_primary());
+        }
+    }
+    if(toktype == T_NAME && strcmp(tok, "in") == 0){
+        next();
+        expect("{");
+        list[0] = a;
+        for(;;){
+            if(n == (int)(sizeof(list) / sizeof(list[0])))
+                error("set too large at", tok);
+            list[n++] = parse_expr();
+            if(!is(","))
+                break;
+            next();
+        }
+        expect("}");
+        return node_list(N_IN, list, n);
+    }
+    return a;
+}
+
+static int parse_not(void){
+    int k;
+    if(is("!")){
+        next();
+        k = push(parse_not());
+        return mknode(N_NOT, 0, -1, 0, k, 1);
+    }
+    return parse_cmp();
+}
+
+static int parse_and(void){
+    int a = parse_not();
+    while(is("&&")){
+        next();
+        a = node2(N_AND, 0, a, parse_not());
+    }
+    return a;
+}
+
+static int parse_expr(void){
+    int a = parse_and();
+    while(is("||")){
+        next();
+        a = node2(N_OR, 0, a, parse_and());
+    }
+    return a;
+}
+
+/*
+ * parse - read every statement of the file
+ */
+static void parse(void){
+    const char *p;
+    int s, isbool;
+
+    while(toktype != T_EOF){
+        if(toktype != T_NAME)
+            error("expected a statement at", tok);
+        if(strcmp(tok, "quote") == 0){
+            next();
+            if(toktype != T_QUOTE)
+                error("expected a quoted string at", tok);
+            if(nquotes == MAXQUOTES)
+                error("too many quotes at", tok);
+            quotes[nquotes++] = strdup(tok);
+            next();
+        }
+        else if(strcmp(tok, "boolsig") == 0 || strcmp(tok, "wordsig") == 0){
+            isbool = tok[0] == 'b';
+            next();
+            if(toktype != T_NAME)
+                error("expected a signal name at", tok);
+            s = lookup(tok);
+            if(sigs[s].declared)
+                error("signal declared twice", tok);
+            next();
+            if(toktype != T_QUOTE)
+                error("expected a C expression at", tok);
+            sigs[s].declared = 1;
+            if(!sigs[s].defined)
+                sigs[s].isbool = isbool;
+            strcpy(sigs[s].cexpr, tok);
+            for(p = tok; *p && (isupper((unsigned char)*p) || isdigit((unsigned char)*p)
+                || *p == '_'); p++)
+                ;
+            sigs[s].constant = *p == '\0' && tok[0] != '\0';
+            next();
+        }
+        else if(strcmp(tok, "bool") == 0 || strcmp(tok, "word") == 0){
+            isbool = tok[0] == 'b';
+            next();
+            if(toktype != T_NAME)
+                error("expected a signal name at", tok);
+            s = lookup(tok);
+            if(sigs[s].defined)
+                error("signal defined twice", tok);
+            next();
+            expect("=");
+            sigs[s].def = parse_expr();
+            sigs[s].defined = 1;
+            sigs[s].isbool = isbool;
+            expect(";");
+        }
+        else
+            error("expected a statement at", tok);
+    }
+}
+
+/*=========================== ORDERING ===========================*/
+
+/*
+ * visit - order the defined signals node n uses, then count its uses
+ *         as an operand of each distinct parent
+ */
+static void visit_sig(int s);
+
+static void visit(int n){
+    struct node *p = &nodes[n];
+    int i;
+
+    if(p->uses++ > 0)
+        return;                 /* operands counted at the first use */
+    if(p->kind == N_SIG){
+        if(!sigs[p->sig].declared && !sigs[p->sig].defined)
+            error("undefined signal", sigs[p->sig].name);
+        if(sigs[p->sig].defined)
+            visit_sig(p->sig);
+    }
+    for(i = 0; i < p->nkid; i++)
+        visit(kids[p->kid + i]);
+    /* x in { non-constants } reads x once per member */
+    if(p->kind == N_IN && p->nkid > 2)
+        nodes[kids[p->kid]].uses++;
+}
+
+static void visit_sig(int s){
+    if(sigs[s].mark == 2)
+        return;
+    if(sigs[s].mark == 1)
+        error("combinational loop through", sigs[s].name);
+    sigs[s].mark = 1;
+    visit(sigs[s].def);
+    sigs[s].mark = 2;
+    order[norder++] = s;
+}
+
+/*
+ * toposort - order the definitions so each follows what it uses
+ */
+static void toposort(void){
+    int s;
+    for(s = 0; s < nsigs; s++)
+        if(sigs[s].defined)
+            visit_sig(s);
+}
+
+/*=========================== OUTPUT ===========================*/
+
+/*
+ * is01 - is the value of node n always 0 or 1
+ */
+static int is01(int n){
+    const struct node *p = &nodes[n];
+    switch(p->kind){
+        case N_NUM: return p->num == 0 || p->num == 1;
+        case N_SIG: return sigs[p->sig].defined && sigs[p->sig].isbool;
+        case N_NOT: case N_AND: case N_OR: case N_CMP: case N_IN: return 1;
+    }
+    return 0;
+}
+
+/*
+ * is_const - is node n a constant, and a member of a set mask (0..63
+ *            for a number)
+ */
+static int is_const(int n){
+    const struct node *p = &nodes[n];
+    if(p->kind == N_NUM)
+        return p->num >= 0 && p->num < 64;
+    return p->kind == N_SIG && sigs[p->sig].constant && !sigs[p->sig].defined;
+}
+
+static void print(int n);
+
+/* n as a condition: 0 or 1 */
+static void print_bool(int n){
+    if(is01(n) || naive)
+        print(n);
+    else{
+        printf("(");
+        print(n);
+        printf(" != 0)");
+    }
+}
+
+static void print_sig(int s){
+    if(!naive && sigs[s].defined)
+        printf("v_%s", sigs[s].name);
+    else if(sigs[s].declared && test && !sigs[s].constant)
+        printf("hcl_in.%s", sigs[s].name);
+    else if(sigs[s].declared)
+        printf("(%s)", sigs[s].cexpr);
+    else
+        printf("gen_%s()", sigs[s].name);
+}
+
+/*
+ * print - print node n as a C expression, temporaries by name
+ */
+static void print(int n){
+    const struct node *p = &nodes[n];
+    const int *k = &kids[p->kid];
+    int i, mask = 1;
+
+    if(p->temp >= 0){
+        printf("t%d", p->temp);
+        return;
+    }
+    switch(p->kind){
+        case N_NUM:
+            printf("%lldLL", p->num);
+            break;
+        case N_SIG:
+            print_sig(p->sig);
+            break;
+        case N_NOT:
+            printf("(!");
+            print(k[0]);
+            printf(")");
+            break;
+        case N_AND:
+        case N_OR:
+            printf("(");
+            print_bool(k[0]);
+            printf(naive ? (p->kind == N_AND ? " && " : " || ") : (p->kind == N_AND ? " & " : " | "));
+            print_bool(k[1]);
+            printf(")");
+            break;
+        case N_CMP:
+            printf("(");
+            print(k[0]);
+            printf(" %s ", cmp_ops[p->op]);
+            print(k[1]);
+            printf(")");
+            break;
+        case N_IN:
+            for(i = 1; i < p->nkid; i++)
+                mask &= is_const(k[i]);
+            if(mask && !naive){
+                printf("hcl_in_mask(");
+                print(k[0]);
+                printf(", ");
+                for(i = 1; i < p->nkid; i++){
+                    printf("%s1ULL << ", i > 1 ? " | " : "");
+                    print(k[i]);
+                }
+                printf(")");
+                break;
+            }
+            printf("(");
+            for(i = 1; i < p->nkid; i++){
+                printf("%s(", i > 1 ? (naive ? " || " : " | ") : "");
+                print(k[0]);
+                printf(" == ");
+                print(k[i]);
+                printf(")");
+            }
+            printf(")");
+            break;
+        case N_CASE:
+            if(naive){
+                printf("(");
+                for(i = 0; i < p->nkid; i += 2){
+                    print(k[i]);
+                    printf(" ? ");
+                    print(k[i + 1]);
+                    printf(" : ");
+                }
+                printf("0)");
+                break;
+            }
+            /* A last arm of constant true is the default, else 0 */
+            i = p->nkid;
+            if(i >= 2 && nodes[k[i - 2]].kind == N_NUM && nodes[k[i - 2]].num != 0)
+                i -= 2;
+            for(n = 0; n < i; n += 2){
+                printf("hcl_sel(");
+                print_bool(k[n]);
+                printf(", ");
+                print(k[n + 1]);
+                printf(", ");
+            }
+            if(i < p->nkid)
+                print(k[i + 1]);
+            else
+                printf("0LL");
+            for(n = 0; n < i; n += 2)
+                printf(")");
+            break;
+    }
+}
+
+/*
+ * emit_temps - print the temporaries node n needs, operands first: every
+ *              node other than a number or signal with two or more uses
+ */
+static void emit_temps(int n){
+    struct node *p = &nodes[n];
+    int i;
+
+    if(p->temp >= 0 || p->kind == N_NUM || p->kind == N_SIG)
+        return;
+    for(i = 0; i < p->nkid; i++)
+        emit_temps(kids[p->kid + i]);
+    if(p->uses >= 2){
+        printf("    long long t%d = ", ntemps);
+        print(n);
+        printf(";\n");
+        p->temp = ntemps++;
+    }
+}
+
+/*
+ * emit - print the C of the file
+ */
+static void emit(void){
+    int i, s, unknown = 16;
+
+    printf("/* Generated by hcl2c%s%s from %s, do not edit */\n\n",
+        naive ? " -n" : "", test ? " -i" : "", file);
+    if(!test){
+        for(i = 0; i < nquotes; i++)
+            printf("%s\n", quotes[i]);
+    }
+    else{
+        printf("#include <stdio.h>\n#include <stdlib.h>\n\n/* isa.h */\n");
+        for(s = 0; s < nsigs; s++){
+            if(!sigs[s].declared || !sigs[s].constant || isdigit((unsigned char)sigs[s].cexpr[0]))
+                continue;
+            for(i = 0; i < NCONSTS && strcmp(isa_consts[i].name, sigs[s].cexpr); i++)
+                ;
+            printf("#ifndef %s\n#define %s %d\n#endif\n", sigs[s].cexpr, sigs[s].cexpr,
+                i < NCONSTS ? isa_consts[i].value : unknown++);
+        }
+        printf("\n/* Declared signals */\nstruct hcl_inputs {\n");
+        for(s = 0; s < nsigs; s++)
+            if(sigs[s].declared && !sigs[s].constant)
+                printf("    long long %s;\n", sigs[s].name);
+        printf("    long long unused;\n} hcl_in;\n");
+    }
+
+    printf("\n/* Defined signals of the last hcl_eval() */\nstruct hcl_signals {\n");
+    for(i = 0; i < norder; i++)
+        printf("    long long %s;\n", sigs[order[i]].name);
+    printf("} hcl_sig;\n\n");
+
+    if(naive){
+        for(i = 0; i < norder; i++){
+            s = order[i];
+            printf("long long gen_%s(void){\n    return ", sigs[s].name);
+            print(sigs[s].def);
+            printf(";\n}\n\n");
+        }
+        /* Called through pointers, as from the simulator in another file */
+        printf("long long (*hcl_gen[])(void) = {\n");
+        for(i = 0; i < norder; i++)
+            printf("    gen_%s,\n", sigs[order[i]].name);
+        printf("};\n\n"
+            "/* hcl_eval - every gen_ function, results stored as the stages do */\n"
+            "void hcl_eval(void){\n");
+        for(i = 0; i < norder; i++){
+            s = order[i];
+            printf("    hcl_sig.%s = hcl_gen[%d]();\n", sigs[s].name, i);
+            if(sigs[s].declared && test)
+                printf("    hcl_in.%s = hcl_sig.%s;\n", sigs[s].name, sigs[s].name);
+            else if(sigs[s].declared)
+                printf("    %s = hcl_sig.%s;\n", sigs[s].cexpr, sigs[s].name);
+        }
+        printf("}\n");
+        return;
+    }
+
+    printf("/* a if c, else b: a cmov, every operand is computed anyway */\n"
+        "static inline long long hcl_sel(long long c, long long a, long long b){\n"
+        "    return c ? a : b;\n"
+        "}\n\n"
+        "/* x in the set of bits m */\n"
+        "static inline int hcl_in_mask(long long x, unsigned long long m){\n"
+        "    return ((unsigned long long)x < 64) & (int)(m >> (x & 63));\n"
+        "}\n\n"
+        "/* hcl_eval - every defined signal once, in topological order */\n"
+        "void hcl_eval(void){\n");
+    for(i = 0; i < norder; i++){
+        s = order[i];
+        emit_temps(sigs[s].def);
+        printf("    long long v_%s = ", sigs[s].name);
+        if(sigs[s].isbool)
+            print_bool(sigs[s].def);
+        else
+            print(sigs[s].def);
+        printf(";\n");
+    }
+    printf("\n");
+    for(i = 0; i < norder; i++){
+        s = order[i];
+        if(sigs[s].declared){
+            if(test)
+                printf("    hcl_in.%s = v_%s;\n", sigs[s].name, sigs[s].name);
+            else
+                printf("    %s = v_%s;\n", sigs[s].cexpr, sigs[s].name);
+        }
+        printf("    hcl_sig.%s = v_%s;\n", sigs[s].name, sigs[s].name);
+    }
+    printf("}\n\n");
+    for(i = 0; i < norder; i++)
+        printf("long long gen_%s(void){ return hcl_sig.%s; }\n",
+            sigs[order[i]].name, sigs[order[i]].name);
+}
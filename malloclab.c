@@ -1,13 +1,64 @@
   
 /*  <Eugene Yu Jun Hao 1900094810>
  *  mm.c - Malloc Simulator
- *  Segregated Free List + First Fit
+ *  Segregated Free List + First Fit (small), Splay Tree + Best Fit (large)
  *  Details:
  *  1. Free list structure - 
  *          previous ptr == heaplist_p : head
  *          next ptr == heaplist_p : tail
  *  2. Free list size increase by power of 2, starting from 16 bytes(Min block size)
  *  3. Be cautious at the insertion and removal of free list nodes!
+ *  4. Free blocks larger than 4096 bytes live in a single splay tree instead
+ *     of a list, keyed by (size, address):
+ *          left ptr/right ptr reuse the previous/next slots, 
+ *          left/right ptr == heap_listp : no child
+ *     find_fit splays the smallest key >= (asize, 0) to the root, which is
+ *     the address-ordered best fit in O(log n) amortized time, and recently
+ *     touched sizes stay near the root.
+ *  5. Handles (not in SHARED) - mm_halloc(n) returns a handle, an index
+ *     into a table (itself a heap block) of {offset, pin count}; the
+ *     block has header bit 0x4 set and its handle in the last word of
+ *     the block, where a free block has its footer. mm_pin(h) returns the
+ *     payload and keeps it in place until mm_unpin(h); mm_hfree(h).
+ *     mm_compact(budget) is one step of a sliding compactor: from a
+ *     cursor, every unpinned handle block right after a free block is
+ *     moved down over it, so the hole bubbles up and merges with the
+ *     next one. A step stops after budget bytes of work (moves, plus
+ *     DSIZE per block walked). At the end of a sweep the free tail is
+ *     given back to the system where mem_trim exists (PRELOAD). It
+ *     returns 0 once a whole sweep moved nothing. coalesce moves the
+ *     cursor to the start of a merged block.
+ *  6. Lifetime hints (not in SHARED) - mm_malloc_hint(n, lifetime):
+ *     LIFETIME_SHORT is plain malloc. LIFETIME_LONG and LIFETIME_PERMANENT
+ *     blocks come from regions of their class: REGION-byte blocks of the
+ *     main heap, each run as a small heap of its own (class word,
+ *     prologue bit, epilogue) with its own set of lists and tree. Every
+ *     allocator routine works on the class by swapping the ten roots in
+ *     (swap_roots), so a dead long object leaves a hole only long
+ *     objects reuse, and short churn never settles between long objects.
+ *     regstart (the region starting in each REGION bytes of heap) lets
+ *     free() route a block to its class and realloc() move it within its
+ *     class; a region whose blocks are all free goes back to the main
+ *     heap. Requests over REGION/4 bytes
+ *     are plain malloc.
+ *  7. Wilderness - the free block just below the epilogue can grow for
+ *     free, so find_fit passes over it and returns it only when no
+ *     interior block fits. When nothing fits the heap grows by what the
+ *     wilderness lacks, or by grow if that is more: grow doubles (up to
+ *     GROW_MAX) when the last extension was fewer than GROW_WINDOW
+ *     mallocs ago, and halves back toward CHUNKSIZE otherwise.
+ *  8. Sizes - mm_malloc_usable_size(p) is the payload the block really
+ *     has, mm_malloc_at_least(n, &actual) returns it with the block, and
+ *     realloc grows into that slack, then into the free block after it
+ *     (or new heap at the top), before it moves anything; a shrink to
+ *     half or more stays and frees the tail.
+ *     mm_free_sized(p, n) (these two not in SHARED) parks a block of up
+ *     to QUICK_MAX bytes, by the class n gives, on a quick list (at most
+ *     QUICK_CAP each, linked by offset in the payload) without reading or
+ *     writing any header; malloc of that class pops it back before
+ *     find_fit. Parked blocks stay allocated in the heap; they are freed
+ *     for real before the heap grows and by mm_compact, and not parked
+ *     while regions exist (a region block must go back to its class).
  * 
  *  Extra Optimization:
  *  1. Relative Address (Maximum size of Heap is 2^32) -
@@ -20,16 +71,91 @@
  *     Solution: using the 2nd bit of header to record the allocation
  *     of previous block.
  *     Result: extra 4bytes for payloads
+ *
+ *  Production Build (-DPRELOAD):
+ *  1. The same allocator as a drop-in libc malloc for real programs:
+ *     malloc, free, realloc, calloc, memalign, posix_memalign,
+ *     aligned_alloc, valloc, pvalloc, malloc_usable_size, free_sized
+ *     and free_aligned_sized.
+ *  2. mem_sbrk is backed by a 4GB (2^32, the offset limit) PROT_NONE
+ *     reservation, made read/write in 64KB steps as the heap grows.
+ *  3. Payloads are 16-byte aligned as the x86-64 ABI expects (ALIGNMENT
+ *     16, block sizes multiple of 16); memalign cuts the aligned block out
+ *     of a larger one and frees the head and tail.
+ *  4. One mutex around every entry point; pthread_atfork holds it across
+ *     fork so the child never inherits a heap in the middle of an update.
+ *  5. mmnew.cc adds C++ operator new/delete, sized and aligned, so sized
+ *     delete goes to mm_free_sized.
+ *  Build: gcc -O2 -shared -fPIC -DPRELOAD -o libmm.so malloclab.c -lpthread
+ *  C++:   gcc -O2 -fPIC -DPRELOAD -c malloclab.c &&
+ *         g++ -O2 -shared -fPIC -o libmm.so malloclab.o mmnew.cc -lpthread
+ *  Usage: LD_PRELOAD=./libmm.so ./proxy 15213
+ *  Bench: ./mmbench.sh (proxy from proxylab.tar.gz, glibc vs libmm.so)
+ *
+ *  Shared Heap Build (-DSHARED):
+ *  1. The heap lives in a MAP_SHARED file (or memfd for a process and its
+ *     children), one page after a header holding the roots as offsets,
+ *     the break and a process-shared robust mutex.
+ *  2. Every link is an offset already, so the heap can be mapped at a
+ *     different address in every process: taking the lock rebuilds
+ *     heap_listp and the roots from the header, releasing it writes the
+ *     roots back.
+ *  3. Objects are exchanged by mm_shared_offset(p) / mm_shared_ptr(off);
+ *     offset 0 is the header and never an object.
+ *  4. Snapshot - mm_snapshot(path) writes the header page and the heap in
+ *     use, with a version and a checksum (FNV-1a over 64-bit words), to
+ *     path.tmp and renames it. mm_restore(path) checks them and maps the
+ *     file copy-on-write in one mmap, over a reservation with room for
+ *     the heap to grow; the restored heap is private to the process.
+ *     mm_shared_set_root/get_root keep one application object in the
+ *     header so the data can be found again after a restore.
+ *  API: mm_shared_open(path or NULL, bytes), mm_shared_malloc/free/realloc,
+ *       mm_shared_offset, mm_shared_ptr, mm_snapshot, mm_restore,
+ *       mm_shared_set_root, mm_shared_get_root
+ *  Build: gcc -O2 -c -DSHARED malloclab.c (link with -lpthread)
  */
 
+#ifdef SHARED
+#define _GNU_SOURCE     /* memfd_create */
+#endif
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#ifdef PRELOAD
+#include <pthread.h>
+#include <sys/mman.h>
+#define DRIVER          /* allocator keeps the mm_ names, libc names below */
+static void *mem_sbrk(size_t incr);
+static void mem_trim(size_t decr);
+static void *mem_heap_lo(void);
+static void *mem_heap_hi(void);
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+#define MM_LOCK()       pthread_mutex_lock(&mm_lock)
+#define MM_UNLOCK()     pthread_mutex_unlock(&mm_lock)
+#elif defined(SHARED)
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#define DRIVER          /* allocator keeps the mm_ names, API below */
+static void *mem_sbrk(size_t incr);
+static void *mem_heap_lo(void);
+static void *mem_heap_hi(void);
+#else
 #include "mm.h"
 #include "memlib.h"
+#endif
+#ifndef MM_LOCK
+#define MM_LOCK()
+#define MM_UNLOCK()
+#endif
 
 /* If you want debugging output, use the following macro.  When you hand
  * in, remove the #define DEBUG line. */
@@ -49,11 +175,15 @@
 #define calloc mm_calloc
 #endif /* def DRIVER */
 
-/* single word (4) or double word (8) alignment */
+/* single word (4) or double word (8) alignment, 16 for the ABI of PRELOAD */
+#if defined(PRELOAD) || defined(SHARED)
+#define ALIGNMENT 16
+#else
 #define ALIGNMENT 8
+#endif
 
 /* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(p) (((size_t)(p) + (ALIGNMENT-1)) & ~0x7)
+#define ALIGN(p) (((size_t)(p) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
 
 /*=========================== variables, constants and macros ===========================*/
 /* Global variables */
@@ -69,7 +199,14 @@ static char *root6 = 0;
 static char *root7 = 0;
 static char *root8 = 0;  
 static char *root9 = 0;    
-static char *root10 = 0;  
+static char *tree = 0;        /* root of splay tree for blocks > 4096 */
+static char *compact_p = 0;   /* compactor cursor, 0 : heap start */
+static size_t grow = 0;       /* bytes of the next extension, 0 : CHUNKSIZE */
+static unsigned int nmalloc = 0;    /* malloc calls */
+static unsigned int last_grow = 0;  /* nmalloc at the last extension */
+static char **const all_roots[10] = {   /* every root, for swapping sets */
+    &root1, &root2, &root3, &root4, &root5, &root6, &root7, &root8, &root9, &tree
+};
 
 #ifdef NEXT_FIT
 static char *rover;           /* Next fit rover */
@@ -78,8 +215,19 @@ static char *rover;           /* Next fit rover */
 #define WSIZE       4       /* Word and header/footer size (bytes) */ 
 #define DSIZE       8       /* Double word size (bytes) */
 #define CHUNKSIZE  (1<<12)  /* Extend heap by this amount (bytes) */  
+#define HEAP_MAX    ((size_t)1 << 32)       /* offsets are 32 bits */
+#define MAX_REQUEST (HEAP_MAX - 2*ALIGNMENT) /* its block size fits 32 bits */
+#define GROW_MAX    (64*CHUNKSIZE)  /* Largest adaptive extension */
+#define GROW_WINDOW 64              /* Extensions closer (mallocs) double */
+#define QUICK_MAX   128             /* Largest block of a quick list */
+#define QUICK_CAP   4               /* Blocks per quick list */
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))  
+#define MIN(x, y) ((x) < (y)? (x) : (y))
+
+/* Header bit of a movable (handle) block */
+#define HANDLE      0x4
+#define GET_HANDLE(p) (GET(p) & HANDLE)
 
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc)  ((size) | (alloc)) 
@@ -105,21 +253,50 @@ static char *rover;           /* Next fit rover */
 #define ADDR2OF(address)    (size_t)(address) - (size_t)(heap_listp)    
 #define OF2ADDR(offset)    (size_t)(offset) + (size_t)(heap_listp)
 
+/* Largest block size kept in the segregated lists */
+#define LISTMAX     4096
+
 /* Store/Read previous and next free list node */
 #define GET_PREV(bp)    (OF2ADDR(*((unsigned int *)(bp))))
 #define GET_NEXT(bp)    (OF2ADDR(*((unsigned int *)(bp + WSIZE))))
 #define SET_PREV(bp, val)   (*(unsigned int *)bp = (unsigned int)ADDR2OF(val))
 #define SET_NEXT(bp, val)   (*(unsigned int *)(bp + WSIZE) = (unsigned int)ADDR2OF(val)) 
 
+/* Store/Read left and right child of a tree node (same slots as prev/next) */
+#define LEFTP(bp)       ((unsigned int *)(bp))
+#define RIGHTP(bp)      ((unsigned int *)((char *)(bp) + WSIZE))
+#define GET_LEFT(bp)    ((void *)(OF2ADDR(*LEFTP(bp))))
+#define GET_RIGHT(bp)   ((void *)(OF2ADDR(*RIGHTP(bp))))
+#define SET_LEFT(bp, val)   (*LEFTP(bp) = (unsigned int)ADDR2OF(val))
+#define SET_RIGHT(bp, val)  (*RIGHTP(bp) = (unsigned int)ADDR2OF(val))
+
 /* Function prototypes for internal helper routines */
 static void *extend_heap(size_t words);
 static void place(void *bp, size_t asize);
-static void *find_fit(size_t asize);
+static void free_block(void *bp);
+static void shrink_block(void *bp, size_t asize);
+static int grow_block(void *bp, size_t asize);
+static void *find_fit(size_t asize, void *wild);
+static void *wilderness(void);
 static void *coalesce(void *bp);
 static void insert_list(void *bp, size_t size);
 static void remove_list(void *bp, size_t size);
 static void *size2ptr(size_t size);
 static void update_root(size_t size);
+static void *splay(void *t, size_t size, void *bp);
+static void insert_tree(void *bp, size_t size);
+static void remove_tree(void *bp, size_t size);
+static void *tree_fit(size_t asize);
+#ifndef SHARED
+static void handle_reset(void);
+static void quick_reset(void);
+static void *quick_pop(size_t asize);
+static int quick_flush(void);
+static void region_reset(void);
+static char *region_of(void *bp);
+static void region_free(char *rb, void *bp);
+static void *hint_malloc(size_t size, int lifetime);
+#endif
 
 /*=========================== MAIN FUNCTIONS ===========================*/
 
@@ -145,7 +322,14 @@ int mm_init(void) {
     root7 = root; 
     root8 = root; 
     root9 = root; 
-    root10 = root; 
+    tree = root; 
+    grow = 0;
+    compact_p = 0;
+#ifndef SHARED
+    handle_reset();
+    region_reset();
+    quick_reset();
+#endif
  
     /* Extend the empty heap with a free block of CHUNKSIZE bytes */
     if (extend_heap(CHUNKSIZE/WSIZE) == NULL) 
@@ -167,21 +351,45 @@ void *malloc (size_t size) {
     /* Ignore spurious requests */
     if(size == 0)
         return NULL;
+    if(size > MAX_REQUEST){
+        errno = ENOMEM;
+        return NULL;
+    }
 
     /* Adjust block size to include overhead and alignment reqs. */
-    if(size <= WSIZE)                                          
-        asize = 2*DSIZE;                                        
-    else
-        asize = DSIZE * ((size + (WSIZE) + (DSIZE-1)) / DSIZE); 
+    asize = MAX(ALIGN(size + WSIZE), 2*DSIZE);
+    nmalloc++;
+
+#ifndef SHARED
+    if(asize <= QUICK_MAX && (bp = quick_pop(asize)) != NULL)
+        return bp;
+#endif
 
     /* Search the free list for a fit */
-    if((bp = find_fit(asize)) != NULL) {  
+    if((bp = find_fit(asize, wilderness())) != NULL) {  
         place(bp, asize);                  
         return bp;
     }
+#ifndef SHARED
+    /* Free the parked blocks and look again before growing the heap */
+    if(quick_flush() && (bp = find_fit(asize, wilderness())) != NULL){
+        place(bp, asize);
+        return bp;
+    }
+#endif
 
     /* No fit found. Get more memory and place the block */
-    extendsize = MAX(asize,CHUNKSIZE);                 
+    if(grow == 0)
+        grow = CHUNKSIZE;
+    else if(nmalloc - last_grow < GROW_WINDOW)         /* burst */
+        grow = MIN(2*grow, GROW_MAX);
+    else
+        grow = MAX(grow/2, CHUNKSIZE);
+    last_grow = nmalloc;
+    extendsize = asize;
+    if((bp = wilderness()) != NULL)     /* merges with the new memory */
+        extendsize -= GET_SIZE(HDRP(bp));
+    extendsize = MAX(extendsize, grow);
     if ((bp = extend_heap(extendsize/WSIZE)) == NULL)  
         return NULL;                                  
     place(bp, asize);                                 
@@ -194,14 +402,14 @@ void *malloc (size_t size) {
 void free(void *bp){
     if(bp == 0) 
         return;
-    size_t size = GET_SIZE(HDRP(bp));
-    if(heap_listp == 0){
-        mm_init();
+#ifndef SHARED
+    char *rb = region_of(bp);
+    if(rb){                     /* block of a lifetime class */
+        region_free(rb, bp);
+        return;
     }
-
-    PUT(HDRP(bp), PACK(size, 0) | GET_PREV_ALLOC(HDRP(bp)));
-    PUT(FTRP(bp), PACK(size, 0));
-    coalesce(bp);
+#endif
+    free_block(bp);
 }
 
 /*
@@ -209,7 +417,7 @@ void free(void *bp){
  * 
  */
 void *realloc(void *oldptr, size_t size) {
-    size_t oldsize;
+    size_t oldsize, asize;
     void *newptr;
 
     /* If size == 0 then this is just free, and we return NULL. */
@@ -222,8 +430,29 @@ void *realloc(void *oldptr, size_t size) {
     if(oldptr == NULL){
         return mm_malloc(size);
     }
+    if(size > MAX_REQUEST){
+        errno = ENOMEM;
+        return 0;
+    }
+
+    /* Stay in place: the block's slack (a shrink by more than half moves
+       to a better fit), or the free block after it */
+    oldsize = GET_SIZE(HDRP(oldptr));
+    asize = MAX(ALIGN(size + WSIZE), 2*DSIZE);
+    if(asize <= oldsize && 2*asize >= oldsize){
+        shrink_block(oldptr, asize);
+        return oldptr;
+    }
+    if(asize > oldsize && grow_block(oldptr, asize))
+        return oldptr;
 
+#ifndef SHARED
+    /* A block of a lifetime class moves within its class */
+    char *rb = region_of(oldptr);
+    newptr = rb ? hint_malloc(size, GET(rb)) : mm_malloc(size);
+#else
     newptr = mm_malloc(size);
+#endif
 
     /* If realloc() fails the original block is left untouched  */
     if(!newptr){
@@ -231,9 +460,7 @@ void *realloc(void *oldptr, size_t size) {
     }
 
     /* Copy the old data. */
-    oldsize = GET_SIZE(HDRP(oldptr));
-    if(size < oldsize) oldsize = size;
-    memcpy(newptr, oldptr, oldsize);
+    memcpy(newptr, oldptr, MIN(size, oldsize - WSIZE));
 
     /* Free the old block. */
     mm_free(oldptr);
@@ -281,6 +508,10 @@ static void *extend_heap(size_t words){
 
     /* Allocate an even number of words to maintain alignment */
     size = (words % 2) ? (words+1) * WSIZE : words * WSIZE; 
+#if !defined(PRELOAD) && !defined(SHARED)
+    if(size > INT_MAX)          /* memlib's mem_sbrk takes an int */
+        return NULL;
+#endif
     if ((long)(bp = mem_sbrk(size)) == -1)  
         return NULL;                                        
 
@@ -299,6 +530,10 @@ static void *extend_heap(size_t words){
  *        and update root afterwards 
  */
 static void insert_list(void *bp, size_t size){ 
+    if(size > LISTMAX){
+        insert_tree(bp, size);
+        return;
+    }
     /* start<-bp<->root->something */
     root = size2ptr(size);
     SET_PREV(bp, heap_listp);
@@ -321,6 +556,10 @@ static void insert_list(void *bp, size_t size){
  *        and update root afterwards 
  */
 static void remove_list(void *bp, size_t size){
+    if(size > LISTMAX){
+        remove_tree(bp, size);
+        return;
+    }
     void *prev = (void *)GET_PREV(bp);
     void *next = (void *)GET_NEXT(bp);
     root = size2ptr(size);
@@ -373,6 +612,8 @@ static void *coalesce(void *bp){
     }
     insert_list(bp, size);
     PUT(HDRP(NEXT_BLKP(bp)), (GET(HDRP(NEXT_BLKP(bp))) & (~0x2)));
+    if(compact_p > (char *)bp && compact_p < NEXT_BLKP(bp))
+        compact_p = bp;         /* cursor was merged away */
     return bp;
 }
 
@@ -386,9 +627,9 @@ static void place(void *bp, size_t asize){
     if ((csize - asize) >= (2 * DSIZE)) { 
         PUT(HDRP(bp), PACK(asize, 1+GET_PREV_ALLOC(HDRP(bp))));
         bp = NEXT_BLKP(bp);
-        insert_list(bp, csize-asize);
         PUT(HDRP(bp), PACK(csize-asize, 2));
         PUT(FTRP(bp), PACK(csize-asize, 0));
+        insert_list(bp, csize-asize);
     } 
     else{ 
         PUT(HDRP(bp), PACK(csize, 1+GET_PREV_ALLOC(HDRP(bp))));
@@ -396,22 +637,110 @@ static void place(void *bp, size_t asize){
     }
 }
 
+/*
+ * free_block - free bp in the lists of the current roots
+ */
+static void free_block(void *bp){
+    size_t size = GET_SIZE(HDRP(bp));
+    if(heap_listp == 0){
+        mm_init();
+    }
+
+    PUT(HDRP(bp), PACK(size, 0) | GET_PREV_ALLOC(HDRP(bp)));
+    PUT(FTRP(bp), PACK(size, 0));
+    coalesce(bp);
+}
+
+/*
+ * shrink_block - cut allocated bp down to asize bytes and free the tail
+ *                if it can be a block of its own
+ */
+static void shrink_block(void *bp, size_t asize){
+    size_t size = GET_SIZE(HDRP(bp));
+    char *tp;
+
+    if(size - asize < 2*DSIZE)
+        return;
+    PUT(HDRP(bp), PACK(asize, 1 | GET_PREV_ALLOC(HDRP(bp))));
+    tp = NEXT_BLKP(bp);
+    PUT(HDRP(tp), PACK(size - asize, 3));
+    mm_free(tp);                /* routes a region block to its class */
+}
+
+/*
+ * grow_block - grow allocated bp to asize (> its size) bytes over the free
+ *              block after it, extending the heap if bp is at the top. 
+ *              Return 0 (bp untouched) if there is no room, or if that
+ *              block is over twice asize and better left to find_fit
+ */
+static int grow_block(void *bp, size_t asize){
+    char *next = NEXT_BLKP(bp);
+    char *wild = wilderness();
+    size_t size = GET_SIZE(HDRP(bp));
+
+#ifndef SHARED
+    if(region_of(bp))           /* next is in the lists of another class */
+        return 0;
+#endif
+    if(GET_SIZE(HDRP(next)) == 0 || 
+       (next == wild && size + GET_SIZE(HDRP(next)) < asize)){
+        if(extend_heap(MAX(asize - size - GET_SIZE(HDRP(next)), CHUNKSIZE)/WSIZE) == NULL)
+            return 0;
+        next = wild = NEXT_BLKP(bp);    /* merged with the old wilderness */
+    }
+    if(GET_ALLOC(HDRP(next)) || size + GET_SIZE(HDRP(next)) < asize)
+        return 0;
+    if(next != wild && size + GET_SIZE(HDRP(next)) - asize > asize)
+        return 0;
+    remove_list(next, GET_SIZE(HDRP(next)));
+    size += GET_SIZE(HDRP(next));
+    PUT(HDRP(bp), PACK(size, 1 | GET_PREV_ALLOC(HDRP(bp))));
+    next = NEXT_BLKP(bp);
+    PUT(HDRP(next), GET(HDRP(next)) | 0x2);
+    if(compact_p > (char *)bp && compact_p < next)
+        compact_p = bp;         /* cursor was merged away */
+    shrink_block(bp, asize);
+    return 1;
+}
+
 /* 
  * find_fit - Find a fit for a block with asize bytes 
  */
-static void *find_fit(size_t asize){ 
-    /* First-fit search */
+static void *find_fit(size_t asize, void *wild){ 
+    /* First-fit search over the lists, best fit in the tree, 
+       the wilderness wild (NULL : none) last */
     void *bp;
 
     size_t size = 0x10;
-    for(bp = size2ptr(size); size<=8192; bp = size2ptr(size)){
+    for(bp = size2ptr(size); size<=LISTMAX && asize<=LISTMAX; bp = size2ptr(size)){
         size = size << 1;
         for(; bp != heap_listp; bp = (void *)GET_NEXT(bp)){
-            if(asize <= GET_SIZE(HDRP(bp))) 
+            if(asize <= GET_SIZE(HDRP(bp)) && bp != wild) 
                 return bp;
         }
     }
-    return NULL; /* No fit */
+    bp = tree_fit(asize);
+    if(bp != NULL && bp == wild){       /* an interior block may be larger */
+        size = GET_SIZE(HDRP(wild));
+        remove_tree(wild, size);
+        bp = tree_fit(asize);
+        insert_tree(wild, size);
+        if(bp == NULL)
+            bp = wild;
+    }
+    if(bp == NULL && wild != NULL && asize <= GET_SIZE(HDRP(wild)))
+        bp = wild;
+    return bp;
+}
+
+/*
+ * wilderness - the free block at the top of the heap, NULL if none
+ */
+static void *wilderness(void){
+    char *bp = (char *)mem_heap_hi() + 1;      /* past the epilogue */
+    if(GET_PREV_ALLOC(HDRP(bp)))
+        return NULL;
+    return PREV_BLKP(bp);
 }
 
 /*
@@ -427,7 +756,7 @@ static void *size2ptr(size_t size){
     else if(size <= 1024) return root7;
     else if(size <= 2048) return root8;
     else if(size <= 4096) return root9;
-    else return root10;
+    else return tree;
 }
 
 /*
@@ -443,7 +772,146 @@ static void update_root(size_t size){
     else if(size <= 1024) root7 = root;
     else if(size <= 2048) root8 = root;
     else if(size <= 4096) root9 = root;
-    else root10 = root;
+    else tree = root;
+}
+
+/*
+ * key_less - (size, address) ordering of tree nodes
+ */
+static int key_less(size_t size, void *bp, void *node){
+    size_t nsize = GET_SIZE(HDRP(node));
+    return size < nsize || (size == nsize && (char *)bp < (char *)node);
+}
+
+/*
+ * splay - Top-down splay of key (size, bp) in tree t, return new root
+ *         (the node with that key, or the last node on its search path)
+ * NOTES: lroot/rroot collect the pieces smaller/larger than the key,
+ *        lslot/rslot point at the slot where the next piece is hung
+ */
+static void *splay(void *t, size_t size, void *bp){
+    unsigned int lroot = 0, rroot = 0;
+    unsigned int *lslot = &lroot, *rslot = &rroot;
+    void *y;
+
+    if(t == heap_listp)
+        return t;
+    while(t != bp){
+        if(key_less(size, bp, t)){
+            y = GET_LEFT(t);
+            if(y == heap_listp) 
+                break;
+            if(key_less(size, bp, y)){  /* zig-zig: rotate right */
+                SET_LEFT(t, GET_RIGHT(y));
+                SET_RIGHT(y, t);
+                t = y;
+                if(GET_LEFT(t) == heap_listp) 
+                    break;
+            }
+            *rslot = ADDR2OF(t);        /* link right */
+            rslot = LEFTP(t);
+            t = GET_LEFT(t);
+        }
+        else{
+            y = GET_RIGHT(t);
+            if(y == heap_listp) 
+                break;
+            if(!key_less(size, bp, y) && y != bp){  /* zag-zag: rotate left */
+                SET_RIGHT(t, GET_LEFT(y));
+                SET_LEFT(y, t);
+                t = y;
+                if(GET_RIGHT(t) == heap_listp) 
+                    break;
+            }
+            *lslot = ADDR2OF(t);        /* link left */
+            lslot = RIGHTP(t);
+            t = GET_RIGHT(t);
+        }
+    }
+    /* assemble: left pieces <- t -> right pieces */
+    *lslot = *LEFTP(t);
+    *rslot = *RIGHTP(t);
+    *LEFTP(t) = lroot;
+    *RIGHTP(t) = rroot;
+    return t;
+}
+
+/*
+ * insert_tree - splay key of bp to the root and hang root under bp
+ */
+static void insert_tree(void *bp, size_t size){
+    void *t = splay(tree, size, bp);
+    if(t == heap_listp){
+        SET_LEFT(bp, heap_listp);
+        SET_RIGHT(bp, heap_listp);
+    }
+    else if(key_less(size, bp, t)){
+        SET_LEFT(bp, GET_LEFT(t));
+        SET_RIGHT(bp, t);
+        SET_LEFT(t, heap_listp);
+    }
+    else{
+        SET_RIGHT(bp, GET_RIGHT(t));
+        SET_LEFT(bp, t);
+        SET_RIGHT(t, heap_listp);
+    }
+    tree = bp;
+}
+
+/*
+ * remove_tree - splay bp to the root, join its subtrees
+ *               (splay of left subtree brings its maximum up, no right child)
+ */
+static void remove_tree(void *bp, size_t size){
+    void *t = splay(tree, size, bp);
+    assert(t == bp);
+    if(GET_LEFT(t) == heap_listp){
+        tree = GET_RIGHT(t);
+    }
+    else{
+        tree = splay(GET_LEFT(t), size, bp);
+        SET_RIGHT(tree, GET_RIGHT(t));
+    }
+}
+
+/*
+ * tree_fit - Best fit: smallest (size, address) with size >= asize
+ */
+static void *tree_fit(size_t asize){
+    void *t = splay(tree, asize, heap_listp);
+    if(t == heap_listp)
+        return NULL;
+    tree = t;
+    if(GET_SIZE(HDRP(t)) >= asize)
+        return t;
+    /* root is the largest key below asize: answer is min of right subtree */
+    if(GET_RIGHT(t) == heap_listp)
+        return NULL;
+    SET_RIGHT(t, splay(GET_RIGHT(t), asize, heap_listp));
+    return GET_RIGHT(t);
+}
+
+/*
+ * check_tree - In-order check of subtree t, all keys within (lo, hi)
+ *              (heap_listp: unbounded), return amount of nodes
+ */
+static size_t check_tree(void *t, void *lo, void *hi){
+    if(t == heap_listp)
+        return 0;
+    if(GET_SIZE(HDRP(t)) <= LISTMAX){
+        printf("Exceed Tree Range\n");
+        exit(0);
+    }
+    if(GET_ALLOC(HDRP(t))){
+        printf("Allocated block in tree\n");
+        exit(0);
+    }
+    if((lo != heap_listp && key_less(GET_SIZE(HDRP(t)), t, lo)) ||
+       (hi != heap_listp && !key_less(GET_SIZE(HDRP(t)), t, hi))){
+        printf("Tree key order error\n");
+        exit(0);
+    }
+    return 1 + check_tree(GET_LEFT(t), lo, t) + check_tree(GET_RIGHT(t), t, hi);
 }
 
 /*
@@ -453,6 +921,8 @@ static void update_root(size_t size){
  * 2.Free List check for:
  *      Next/Previous pointer error, Bucket range error,
  *      Record amount of free blocks
+ * 3.Free Tree check for:
+ *      Key order error, Bucket range error, Allocated block in tree
  */
 void mm_checkheap(int verbose){
     void *ptr;
@@ -475,7 +945,7 @@ void mm_checkheap(int verbose){
     /* Free List Check */
     size_t size = 0x10;
     size_t cnt = 0;
-    for(ptr = size2ptr(size); size<=8192; ptr = size2ptr(size)){
+    for(ptr = size2ptr(size); size<=LISTMAX; ptr = size2ptr(size)){
         for(; (void *)GET_NEXT(ptr) != heap_listp; ptr = (void *)GET_NEXT(ptr)){
             cnt++;
             if((void *)GET_PREV(GET_NEXT(ptr)) != ptr){
@@ -490,7 +960,935 @@ void mm_checkheap(int verbose){
         cnt++;
         size = size << 1;
     }
+
+    /* Free Tree Check */
+    cnt += check_tree(tree, heap_listp, heap_listp);
     if(verbose){
         printf("Free blocks count: %ld\n",cnt);
     }
 }
+
+/*=========================== HANDLES ===========================*/
+#ifndef SHARED
+struct hentry {
+    unsigned int off;           /* block offset from heap_listp, 0 : free entry */
+    unsigned int pins;          /* pin count, next free entry if free */
+};
+
+static struct hentry *htab = 0; /* handle table, entry 0 unused */
+static unsigned int hcap = 0;   /* entries in htab */
+static unsigned int hfree = 0;  /* first free entry, 0 : none */
+static int compact_moved = 0;   /* this sweep moved a block */
+
+/* Handle of a handle block, kept in its last word */
+#define HANDLEP(bp)     ((unsigned int *)FTRP(bp))
+
+/*
+ * handle_reset - forget the handles of the previous heap (mm_init)
+ */
+static void handle_reset(void){
+    htab = 0;
+    hcap = 0;
+    hfree = 0;
+    compact_moved = 0;
+}
+
+/*
+ * hvalid - h is a live handle (entry 0 is never one)
+ */
+static int hvalid(unsigned int h){
+    return h != 0 && h < hcap && htab[h].off != 0;
+}
+
+/*
+ * hgrow - double the handle table (a plain, immovable heap block)
+ */
+static int hgrow(void){
+    unsigned int i, ncap = hcap ? 2 * hcap : 64;
+    struct hentry *nt = mm_malloc(ncap * sizeof(struct hentry));
+    if(nt == NULL)
+        return -1;
+    if(htab){
+        memcpy(nt, htab, hcap * sizeof(struct hentry));
+        mm_free(htab);
+    }
+    for(i = ncap - 1; i >= (hcap ? hcap : 1); i--){
+        nt[i].off = 0;
+        nt[i].pins = hfree;
+        hfree = i;
+    }
+    htab = nt;
+    hcap = ncap;
+    return 0;
+}
+
+/*
+ * mm_halloc - movable block of size bytes, return handle (0 on error)
+ */
+unsigned int mm_halloc(size_t size){
+    unsigned int h = 0;
+    char *bp;
+
+    MM_LOCK();
+    if(size == 0 || size > MAX_REQUEST - WSIZE || 
+       (hfree == 0 && hgrow() == -1))
+        goto out;
+    if((bp = mm_malloc(size + WSIZE)) == NULL)
+        goto out;
+    h = hfree;
+    hfree = htab[h].pins;
+    htab[h].off = ADDR2OF(bp);
+    htab[h].pins = 0;
+    PUT(HDRP(bp), GET(HDRP(bp)) | HANDLE);
+    *HANDLEP(bp) = h;
+out:
+    MM_UNLOCK();
+    return h;
+}
+
+/*
+ * mm_pin - payload of handle h, which stays put until mm_unpin(h)
+ * NULL if h is not a live handle; unpin and hfree ignore one.
+ */
+void *mm_pin(unsigned int h){
+    void *bp = NULL;
+    MM_LOCK();
+    if(hvalid(h)){
+        htab[h].pins++;
+        bp = (void *)(OF2ADDR(htab[h].off));
+    }
+    MM_UNLOCK();
+    return bp;
+}
+
+void mm_unpin(unsigned int h){
+    MM_LOCK();
+    if(hvalid(h) && htab[h].pins > 0)   /* an unbalanced unpin is ignored */
+        htab[h].pins--;
+    MM_UNLOCK();
+}
+
+void mm_hfree(unsigned int h){
+    MM_LOCK();
+    if(!hvalid(h)){             /* 0, out of range or already freed */
+        MM_UNLOCK();
+        return;
+    }
+    mm_free((void *)(OF2ADDR(htab[h].off)));
+    htab[h].off = 0;
+    htab[h].pins = hfree;
+    hfree = h;
+    MM_UNLOCK();
+}
+
+/*
+ * movable - nb is an unpinned handle block, or the handle table itself
+ */
+static int movable(char *nb){
+    if(nb == (char *)htab)
+        return 1;
+    return GET_ALLOC(HDRP(nb)) && GET_HANDLE(HDRP(nb)) && htab[*HANDLEP(nb)].pins == 0;
+}
+
+/*
+ * slide - move movable block nb down over the free block bp before it,
+ *         return the free block that now follows it (after coalescing)
+ */
+static void *slide(char *bp, char *nb){
+    size_t fsize = GET_SIZE(HDRP(bp));
+    size_t nsize = GET_SIZE(HDRP(nb));
+    unsigned int hbit = GET_HANDLE(HDRP(nb));
+
+    remove_list(bp, fsize);
+    memmove(bp, nb, nsize - WSIZE);
+    PUT(HDRP(bp), PACK(nsize, 1 | hbit | GET_PREV_ALLOC(HDRP(bp))));
+    if(hbit)
+        htab[*HANDLEP(bp)].off = ADDR2OF(bp);
+    else
+        htab = (struct hentry *)bp;
+    bp = NEXT_BLKP(bp);
+    PUT(HDRP(bp), PACK(fsize, 2));
+    PUT(FTRP(bp), PACK(fsize, 0));
+    return coalesce(bp);
+}
+
+/*
+ * trim - give a free block at the end of the heap back to the system
+ */
+static void trim(void){
+#ifdef PRELOAD
+    char *bp = wilderness();
+    size_t size;
+
+    if(bp == NULL || (size = GET_SIZE(HDRP(bp))) < 2*CHUNKSIZE)
+        return;
+    remove_list(bp, size);
+    PUT(HDRP(bp), PACK(0, 3));                  /* new epilogue */
+    mem_trim(size);
+#endif
+}
+
+/*
+ * mm_compact - one step of at most budget bytes of work,
+ *              return 0 once a whole sweep found nothing to move
+ */
+int mm_compact(size_t budget){
+    char *bp, *nb;
+    size_t work = 0;
+    int ret = 1;
+
+    MM_LOCK();
+    if(heap_listp == 0){
+        MM_UNLOCK();
+        return 0;
+    }
+    quick_flush();              /* parked blocks would be barriers */
+    bp = compact_p ? compact_p : NEXT_BLKP(heap_listp);
+    while(GET_SIZE(HDRP(bp)) > 0 && work < budget){
+        nb = NEXT_BLKP(bp);
+        if(GET_ALLOC(HDRP(bp)) || !movable(nb)){
+            work += DSIZE;
+            bp = nb;
+            continue;
+        }
+        work += GET_SIZE(HDRP(nb));
+        bp = slide(bp, nb);
+        compact_moved = 1;
+    }
+    if(GET_SIZE(HDRP(bp)) == 0){                /* end of sweep */
+        trim();
+        ret = compact_moved;
+        compact_moved = 0;
+        bp = 0;
+    }
+    compact_p = bp;
+    MM_UNLOCK();
+    return ret;
+}
+#endif /* ndef SHARED */
+
+/*=========================== LIFETIME HINTS ===========================*/
+#ifndef SHARED
+#define LIFETIME_SHORT      0
+#define LIFETIME_LONG       1
+#define LIFETIME_PERMANENT  2
+#define REGION      (8*CHUNKSIZE)   /* bytes per region */
+#define REGION_IN   (REGION - 2*ALIGNMENT)  /* first free block of a region */
+
+static char *croots[3][10];     /* saved roots of LONG/PERMANENT, 0 : empty */
+static int nregion = 0;         /* live regions */
+/* Offset of the region starting in each REGION bytes of heap, 0 : none */
+static unsigned int regstart[((size_t)1 << 32) / REGION];
+
+/*
+ * swap_roots - exchange the ten roots with the saved set of class c
+ *              (call again to swap back)
+ */
+static void swap_roots(int c){
+    char *t;
+    int i;
+    for(i = 0; i < 10; i++){
+        t = croots[c][i] ? croots[c][i] : heap_listp;
+        croots[c][i] = *all_roots[i];
+        *all_roots[i] = t;
+    }
+}
+
+/*
+ * region_reset - forget the regions of the previous heap (mm_init)
+ */
+static void region_reset(void){
+    if(nregion)
+        memset(regstart, 0, sizeof(regstart));
+    memset(croots, 0, sizeof(croots));
+    nregion = 0;
+}
+
+/*
+ * region_of - region block holding bp, NULL if none (the region block
+ *             itself is not inside). A region spans at most two slots of
+ *             regstart: the one it starts in and the next.
+ */
+static char *region_of(void *bp){
+    size_t off = ADDR2OF(bp), i = off / REGION, r;
+    if(nregion == 0)
+        return NULL;
+    r = regstart[i];
+    if(r && r < off && off < r + REGION)
+        return (char *)(OF2ADDR(r));
+    r = i ? regstart[i - 1] : 0;
+    if(r && r < off && off < r + REGION)
+        return (char *)(OF2ADDR(r));
+    return NULL;
+}
+
+/*
+ * region_new - region for class c: a REGION-byte block of the main heap
+ *              with one free block of REGION_IN bytes in class c
+ */
+static void *region_new(int c){
+    char *rb, *ib;
+
+    if((rb = mm_malloc(REGION - WSIZE)) == NULL)
+        return NULL;
+    PUT(rb, c);                                 /* class word */
+    ib = rb + ALIGNMENT;
+    PUT(HDRP(ib), PACK(REGION_IN, 2));          /* prologue: prev allocated */
+    PUT(FTRP(ib), PACK(REGION_IN, 0));
+    PUT(HDRP(NEXT_BLKP(ib)), PACK(0, 1));       /* epilogue */
+    regstart[(size_t)(ADDR2OF(rb)) / REGION] = ADDR2OF(rb);
+    nregion++;
+    swap_roots(c);
+    insert_list(ib, REGION_IN);
+    swap_roots(c);
+    return ib;
+}
+
+/*
+ * region_free - free bp in the lists of its class; give the region back
+ *               to the main heap once it is all free
+ */
+static void region_free(char *rb, void *bp){
+    int c = GET(rb);
+    size_t size = GET_SIZE(HDRP(bp));
+
+    swap_roots(c);
+    PUT(HDRP(bp), PACK(size, 0) | GET_PREV_ALLOC(HDRP(bp)));
+    PUT(FTRP(bp), PACK(size, 0));
+    bp = coalesce(bp);
+    if(GET_SIZE(HDRP(bp)) == REGION_IN){
+        remove_list(bp, REGION_IN);
+        swap_roots(c);
+        regstart[(size_t)(ADDR2OF(rb)) / REGION] = 0;
+        nregion--;
+        mm_free(rb);
+        return;
+    }
+    swap_roots(c);
+}
+
+/*
+ * hint_malloc - mm_malloc_hint with the lock held (also realloc of a
+ *               region block)
+ */
+static void *hint_malloc(size_t size, int lifetime){
+    size_t asize;
+    char *bp;
+
+    if((lifetime != LIFETIME_LONG && lifetime != LIFETIME_PERMANENT) ||
+       size == 0 || size > REGION/4)
+        return mm_malloc(size);
+    asize = MAX(ALIGN(size + WSIZE), 2*DSIZE);
+    swap_roots(lifetime);
+    bp = find_fit(asize, NULL);          /* regions have no wilderness */
+    swap_roots(lifetime);
+    if(bp == NULL && (bp = region_new(lifetime)) == NULL)
+        return NULL;
+    swap_roots(lifetime);
+    place(bp, asize);
+    swap_roots(lifetime);
+    return bp;
+}
+
+/*
+ * mm_malloc_hint - malloc for objects of a known lifetime class
+ */
+void *mm_malloc_hint(size_t size, int lifetime){
+    void *bp;
+
+    MM_LOCK();
+    bp = hint_malloc(size, lifetime);
+    MM_UNLOCK();
+    return bp;
+}
+#endif /* ndef SHARED */
+
+/*=========================== SIZED API ===========================*/
+#ifndef SHARED
+/* Quick lists of parked blocks by asize / ALIGNMENT, offsets, 0 : empty */
+static unsigned int quick[QUICK_MAX / ALIGNMENT + 1];
+static unsigned int nquick[QUICK_MAX / ALIGNMENT + 1];
+
+/*
+ * quick_reset - forget the parked blocks of the previous heap (mm_init)
+ */
+static void quick_reset(void){
+    memset(quick, 0, sizeof(quick));
+    memset(nquick, 0, sizeof(nquick));
+}
+
+/*
+ * quick_pop - a parked block of class asize, NULL if none
+ */
+static void *quick_pop(size_t asize){
+    size_t c = asize / ALIGNMENT;
+    char *bp;
+
+    if(quick[c] == 0)
+        return NULL;
+    bp = (char *)(OF2ADDR(quick[c]));
+    quick[c] = *(unsigned int *)bp;
+    nquick[c]--;
+    return bp;
+}
+
+/*
+ * quick_flush - free every parked block for real, return how many
+ */
+static int quick_flush(void){
+    size_t c;
+    char *bp;
+    int n = 0;
+
+    for(c = 0; c <= QUICK_MAX / ALIGNMENT; c++){
+        while((bp = quick_pop(c * ALIGNMENT)) != NULL){
+            free_block(bp);
+            n++;
+        }
+    }
+    return n;
+}
+
+/*
+ * mm_malloc_usable_size - payload bytes of bp, the request rounded up
+ */
+size_t mm_malloc_usable_size(void *bp){
+    return bp ? GET_SIZE(HDRP(bp)) - WSIZE : 0;
+}
+
+/*
+ * mm_malloc_at_least - malloc of at least size bytes, the usable size
+ *                      in *actual (0 on failure)
+ */
+void *mm_malloc_at_least(size_t size, size_t *actual){
+    void *bp;
+    MM_LOCK();
+    bp = mm_malloc(size);
+    MM_UNLOCK();
+    *actual = mm_malloc_usable_size(bp);
+    return bp;
+}
+
+/*
+ * mm_free_sized - free of a block the caller asked size bytes (or its
+ *                 usable size) for: a small block is parked on the
+ *                 quick list of its class, headers untouched
+ */
+void mm_free_sized(void *bp, size_t size){
+    size_t c;
+    char *rb;
+
+    if(bp == 0)
+        return;
+    MM_LOCK();
+    c = MAX(ALIGN(size + WSIZE), 2*DSIZE) / ALIGNMENT;
+    if(size <= QUICK_MAX && c <= QUICK_MAX / ALIGNMENT && 
+       nquick[c] < QUICK_CAP && nregion == 0){
+        *(unsigned int *)bp = quick[c];
+        quick[c] = ADDR2OF(bp);
+        nquick[c]++;
+    }
+    else if((rb = region_of(bp)) != NULL)
+        region_free(rb, bp);
+    else
+        free_block(bp);
+    MM_UNLOCK();
+}
+#endif /* ndef SHARED */
+
+/*=========================== PRELOAD BUILD ===========================*/
+#ifdef PRELOAD
+#undef malloc
+#undef free
+#undef realloc
+#undef calloc
+
+#define HEAP_STEP   ((size_t)1 << 16)   /* read/write granularity */
+
+static char *mem_start = 0;     /* reserved [mem_start, mem_start + HEAP_MAX) */
+static char *mem_brk = 0;       /* end of heap */
+static char *mem_rw = 0;        /* end of read/write pages */
+
+/*
+ * mem_sbrk - memlib's sbrk on a reserved range of real virtual memory
+ */
+static void *mem_sbrk(size_t incr){
+    char *old;
+    size_t grow;
+
+    if(mem_start == 0){
+        old = mmap(NULL, HEAP_MAX, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(old == MAP_FAILED)
+            return (void *)-1;
+        mem_start = mem_brk = mem_rw = old;
+    }
+    if(incr > HEAP_MAX - (size_t)(mem_brk - mem_start))
+        return (void *)-1;
+    if(mem_brk + incr > mem_rw){
+        grow = (mem_brk + incr - mem_rw + HEAP_STEP - 1) & ~(HEAP_STEP - 1);
+        if(mprotect(mem_rw, grow, PROT_READ | PROT_WRITE) != 0)
+            return (void *)-1;
+        mem_rw += grow;
+    }
+    old = mem_brk;
+    mem_brk += incr;
+    return old;
+}
+
+/*
+ * mem_trim - lower the break by decr bytes, giving whole steps back
+ */
+static void mem_trim(size_t decr){
+    size_t keep;
+
+    if(decr > (size_t)(mem_brk - mem_start))
+        return;
+    mem_brk -= decr;
+    keep = ((size_t)(mem_brk - mem_start) + HEAP_STEP - 1) & ~(HEAP_STEP - 1);
+    if(mem_start + keep < mem_rw){
+        madvise(mem_start + keep, mem_rw - mem_start - keep, MADV_DONTNEED);
+        mprotect(mem_start + keep, mem_rw - mem_start - keep, PROT_NONE);
+        mem_rw = mem_start + keep;
+    }
+}
+
+static void *mem_heap_lo(void){
+    return mem_start;
+}
+
+static void *mem_heap_hi(void){
+    return mem_brk - 1;
+}
+
+/*
+ * mm_memalign - allocate size + align + min block, keep the aligned part
+ *               and give the head and tail back to the free lists
+ */
+static void *mm_memalign(size_t align, size_t size){
+    char *bp, *ab, *tp;
+    size_t bsize, asize;
+
+    if(align <= ALIGNMENT)
+        return mm_malloc(size);
+    if(size > HEAP_MAX || align > HEAP_MAX ||
+       (bp = mm_malloc(size + align + 2*DSIZE)) == NULL)
+        return NULL;
+    ab = bp;
+    if((size_t)bp & (align - 1)){
+        /* head must be a block on its own (at least 2*DSIZE) */
+        ab = (char *)(((size_t)bp + 2*DSIZE + align - 1) & ~(align - 1));
+        bsize = GET_SIZE(HDRP(bp));
+        PUT(HDRP(ab), PACK(bsize - (ab - bp), 3));
+        PUT(HDRP(bp), PACK(ab - bp, 1 | GET_PREV_ALLOC(HDRP(bp))));
+        mm_free(bp);
+    }
+    asize = MAX(ALIGN(size + WSIZE), 2*DSIZE);
+    bsize = GET_SIZE(HDRP(ab));
+    if(bsize - asize >= 2*DSIZE){
+        PUT(HDRP(ab), PACK(asize, 1 | GET_PREV_ALLOC(HDRP(ab))));
+        tp = NEXT_BLKP(ab);
+        PUT(HDRP(tp), PACK(bsize - asize, 3));
+        mm_free(tp);
+    }
+    return ab;
+}
+
+/*
+ * fork hooks - no other thread may be inside the allocator at fork
+ */
+static void fork_prepare(void){
+    pthread_mutex_lock(&mm_lock);
+}
+
+static void fork_parent(void){
+    pthread_mutex_unlock(&mm_lock);
+}
+
+static void fork_child(void){
+    pthread_mutex_init(&mm_lock, NULL);
+}
+
+__attribute__((constructor))
+static void preload_init(void){
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+}
+
+/*
+ * libc entry points
+ */
+void *malloc(size_t size){
+    void *p;
+    pthread_mutex_lock(&mm_lock);
+    p = mm_malloc(size ? size : 1);
+    pthread_mutex_unlock(&mm_lock);
+    if(!p) 
+        errno = ENOMEM;
+    return p;
+}
+
+void free(void *p){
+    if(p == NULL)
+        return;
+    pthread_mutex_lock(&mm_lock);
+    mm_free(p);
+    pthread_mutex_unlock(&mm_lock);
+}
+
+void *realloc(void *p, size_t size){
+    void *np;
+    pthread_mutex_lock(&mm_lock);
+    np = mm_realloc(p, size);
+    pthread_mutex_unlock(&mm_lock);
+    if(!np && size) 
+        errno = ENOMEM;
+    return np;
+}
+
+/* mm_malloc, not malloc: gcc turns malloc + memset back into calloc */
+void *calloc(size_t nmemb, size_t size){
+    void *p;
+    size_t bytes = nmemb * size;
+    if(size && nmemb > HEAP_MAX / size){
+        errno = ENOMEM;
+        return NULL;
+    }
+    pthread_mutex_lock(&mm_lock);
+    p = mm_malloc(bytes ? bytes : 1);
+    pthread_mutex_unlock(&mm_lock);
+    if(!p){
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(p, 0, bytes);
+    return p;
+}
+
+void *memalign(size_t align, size_t size){
+    void *p;
+    if(align & (align - 1)){
+        errno = EINVAL;
+        return NULL;
+    }
+    pthread_mutex_lock(&mm_lock);
+    p = mm_memalign(align, size ? size : 1);
+    pthread_mutex_unlock(&mm_lock);
+    if(!p) 
+        errno = ENOMEM;
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size){
+    void *p;
+    if(align < sizeof(void *) || (align & (align - 1)))
+        return EINVAL;
+    if((p = memalign(align, size)) == NULL)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t align, size_t size){
+    return memalign(align, size);
+}
+
+void *valloc(size_t size){
+    return memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+void *pvalloc(size_t size){
+    size_t page = sysconf(_SC_PAGESIZE);
+    return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void *p){
+    return mm_malloc_usable_size(p);
+}
+
+/* C23 sized free */
+void free_sized(void *p, size_t size){
+    mm_free_sized(p, size);
+}
+
+void free_aligned_sized(void *p, size_t align, size_t size){
+    (void)align;
+    mm_free_sized(p, size);
+}
+#endif /* def PRELOAD */
+
+/*=========================== SHARED HEAP ===========================*/
+#ifdef SHARED
+#define SHM_MAGIC   0x6d6d7368      /* "mmsh" */
+#define SHM_HEAD    4096            /* heap starts one page into the mapping */
+#define SHM_MAX     ((size_t)1 << 32)
+#define SNAP_MAGIC  0x6d6d736e      /* "mmsn" */
+#define SNAP_VERSION 1
+
+/* Header of the mapping: everything a process needs to rebuild the globals */
+struct shm_head {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int roots[10];     /* root1 ~ root9, tree: offsets from heap_listp */
+    unsigned int app;           /* application root object, offset */
+    size_t size;                /* bytes mapped, header included */
+    size_t brk;                 /* bytes of heap in use */
+    unsigned long long sum;     /* snapshot checksum, 0 while hashing */
+    pthread_mutex_t lock;       /* process-shared, robust; not hashed */
+};
+
+static struct shm_head *shm = 0;     /* mapping in this process */
+
+/*
+ * mem_sbrk - memlib's sbrk on the shared break
+ */
+static void *mem_sbrk(size_t incr){
+    char *old = (char *)shm + SHM_HEAD + shm->brk;
+    if(incr > shm->size - SHM_HEAD - shm->brk)
+        return (void *)-1;
+    shm->brk += incr;
+    return old;
+}
+
+static void *mem_heap_lo(void){
+    return (char *)shm + SHM_HEAD;
+}
+
+static void *mem_heap_hi(void){
+    return (char *)shm + SHM_HEAD + shm->brk - 1;
+}
+
+/*
+ * shm_lock - take the heap, load the globals for this mapping
+ * NOTES: a holder that died leaves EOWNERDEAD, the heap is taken over as is
+ */
+static void shm_lock(void){
+    int i;
+    if(pthread_mutex_lock(&shm->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&shm->lock);
+    heap_listp = (char *)shm + SHM_HEAD + 2*WSIZE;
+    for(i = 0; i < 10; i++)
+        *all_roots[i] = (char *)(OF2ADDR(shm->roots[i]));
+}
+
+/*
+ * shm_unlock - store the roots back, release the heap
+ */
+static void shm_unlock(void){
+    int i;
+    for(i = 0; i < 10; i++)
+        shm->roots[i] = ADDR2OF(*all_roots[i]);
+    pthread_mutex_unlock(&shm->lock);
+}
+
+/*
+ * mm_shared_open - map the heap in file path (created with bytes of room if
+ *                  empty), or in a new memfd if path is NULL.
+ *                  Return -1 on error, 0 on success.
+ */
+int mm_shared_open(const char *path, size_t bytes){
+    int fd, i, ret = -1;
+    struct stat st;
+    pthread_mutexattr_t attr;
+    void *p;
+
+    bytes = (bytes + SHM_HEAD + CHUNKSIZE - 1) & ~(size_t)(CHUNKSIZE - 1);
+    if(bytes > SHM_MAX)
+        return -1;
+    fd = path ? open(path, O_RDWR | O_CREAT, 0600) : memfd_create("mm_shared", 0);
+    if(fd < 0)
+        return -1;
+    flock(fd, LOCK_EX);         /* one creator, attachers wait for it */
+    if(fstat(fd, &st) != 0)
+        goto out;
+    if(st.st_size != 0)
+        bytes = st.st_size;
+    else if(ftruncate(fd, bytes) != 0)
+        goto out;
+    p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(p == MAP_FAILED)
+        goto out;
+    shm = p;
+    if(st.st_size == 0){
+        shm->version = SNAP_VERSION;
+        shm->size = bytes;
+        shm->brk = 0;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&shm->lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        heap_listp = 0;
+        if(mm_init() == -1)
+            goto out;
+        for(i = 0; i < 10; i++)
+            shm->roots[i] = ADDR2OF(*all_roots[i]);
+        shm->magic = SHM_MAGIC;
+    }
+    else if(shm->magic != SHM_MAGIC || shm->size != bytes){
+        munmap(p, bytes);
+        shm = 0;
+        goto out;
+    }
+    ret = 0;
+out:
+    flock(fd, LOCK_UN);
+    close(fd);                  /* the mapping keeps the file */
+    return ret;
+}
+
+void *mm_shared_malloc(size_t size){
+    void *p;
+    shm_lock();
+    p = mm_malloc(size);
+    shm_unlock();
+    return p;
+}
+
+void mm_shared_free(void *p){
+    if(p == NULL)
+        return;
+    shm_lock();
+    mm_free(p);
+    shm_unlock();
+}
+
+void *mm_shared_realloc(void *p, size_t size){
+    shm_lock();
+    p = mm_realloc(p, size);
+    shm_unlock();
+    return p;
+}
+
+/*
+ * mm_shared_offset/mm_shared_ptr - name an object the same way in every
+ *                                  process mapping the heap (0 : NULL)
+ */
+unsigned int mm_shared_offset(void *p){
+    return p ? (unsigned int)((char *)p - (char *)shm) : 0;
+}
+
+void *mm_shared_ptr(unsigned int off){
+    return off ? (char *)shm + off : NULL;
+}
+
+void mm_shared_set_root(void *p){
+    shm->app = mm_shared_offset(p);
+}
+
+void *mm_shared_get_root(void){
+    return mm_shared_ptr(shm->app);
+}
+
+/*
+ * snap_sum - FNV-1a over 64-bit words of the hashed part of the header
+ *            (sum taken as 0) and of brk bytes of heap
+ */
+static unsigned long long snap_sum(const struct shm_head *h, const char *heap){
+    struct shm_head c;
+    unsigned long long s = 0xcbf29ce484222325ULL, w;
+    size_t i, n = offsetof(struct shm_head, lock);
+
+    memcpy(&c, h, n);
+    c.sum = 0;
+    for(i = 0; i + 8 <= n; i += 8){
+        memcpy(&w, (char *)&c + i, 8);
+        s = (s ^ w) * 0x100000001b3ULL;
+    }
+    for(i = 0; i < h->brk; i += 8){
+        memcpy(&w, heap + i, 8);
+        s = (s ^ w) * 0x100000001b3ULL;
+    }
+    return s;
+}
+
+/*
+ * write_all - write n bytes, return -1 on error
+ */
+static int write_all(int fd, const char *p, size_t n){
+    ssize_t k;
+    while(n > 0){
+        if((k = write(fd, p, n)) < 0){
+            if(errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += k;
+        n -= k;
+    }
+    return 0;
+}
+
+/*
+ * mm_snapshot - save header page and heap to path (through path.tmp, so a
+ *               crash never leaves half a snapshot). Return -1 on error.
+ */
+int mm_snapshot(const char *path){
+    static char page[SHM_HEAD];
+    char tmp[4096];
+    struct shm_head *h = (struct shm_head *)page;
+    int fd, ret = -1;
+
+    if(snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+        return -1;
+    shm_lock();
+    memset(page, 0, SHM_HEAD);
+    memcpy(page, shm, offsetof(struct shm_head, lock));
+    h->magic = SNAP_MAGIC;
+    h->sum = snap_sum(h, (char *)shm + SHM_HEAD);
+    if((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600)) >= 0){
+        if(write_all(fd, page, SHM_HEAD) == 0 &&
+           write_all(fd, (char *)shm + SHM_HEAD, shm->brk) == 0 &&
+           fsync(fd) == 0)
+            ret = 0;
+        close(fd);
+        if(ret == 0 && rename(tmp, path) != 0)
+            ret = -1;
+        if(ret != 0)
+            unlink(tmp);
+    }
+    shm_unlock();
+    return ret;
+}
+
+/*
+ * mm_restore - replace the heap of this process by snapshot path, mapped
+ *              copy-on-write. Return -1 (heap untouched) on error.
+ */
+int mm_restore(const char *path){
+    struct shm_head h;
+    struct stat st;
+    char *p;
+    int fd;
+
+    if((fd = open(path, O_RDONLY)) < 0)
+        return -1;
+    if(fstat(fd, &st) != 0 || pread(fd, &h, sizeof(h), 0) != sizeof(h) ||
+       h.magic != SNAP_MAGIC || h.version != SNAP_VERSION ||
+       h.size > SHM_MAX || (size_t)st.st_size != SHM_HEAD + h.brk ||
+       SHM_HEAD + h.brk > h.size){
+        close(fd);
+        return -1;
+    }
+    /* room to grow, then the file over its start */
+    p = mmap(NULL, h.size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(p == MAP_FAILED || mmap(p, st.st_size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED){
+        if(p != MAP_FAILED)
+            munmap(p, h.size);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    if(snap_sum((struct shm_head *)p, p + SHM_HEAD) != h.sum){
+        munmap(p, h.size);
+        return -1;
+    }
+    if(shm)
+        munmap(shm, shm->size);
+    shm = (struct shm_head *)p;
+    shm->magic = SHM_MAGIC;
+    pthread_mutex_init(&shm->lock, NULL);
+    return 0;
+}
+#endif /* def SHARED */
@@ -0,0 +1,62 @@
+#!/bin/bash
+# <Eugene Yu Jun Hao 1900094810>
+# mmbench.sh - proxy of proxylab.tar.gz under load, glibc malloc against
+#              the PRELOAD build of malloclab.c
+#
+# Details:
+# 1. proxylab.tar.gz is unpacked in a temporary directory, proxy and tiny
+#    are built there, and libmm.so is built from malloclab.c.
+# 2. tiny serves the handout's files; the proxy runs once with glibc and
+#    once with LD_PRELOAD=libmm.so, each time taking REQS requests from
+#    CONC concurrent curl clients (a mix of small and large files).
+# 3. Reported per allocator: wall time, requests/s, failed requests and
+#    the proxy's peak RSS (VmHWM).
+# Usage: ./mmbench.sh [REQS] [CONC]        (default 2000 16)
+
+REQS=${1:-2000}
+CONC=${2:-16}
+TINY_PORT=$((20000 + RANDOM % 20000))
+PROXY_PORT=$((TINY_PORT + 1))
+SRC=$(cd "$(dirname "$0")" && pwd)
+DIR=$(mktemp -d)
+trap 'kill $TINY $PROXY 2>/dev/null; rm -rf "$DIR"' EXIT
+
+tar xzf "$SRC/proxylab.tar.gz" -C "$DIR" || exit 1
+cd "$DIR/proxylab-handout" || exit 1
+make -s -B proxy >/dev/null 2>&1 || { echo "proxy build failed"; exit 1; }
+(cd tiny && make -s -B tiny >/dev/null 2>&1) || { echo "tiny build failed"; exit 1; }
+gcc -O2 -shared -fPIC -DPRELOAD -o libmm.so "$SRC/malloclab.c" -lpthread \
+    || { echo "libmm.so build failed"; exit 1; }
+
+(cd tiny && exec ./tiny $TINY_PORT >/dev/null 2>&1) &
+TINY=$!
+sleep 0.5
+
+# one line per request: url through the proxy
+urls(){
+    local files=(home.html csapp.c tiny.c godzilla.gif godzilla.jpg)
+    for ((i = 0; i < REQS; i++)); do
+        echo "http://localhost:$TINY_PORT/${files[i % ${#files[@]}]}"
+    done
+}
+
+run(){
+    local name=$1 preload=$2 start end fail
+    LD_PRELOAD=$preload ./proxy $PROXY_PORT >/dev/null 2>&1 &
+    PROXY=$!
+    sleep 0.5
+    start=$(date +%s.%N)
+    fail=$(urls | xargs -P "$CONC" -n 1 curl -s -o /dev/null -m 10 \
+               -w '%{http_code}\n' --proxy "http://localhost:$PROXY_PORT" \
+           | grep -vc '^200$')
+    end=$(date +%s.%N)
+    awk -v n=$name -v t=$(awk -v a=$start -v b=$end 'BEGIN {print b - a}') \
+        -v r=$REQS -v f=$fail -v m=$(awk '/VmHWM/ {print $2}' /proc/$PROXY/status) \
+        'BEGIN {printf "%-8s %8.3fs %10.1f req/s %6d failed %8d KB peak RSS\n", n, t, r / t, f, m}'
+    kill $PROXY
+    wait $PROXY 2>/dev/null || true
+}
+
+echo "$REQS requests, $CONC clients"
+run glibc ""
+run libmm "$PWD/libmm.so"
@@ -0,0 +1,139 @@
+/*  <Eugene Yu Jun Hao 1900094810>
+ *  mmnew.cc - C++ operator new/delete on the PRELOAD build of malloclab.c
+ *  Details:
+ *  1. new goes to malloc / memalign of libmm.so, with the new_handler
+ *     loop and std::bad_alloc the standard asks for (nothrow forms
+ *     return NULL instead).
+ *  2. Sized delete (C++14) goes to mm_free_sized, plain delete to free.
+ *     Aligned blocks are ordinary blocks, so aligned delete needs nothing
+ *     of its own.
+ *  Build: gcc -O2 -fPIC -DPRELOAD -c malloclab.c &&
+ *         g++ -O2 -shared -fPIC -o libmm.so malloclab.o mmnew.cc -lpthread
+ */
+
+#include <cstddef>
+#include <new>
+
+extern "C" {
+void *malloc(std::size_t size);
+void *memalign(std::size_t align, std::size_t size);
+void free(void *p);
+void mm_free_sized(void *bp, std::size_t size);
+}
+
+/*
+ * alloc - block of size bytes aligned to align (0 : default), calling
+ *         the new_handler until it fits; NULL only if nothrow
+ */
+static void *alloc(std::size_t size, std::size_t align, bool nothrow){
+    void *p;
+
+    for(;;){
+        p = align ? memalign(align, size) : malloc(size);
+        if(p)
+            return p;
+        std::new_handler h = std::get_new_handler();
+        if(h == nullptr){
+            if(nothrow)
+                return nullptr;
+            throw std::bad_alloc();
+        }
+        h();
+    }
+}
+
+/*
+ * nothrow forms - a new_handler may still throw, which must not escape
+ */
+static void *alloc_nothrow(std::size_t size, std::size_t align) noexcept {
+    try{
+        return alloc(size, align, true);
+    }
+    catch(...){
+        return nullptr;
+    }
+}
+
+void *operator new(std::size_t size){
+    return alloc(size, 0, false);
+}
+
+void *operator new[](std::size_t size){
+    return alloc(size, 0, false);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return alloc_nothrow(size, 0);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return alloc_nothrow(size, 0);
+}
+
+void *operator new(std::size_t size, std::align_val_t align){
+    return alloc(size, static_cast<std::size_t>(align), false);
+}
+
+void *operator new[](std::size_t size, std::align_val_t align){
+    return alloc(size, static_cast<std::size_t>(align), false);
+}
+
+void *operator new(std::size_t size, std::align_val_t align,
+                   const std::nothrow_t &) noexcept {
+    return alloc_nothrow(size, static_cast<std::size_t>(align));
+}
+
+void *operator new[](std::size_t size, std::align_val_t align,
+                     const std::nothrow_t &) noexcept {
+    return alloc_nothrow(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, std::size_t size) noexcept {
+    mm_free_sized(p, size);
+}
+
+void operator delete[](void *p, std::size_t size) noexcept {
+    mm_free_sized(p, size);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, std::size_t size, std::align_val_t) noexcept {
+    mm_free_sized(p, size);
+}
+
+void operator delete[](void *p, std::size_t size, std::align_val_t) noexcept {
+    mm_free_sized(p, size);
+}
+
+void operator delete(void *p, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+    free(p);
+}
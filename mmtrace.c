@@ -0,0 +1,306 @@
+/*  <Eugene Yu Jun Hao 1900094810>
+ *  mmtrace.c - trace studies of malloclab.c: lifetime hints, wilderness
+ *              and heap growth
+ *  Details:
+ *  1. malloclab.c is included whole as the PRELOAD build, so the study
+ *     needs no handout memlib and can walk the heap and the regions.
+ *     Figures are for PRELOAD (16-byte alignment).
+ *  2. Every trace is generated from a fixed xorshift seed and runs in a
+ *     child process on a fresh heap (the child never returns to libc
+ *     memory allocated before the reset, and leaves with _exit).
+ *          life  - REQS requests, each 20~99 short objects (16~515 bytes)
+ *                  freed at its end; every 20th short object replaces one
+ *                  of 4000 long objects (32~2031 bytes), every 2000th is
+ *                  a permanent object (64~1063 bytes). Run unhinted and
+ *                  with mm_malloc_hint. The hints pay off only once the
+ *                  long objects have scattered over the heap: at 100000
+ *                  requests the hinted heap is 9% smaller (util 0.875
+ *                  against 0.800), at 20000 it is no smaller (0.854
+ *                  against 0.859).
+ *          mixed - OPS operations on 4000 slots: malloc an empty slot,
+ *                  else free it (3/4) or realloc it (1/4); sizes 1~200
+ *                  (60%), 1~4000 (25%), 4097~64096 (15%).
+ *          large - mixed with every size 4097~64096.
+ *  3. Reported: heap bytes, peak live bytes, utilization (peak / heap),
+ *     heap extensions, and the free blocks left in the main heap and in
+ *     the regions once the trace is idle.
+ *  4. -w dir also writes life.rep (no hints), mixed.rep and large.rep in
+ *     the mdriver trace format.
+ *  Build: gcc -O2 -DPRELOAD -o mmtrace mmtrace.c -lpthread
+ *  Usage: ./mmtrace [-w dir] [REQS] [OPS]        (default 100000 200000)
+ */
+
+#include "malloclab.c"
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <sys/wait.h>
+
+#define NL      4000    /* long objects of life */
+#define NSLOT   4000    /* slots of mixed and large */
+
+static unsigned long long rs;           /* xorshift state */
+static size_t live, peak;               /* bytes requested and alive */
+static int extends;                     /* heap extensions */
+static char *last_brk;
+
+/* mdriver trace being written, fd -1 : none */
+static int rep_fd = -1;
+static int rep_ids, rep_ops;
+static char rep_buf[1 << 16];
+static size_t rep_len;
+
+static unsigned long long rnd(void){
+    rs ^= rs << 13;
+    rs ^= rs >> 7;
+    rs ^= rs << 17;
+    return rs;
+}
+
+/*
+ * out - printf to fd without stdio, which would allocate
+ */
+static void out(int fd, const char *fmt, ...){
+    char line[256];
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if(write(fd, line, n) != n)
+        _exit(1);
+}
+
+/*=========================== MDRIVER TRACE ===========================*/
+static void rep_flush(void){
+    if(rep_len && write(rep_fd, rep_buf, rep_len) != (ssize_t)rep_len)
+        _exit(1);
+    rep_len = 0;
+}
+
+static void rep(const char *fmt, ...){
+    va_list ap;
+
+    if(rep_fd < 0)
+        return;
+    if(rep_len + 64 > sizeof(rep_buf))
+        rep_flush();
+    va_start(ap, fmt);
+    rep_len += vsnprintf(rep_buf + rep_len, 64, fmt, ap);
+    va_end(ap);
+    rep_ops++;
+}
+
+/*
+ * rep_open - trace file with a blank header, filled in by rep_close
+ */
+static void rep_open(const char *dir, const char *name){
+    char path[4096];
+
+    if(dir == NULL)
+        return;
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if((rep_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0){
+        out(2, "mmtrace: cannot write %s\n", path);
+        _exit(1);
+    }
+    memset(rep_buf, ' ', 4*16);
+    rep_buf[4*16 - 1] = '\n';
+    rep_len = 4*16;
+    rep_ids = rep_ops = 0;
+}
+
+static void rep_close(void){
+    char head[4*16 + 1];
+
+    if(rep_fd < 0)
+        return;
+    rep_flush();
+    snprintf(head, sizeof(head), "%-15zu\n%-15d\n%-15d\n%-15d\n",
+             peak, rep_ids, rep_ops, 1);
+    if(pwrite(rep_fd, head, 4*16, 0) != 4*16)
+        _exit(1);
+    close(rep_fd);
+    rep_fd = -1;
+}
+
+/*=========================== TRACE OPERATIONS ===========================*/
+/*
+ * fresh - give the whole heap back and start over
+ */
+static void fresh(void){
+    if(heap_listp)
+        mem_trim(mem_brk - mem_start);
+    heap_listp = 0;
+    mm_init();
+    live = peak = 0;
+    extends = 0;
+    last_brk = mem_brk;
+}
+
+static void tick(void){
+    if(mem_brk != last_brk)
+        extends++;
+    last_brk = mem_brk;
+    if(live > peak)
+        peak = live;
+}
+
+static void *t_malloc(size_t size, int hint, int *id){
+    void *p = hint ? mm_malloc_hint(size, hint) : mm_malloc(size);
+    *id = rep_ids++;
+    rep("a %d %zu\n", *id, size);
+    live += size;
+    tick();
+    return p;
+}
+
+static void t_free(void *p, size_t size, int id){
+    mm_free(p);
+    rep("f %d\n", id);
+    live -= size;
+}
+
+static void *t_realloc(void *p, size_t old, size_t size, int id){
+    p = mm_realloc(p, size);
+    rep("r %d %zu\n", id, size);
+    live += size - old;
+    tick();
+    return p;
+}
+
+/*
+ * report - one line for the trace, free blocks in the main heap and in
+ *          the regions
+ */
+static void report(const char *name){
+    char *bp;
+    size_t heap = mem_brk - mem_start, g;
+    int holes = 0, rholes = 0;
+
+    for(bp = NEXT_BLKP(heap_listp); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+        holes += !GET_ALLOC(HDRP(bp));
+    for(g = 0; nregion && g < sizeof(regstart) / sizeof(regstart[0]); g++){
+        if(regstart[g] == 0)
+            continue;
+        bp = (char *)(OF2ADDR(regstart[g])) + ALIGNMENT;
+        for(; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+            rholes += !GET_ALLOC(HDRP(bp));
+    }
+    out(1, "%-9s heap %10zu peak %10zu util %.3f extends %5d holes %5d"
+        " (regions %d, %d holes)\n", name, heap, peak, (double)peak / heap,
+        extends, holes, nregion, rholes);
+}
+
+/*=========================== TRACES ===========================*/
+static void life(int reqs, int hint){
+    static char *lng[NL];
+    static size_t lsz[NL];
+    static int lid[NL];
+    char *sh[100];
+    size_t ssz[100];
+    int sid[100], r, k, n, j, id;
+    size_t ps;
+
+    rs = 88172645463325252ULL;
+    for(r = 0; r < reqs; r++){
+        n = 20 + rnd() % 80;
+        for(k = 0; k < n; k++){
+            ssz[k] = 16 + rnd() % 500;
+            sh[k] = t_malloc(ssz[k], 0, &sid[k]);
+            if(rnd() % 20 == 0){
+                j = rnd() % NL;
+                if(lng[j])
+                    t_free(lng[j], lsz[j], lid[j]);
+                lsz[j] = 32 + rnd() % 2000;
+                lng[j] = t_malloc(lsz[j], hint ? LIFETIME_LONG : 0, &lid[j]);
+            }
+            if(rnd() % 2000 == 0){
+                ps = 64 + rnd() % 1000;
+                t_malloc(ps, hint ? LIFETIME_PERMANENT : 0, &id);
+            }
+        }
+        for(k = 0; k < n; k++)
+            t_free(sh[k], ssz[k], sid[k]);
+    }
+}
+
+static size_t rsize(int large){
+    unsigned int r = rnd() % 100;
+    if(large || r >= 85)
+        return 4097 + rnd() % 60000;
+    return r < 60 ? 1 + rnd() % 200 : 1 + rnd() % 4000;
+}
+
+static void mixed(int ops, int large){
+    static char *p[NSLOT];
+    static size_t sz[NSLOT];
+    static int pid[NSLOT];
+    size_t n;
+    int o, i;
+
+    rs = 88172645463325252ULL;
+    for(o = 0; o < ops; o++){
+        i = rnd() % NSLOT;
+        if(p[i] == NULL){
+            sz[i] = rsize(large);
+            p[i] = t_malloc(sz[i], 0, &pid[i]);
+        }
+        else if(rnd() % 4 == 0){
+            n = rsize(large);
+            p[i] = t_realloc(p[i], sz[i], n, pid[i]);
+            sz[i] = n;
+        }
+        else{
+            t_free(p[i], sz[i], pid[i]);
+            p[i] = NULL;
+        }
+    }
+}
+
+/*
+ * study - run one trace in a child on a fresh heap
+ */
+static void study(const char *name, const char *dir, int kind, int n){
+    pid_t pid = fork();
+    char file[64];
+
+    if(pid < 0){
+        out(2, "mmtrace: fork failed\n");
+        exit(1);
+    }
+    if(pid){
+        waitpid(pid, NULL, 0);
+        return;
+    }
+    fresh();
+    snprintf(file, sizeof(file), "%s.rep", kind == 0 ? "life" : name);
+    if(kind != 1)
+        rep_open(dir, file);
+    if(kind <= 1)
+        life(n, kind);
+    else
+        mixed(n, kind == 3);
+    rep_close();
+    report(name);
+    _exit(0);
+}
+
+int main(int argc, char **argv){
+    const char *dir = NULL;
+    int reqs, ops;
+
+    if(argc > 2 && strcmp(argv[1], "-w") == 0){
+        dir = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+    reqs = argc > 1 ? atoi(argv[1]) : 100000;
+    ops = argc > 2 ? atoi(argv[2]) : 200000;
+    study("unhinted", dir, 0, reqs);
+    study("hinted", dir, 1, reqs);
+    study("mixed", dir, 2, ops);
+    study("large", dir, 3, ops);
+    return 0;
+}
@@ -8,6 +8,7 @@
  *          quit: exit(0)
  *          jobs: listjobs() 
  *                  * Remember to redirect I/O *
+ *          jobs -m: compact, machine-readable listjobs()
  *          bg job: restart job and execute in bg by sending SIGCONT
  *          fg job: restart job and execute in fg by sending SIGCONT 
  *                  * Have to wait for other fg job to finish *  
@@ -15,7 +16,14 @@
  *                  * Have to check if job is in job_list *
  *          nohup [cmd]: Ignore SIGHUP for [command]
  *                  * assuming cmd is path of exe file followed by arguments *
- *      b)Other:
+ *      b)Job controls: [key=value ...] cmd
+ *          cpus=0,2-3: pin job to the listed CPUs
+ *          nice=N: run job with niceness N
+ *          sched=other|batch|idle: scheduling class of the job
+ *          as=KB, cputime=SECS, nofile=N: rlimits of the job
+ *                  * Applied in the child after io redirection, before
+ *                    execve; not allowed on builtins *
+ *      c)Other:
  *          assuming cmd is path of exe file followed by arguments
  *          * Block and unblock SIGNALs carefully *
  *          * Check if cmd runs in bg or fg *
@@ -28,6 +36,7 @@
  * 3. I/O redirection
  * ===========================================================================
  */
+#define _GNU_SOURCE
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -40,12 +49,17 @@
 #include <sys/wait.h>
 #include <errno.h>
 #include <stdarg.h>
+#include <sched.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 
 /* Misc manifest constants */
 #define MAXLINE    1024   /* max line size */
 #define MAXARGS     128   /* max args on a command line */
 #define MAXJOBS      16   /* max jobs at any point in time */
 #define MAXJID    1<<16   /* max job ID */
+#define MAXRLIMITS    3   /* max rlimits set by job controls */
+#define JOBLINE (MAXLINE+64)  /* max size of a listjobs line */
 
 /* Job states */
 #define UNDEF         0   /* undefined */
@@ -98,6 +112,19 @@ struct cmdline_tokens {
         BUILTIN_NOHUP} builtins;
 };
 
+struct job_limits {         /* Job controls applied before execve */
+    int setcpus;            /* if true, apply CPU affinity mask */
+    cpu_set_t cpus;         /* CPU affinity mask */
+    int setnice;            /* if true, apply niceness */
+    int nice;               /* niceness of the job */
+    int policy;             /* scheduling class, -1 to inherit */
+    int nrlimits;           /* number of rlimits to apply */
+    struct {
+        int resource;       /* RLIMIT_AS, RLIMIT_CPU or RLIMIT_NOFILE */
+        rlim_t value;       /* soft and hard limit */
+    } rlimits[MAXRLIMITS];
+};
+
 /* End global variables */
 
 /* Function prototypes */
@@ -120,7 +147,7 @@ pid_t fgpid(struct job_t *job_list);
 struct job_t *getjobpid(struct job_t *job_list, pid_t pid);
 struct job_t *getjobjid(struct job_t *job_list, int jid); 
 int pid2jid(pid_t pid); 
-void listjobs(struct job_t *job_list, int output_fd);
+void listjobs(struct job_t *job_list, int output_fd, int compact);
 
 void usage(void);
 void unix_error(char *msg);
@@ -129,6 +156,8 @@ ssize_t sio_puts(char s[]);
 ssize_t sio_putl(long v);
 ssize_t sio_put(const char *fmt, ...);
 void sio_error(char s[]);
+size_t sio_cat(char *s, const char *src);
+static void sio_ltoa(long v, char s[], int b);
 
 typedef void handler_t(int);
 handler_t *Signal(int signum, handler_t *handler);
@@ -141,6 +170,8 @@ void builtin_kill(struct cmdline_tokens tok);
 void builtin_nohup(struct cmdline_tokens tok);
 int builtin_cmd(struct cmdline_tokens tok);
 void io_redirection(struct cmdline_tokens tok);
+int parse_limits(struct cmdline_tokens *tok, struct job_limits *lim);
+void apply_limits(struct job_limits *lim);
 
 /*
  * main - The shell's main routine 
@@ -212,7 +243,6 @@ main(int argc, char **argv)
         eval(cmdline);
         
         fflush(stdout);
-        fflush(stdout);
     } 
     
     exit(0); /* control never reaches here */
@@ -234,6 +264,7 @@ eval(char *cmdline)
 {
     int bg;              /* should the job run in bg or fg? */
     struct cmdline_tokens tok;
+    struct job_limits lim;
     pid_t pid;
     sigset_t mask, prev_mask;
 
@@ -250,6 +281,8 @@ eval(char *cmdline)
         return;
     if(tok.argv[0] == NULL) /* ignore empty lines */
         return;
+    if(parse_limits(&tok, &lim) < 0) /* job control error */
+        return;
     if(!builtin_cmd(tok)){
         /* Block */
         sigprocmask(SIG_BLOCK, &mask, &prev_mask);
@@ -259,7 +292,8 @@ eval(char *cmdline)
             /* Unblock */ 
             sigprocmask(SIG_SETMASK, &prev_mask, NULL);
             setpgid(0,0);
-            io_redirection(tok);
+            io_redirection(tok);    /* before nofile= can forbid its open */
+            apply_limits(&lim);
             execve(tok.argv[0], tok.argv, environ);
         }
         /* Parent process */
@@ -667,46 +701,73 @@ pid2jid(pid_t pid)
     return 0;
 }
 
-/* listjobs - Print the job list */
+/* 
+ * listjobs - Print the job list
+ *   The whole report is built into one static buffer with the sio
+ *   helpers and written with a single write, so it is async-signal-safe.
+ *   compact: one "jid<TAB>pid<TAB>state<TAB>cmdline" line per job,
+ *            state is R (running), F (foreground) or S (stopped)
+ */
 void 
-listjobs(struct job_t *job_list, int output_fd) 
+listjobs(struct job_t *job_list, int output_fd, int compact) 
 {
+    static char buf[MAXJOBS * JOBLINE];
+    char num[128];
+    const char *state;
+    size_t len = 0;
+    ssize_t n;
     int i;
-    char buf[MAXLINE << 2];
 
     for (i = 0; i < MAXJOBS; i++) {
-        memset(buf, '\0', MAXLINE);
-        if (job_list[i].pid != 0) {
-            sprintf(buf, "[%d] (%d) ", job_list[i].jid, job_list[i].pid);
-            if(write(output_fd, buf, strlen(buf)) < 0) {
-                fprintf(stderr, "Error writing to output file\n");
-                exit(1);
-            }
-            memset(buf, '\0', MAXLINE);
-            switch (job_list[i].state) {
-            case BG:
-                sprintf(buf, "Running    ");
-                break;
-            case FG:
-                sprintf(buf, "Foreground ");
-                break;
-            case ST:
-                sprintf(buf, "Stopped    ");
-                break;
-            default:
-                sprintf(buf, "listjobs: Internal error: job[%d].state=%d ",
-                        i, job_list[i].state);
-            }
-            if(write(output_fd, buf, strlen(buf)) < 0) {
-                fprintf(stderr, "Error writing to output file\n");
-                exit(1);
-            }
-            memset(buf, '\0', MAXLINE);
-            sprintf(buf, "%s\n", job_list[i].cmdline);
-            if(write(output_fd, buf, strlen(buf)) < 0) {
-                fprintf(stderr, "Error writing to output file\n");
-                exit(1);
+        if (job_list[i].pid == 0)
+            continue;
+        switch (job_list[i].state) {
+        case BG:
+            state = compact ? "R" : "Running    ";
+            break;
+        case FG:
+            state = compact ? "F" : "Foreground ";
+            break;
+        case ST:
+            state = compact ? "S" : "Stopped    ";
+            break;
+        default:
+            state = NULL;
+        }
+        if (!compact)
+            len += sio_cat(buf + len, "[");
+        sio_ltoa(job_list[i].jid, num, 10);
+        len += sio_cat(buf + len, num);
+        len += sio_cat(buf + len, compact ? "\t" : "] (");
+        sio_ltoa(job_list[i].pid, num, 10);
+        len += sio_cat(buf + len, num);
+        len += sio_cat(buf + len, compact ? "\t" : ") ");
+        if (state != NULL) {
+            len += sio_cat(buf + len, state);
+        } else {
+            len += sio_cat(buf + len, "listjobs: Internal error: job[");
+            sio_ltoa(i, num, 10);
+            len += sio_cat(buf + len, num);
+            len += sio_cat(buf + len, "].state=");
+            sio_ltoa(job_list[i].state, num, 10);
+            len += sio_cat(buf + len, num);
+            len += sio_cat(buf + len, " ");
+        }
+        if (compact)
+            len += sio_cat(buf + len, "\t");
+        len += sio_cat(buf + len, job_list[i].cmdline);
+        len += sio_cat(buf + len, "\n");
+    }
+
+    /* Write out the report, resuming after short writes */
+    for (i = 0; (size_t)i < len; i += n) {
+        if ((n = write(output_fd, buf + i, len - i)) < 0) {
+            if (errno == EINTR) {
+                n = 0;
+                continue;
             }
+            fprintf(stderr, "Error writing to output file\n");
+            exit(1);
         }
     }
 }
@@ -797,6 +858,15 @@ void sio_copy(char *s, const char *fmt, size_t len)
         s[i] = fmt[i];
 }
 
+/* sio_cat - Copy string src to s, return its length */
+size_t sio_cat(char *s, const char *src)
+{
+    size_t len = sio_strlen(src);
+
+    sio_copy(s, src, len);
+    return len;
+}
+
 /* Public Sio functions */
 ssize_t sio_puts(char s[]) /* Put string */
 {
@@ -1007,18 +1077,20 @@ void builtin_nohup(struct cmdline_tokens tok){
 */ 
 int builtin_cmd(struct cmdline_tokens tok){
     int x = tok.builtins;
-    int fd;
+    int fd, compact;
     switch(x){
         case 1: /* quit */
             exit(0);
         case 2: /* jobs */
+            compact = tok.argv[1] != NULL && !strcmp(tok.argv[1], "-m");
             if(tok.outfile == NULL){
-                listjobs(job_list, STDOUT_FILENO);
+                listjobs(job_list, STDOUT_FILENO, compact);
             }
             else{
                 fd = open(tok.outfile, O_RDWR|O_CREAT|O_APPEND,
                     S_IROTH|S_IWOTH|S_IXOTH);
-                listjobs(job_list, fd);
+                listjobs(job_list, fd, compact);
+                close(fd);
             }
             return 1;
         case 3: /* bg */
@@ -1060,3 +1132,136 @@ void io_redirection(struct cmdline_tokens tok){
     }
     return;
 }
+
+/*
+ * parse_limits - strip leading key=value job controls from argv
+ * Returns the number of controls consumed, or -1 if one is malformed
+ * or the command is a builtin (it would run in the shell itself)
+*/
+int parse_limits(struct cmdline_tokens *tok, struct job_limits *lim){
+    static const char *builtin_names[] = {
+        "quit", "jobs", "bg", "fg", "kill", "nohup", NULL
+    };
+    char *arg, *val, *end;
+    long lo, hi, n;
+    int i, cnt = 0;
+
+    lim->setcpus = 0;
+    lim->setnice = 0;
+    lim->policy = -1;
+    lim->nrlimits = 0;
+    CPU_ZERO(&lim->cpus);
+
+    while((arg = tok->argv[cnt]) != NULL && (val = strchr(arg, '=')) != NULL){
+        val++;
+        /* cpus=0,2-3 */
+        if(!strncmp(arg, "cpus=", 5)){
+            do{
+                lo = hi = strtol(val, &end, 10);
+                if(end == val || lo < 0)
+                    goto bad;
+                if(*end == '-'){
+                    val = end + 1;
+                    hi = strtol(val, &end, 10);
+                    if(end == val || hi < lo)
+                        goto bad;
+                }
+                if(hi >= CPU_SETSIZE)
+                    goto bad;
+                for(n = lo; n <= hi; n++)
+                    CPU_SET(n, &lim->cpus);
+                val = end + 1;
+            } while(*end == ',');
+            if(*end != '\0')
+                goto bad;
+            lim->setcpus = 1;
+        }
+        /* nice=N */
+        else if(!strncmp(arg, "nice=", 5)){
+            lim->nice = strtol(val, &end, 10);
+            if(end == val || *end != '\0')
+                goto bad;
+            lim->setnice = 1;
+        }
+        /* sched=other|batch|idle */
+        else if(!strncmp(arg, "sched=", 6)){
+            if(!strcmp(val, "other"))
+                lim->policy = SCHED_OTHER;
+            else if(!strcmp(val, "batch"))
+                lim->policy = SCHED_BATCH;
+            else if(!strcmp(val, "idle"))
+                lim->policy = SCHED_IDLE;
+            else
+                goto bad;
+        }
+        /* as=KB, cputime=SECS, nofile=N */
+        else{
+            if(!strncmp(arg, "as=", 3))
+                i = RLIMIT_AS;
+            else if(!strncmp(arg, "cputime=", 8))
+                i = RLIMIT_CPU;
+            else if(!strncmp(arg, "nofile=", 7))
+                i = RLIMIT_NOFILE;
+            else
+                break; /* not a job control, e.g. an argument of cmd */
+            n = strtol(val, &end, 10);
+            if(end == val || *end != '\0' || n < 0
+                || lim->nrlimits >= MAXRLIMITS)
+                goto bad;
+            lim->rlimits[lim->nrlimits].resource = i;
+            lim->rlimits[lim->nrlimits].value =
+                (i == RLIMIT_AS) ? (rlim_t)n << 10 : (rlim_t)n;
+            lim->nrlimits++;
+        }
+        cnt++;
+    }
+
+    /* Shift the command to the front of argv */
+    if(cnt > 0){
+        for(i = cnt; i <= tok->argc; i++)
+            tok->argv[i - cnt] = tok->argv[i];
+        tok->argc -= cnt;
+        if(tok->argv[0] == NULL){
+            fprintf(stderr, "Error: job controls without command\n");
+            return -1;
+        }
+        for(i = 0; builtin_names[i] != NULL; i++){
+            if(!strcmp(tok->argv[0], builtin_names[i])){
+                fprintf(stderr, "Error: job controls on builtin %s\n",
+                    tok->argv[0]);
+                return -1;
+            }
+        }
+    }
+    return cnt;
+
+bad:
+    fprintf(stderr, "Error: bad job control %s\n", arg);
+    return -1;
+}
+
+/*
+ * apply_limits - apply job controls to the calling (child) process
+ * Must be called between fork and execve
+*/
+void apply_limits(struct job_limits *lim){
+    struct sched_param param;
+    struct rlimit rl;
+    int i;
+
+    if(lim->setcpus && sched_setaffinity(0, sizeof(cpu_set_t), &lim->cpus) < 0)
+        unix_error("sched_setaffinity error");
+    if(lim->policy >= 0){
+        param.sched_priority = 0;
+        if(sched_setscheduler(0, lim->policy, &param) < 0)
+            unix_error("sched_setscheduler error");
+    }
+    if(lim->setnice && setpriority(PRIO_PROCESS, 0, lim->nice) < 0)
+        unix_error("setpriority error");
+    for(i = 0; i < lim->nrlimits; i++){
+        rl.rlim_cur = rl.rlim_max = lim->rlimits[i].value;
+        if(setrlimit(lim->rlimits[i].resource, &rl) < 0)
+            unix_error("setrlimit error");
+    }
+    return;
+}
@@ -0,0 +1,3358 @@
+/*
+ * <Eugene Yu Jun Hao 1900094810>
+ * y86sim.c - Y86-64 simulator for the Arch Lab programs, with a profile
+ *            of the cycles the PIPE processor of pipe-full.hcl loses
+ *
+ * Details:
+ * 1. Input - a .ys file is assembled here (the part of yas the lab
+ *    programs use: labels, .pos, .align, .byte/.word/.long/.quad and
+ *    every instruction including iaddq); a .yo file is loaded from its
+ *    address: bytes columns. With -n len the file is ncopy.ys, wrapped
+ *    in the driver of gen-driver.pl for a src block of len words, and
+ *    the count and the copy are checked after the run.
+ * 2. SEQ (-s) - one instruction per step, the semantics of
+ *    seq-full.hcl for the instructions PIPE has (not jm). The excepting
+ *    instruction changes no state.
+ * 3. PIPE (default) - the pipeline registers and control logic of
+ *    pipe-full.hcl translated signal by signal: f_pc and f_predPC,
+ *    forwarding into d_valA/d_valB, set_cc, and the stall and bubble
+ *    conditions of the pipeline register control section. Stages are
+ *    evaluated from the current registers, then every register, the
+ *    register file, memory and CC are clocked together.
+ * 4. Profile (-p) - a bubble carries the cause that injected it and the
+ *    PC of the instruction responsible:
+ *        load/use    E_bubble, the mrmovq/popq whose dstM decode reads
+ *        mispredict  D_bubble and E_bubble, the jXX not taken
+ *        ret         D_bubble while a ret is in D, E or M, the ret
+ *        drain       M_bubble behind an exception, the excepting one
+ *        fill        the empty pipeline after reset
+ *        icache      D_bubble while F waits for an I-cache miss, its PC
+ *        dcache      W_bubble while M waits for a D-cache miss, its PC
+ *    Every cycle W holds either an instruction, which retires, or a
+ *    bubble, which is a lost cycle of its cause, so cycles equal
+ *    instructions plus lost cycles exactly. The hotspot table lists
+ *    instructions by the cycles lost to them.
+ * 5. Benchmark (-b) - the CPE of ncopy.ys over lengths 1..64 as
+ *    benchmark.pl computes it: the mean of cycles / len.
+ * 6. Predictors (-P name, -r) - f_predPC of a conditional jump comes from
+ *        taken      always taken, pipe-full.hcl
+ *        btfnt      backward taken, forward not taken
+ *        bimodal    2-bit counters in a 256-entry BTB; the target is in
+ *                   the instruction, so an entry is a tag and a counter,
+ *                   and a miss predicts not taken
+ *        gshare     4096 2-bit counters indexed by PC xor 12 bits of
+ *                   global history
+ *    Counters and history train when the jump leaves E. A mispredicted
+ *    jump in M selects its other target for f_pc, so a jump the
+ *    predictor takes wrongly costs the same 2 cycles as one it falls
+ *    through wrongly. With -r a 16-entry return address stack predicts
+ *    ret at fetch instead of stalling F; a wrong ret is found when valM
+ *    is read in M, the 3 instructions behind it are squashed and W_valM
+ *    is fetched, the 3 cycles every ret costs without it. The stack top
+ *    travels with each instruction and is restored on a squash. -p adds
+ *    the mispredict rate of every jXX and ret.
+ * 7. Load forwarding (-f) - pipe-full.hcl stalls a store whose data
+ *    register a load in E writes, though the data is not needed until M.
+ *    With -f srcA travels to M and the memory stage takes its data from
+ *    the load now in W:
+ *        word m_data = [
+ *            M_icode in { IRMMOVQ, IPUSHQ } && M_srcA == W_dstM : W_valM;
+ *            1 : M_valA;
+ *        ];
+ *    and the load/use condition no longer counts d_srcA of rmmovq and
+ *    pushq. A load feeding the address (srcB) of a store still stalls.
+ *    With -b the CPE of pipe-full.hcl is printed next to that with -f.
+ * 8. Fast mode (-t) - the ISA alone, for long runs. Each instruction is
+ *    decoded once into icache[PC] (the handler address, operands, valC,
+ *    valP) and handlers end in a computed goto to the next one. A store
+ *    into decoded bytes sends the instructions it may overlap back to
+ *    decode, so self-modifying code runs as on SEQ. The state and the
+ *    instruction count are those of SEQ.
+ * 9. JIT (-j) - on x86-64 a block entered JIT_HOT times is translated to
+ *    native code, up to a control transfer or 64 instructions. The Y86
+ *    registers are slots of a context at %r15 (15 of them do not fit
+ *    in the 16 of x86-64 with room for the base registers), memory is at
+ *    %r14. ALU ops and iaddq run as the same x86 op, whose ZF, SF and
+ *    OF are exactly Y86's, saved with lahf/seto and restored with sahf
+ *    for jXX and cmovXX. Exits to a constant PC are patched into a
+ *    direct jump to the target block once it exists; ret looks up the
+ *    block of its target in a table. Each store compares the 8 bytes
+ *    of a map of translated code under it and leaves the block if any
+ *    are set, and the translations are then all dropped. A block first
+ *    takes its length from an instruction budget so -l stays exact;
+ *    halt, faults and invalid codes run on seq_step. Elsewhere, or
+ *    without executable memory, -j runs -t.
+ * 10. Check (-c) - run SEQ, PIPE, the fast mode and the JIT from the same state,
+ *    print the instructions and speed of each and whether status, PC,
+ *    CC, registers, memory and instruction count all agree. Only runs
+ *    that stop by themselves compare (-l counts cycles on PIPE), and PIPE,
+ *    as pipe-full.hcl, fetches past a store into the code that follows.
+ * 11. Out-of-order model (-o width,rob,rs) - a superscalar timing model
+ *    that runs the instructions on SEQ as it fetches them, so the
+ *    state is SEQ's (with -l, that of the last instruction fetched):
+ *        fetch     width instructions a cycle into a queue, up to a
+ *                  taken jump, call or ret; behind a mispredicted jXX
+ *                  (or any ret without -r) fetch waits until it issues
+ *        dispatch  a cycle later, width a cycle: sources are renamed
+ *                  to the ROB slots producing them (CC is renamed too)
+ *                  and the instruction takes a ROB entry and a
+ *                  reservation station, or dispatch stalls
+ *        issue     the oldest width ready instructions, at most one
+ *                  per two of width to memory; ALU results in 1 cycle,
+ *                  loads in 2, and a load waits for the youngest older
+ *                  store it overlaps (addresses are known exactly)
+ *        commit    width completed instructions a cycle, in order
+ *    The IPC and the cycles dispatch and fetch stall are printed; -P
+ *    and -r choose the predictor, -p prints its rates, and with -b the
+ *    CPE is that of the model.
+ * 12. Caches (-I size,ways,block,penalty and -D ...) - imem and dmem are
+ *    perfect without them. A cache is set associative with LRU, write
+ *    back and write allocate; a miss fills the block penalty cycles later
+ *    and writebacks go to a buffer that costs nothing. On PIPE an
+ *    I-cache miss stalls F and bubbles D, and a D-cache miss holds M and
+ *    every stage behind it while W drains into bubbles; both are causes
+ *    of lost cycles in -p. On the out-of-order model a miss stalls fetch
+ *    or adds to the latency of a load. The accesses and misses of each
+ *    cache are printed after the run. An access fills all its blocks at
+ *    once, so a cache needs two lines at least and I-cache blocks of 16
+ *    bytes (an instruction then spans two blocks at most); otherwise a
+ *    fill would evict the block it is waiting with and never finish.
+ * 13. Generator (-g) - write ncopy variants, score each in the driver
+ *    of -n over lengths 0..64 on the processor the other options
+ *    configure (PIPE or -o, -f, -P, -r, caches), and write the one of
+ *    best CPE to file. A variant is
+ *        unroll    1..16 elements per iteration, 10 registers reused
+ *        schedule  batch (all loads, stores, then tests from the last),
+ *                  pair (two loads, then store and test each) or
+ *                  stream (each load one element ahead)
+ *        tail      search (a binary search over the length left),
+ *                  table (a jump table through pushq and ret), linear
+ *                  (a test per length), each entering a chain that falls
+ *                  through element by element, or loop (one element)
+ *        order     in the chain, test or store first after the load
+ *    Every variant is checked on every length, and one over 1000 bytes,
+ *    the limit of check-len.pl, is not kept. The ten best are printed.
+ * 14. Differential test (-z cases) - random programs, one per case
+ *    number, run on SEQ and, when SEQ halts or faults within 4000 steps
+ *    without storing into its code, on PIPE, the fast mode and the JIT,
+ *    whose status, PC, CC, registers, memory and instruction count must
+ *    all agree with SEQ's. Programs mix every instruction with edge
+ *    values, loads and stores around %rbp and %rsp, short backward loops,
+ *    calls, rets and invalid codes, and each case draws the PIPE options
+ *    (predictor, RAS, -f, caches) at random. Cases are spread over a
+ *    forked worker per core. The first failures of each are minimized,
+ *    dropping instructions while the case still fails, and written to
+ *    file-<worker>-<k>.ys with their options.
+ *
+ * Usage: y86sim [-s | -t | -j | -c | -o w[,rob[,rs]]] [-p] [-P predictor] [-r] [-f]
+ *               [-I cache] [-D cache] [-l maxcycles] [-n len | -b | -g | -z cases]
+ *               file.ys|file.yo
+ * Build: gcc -O2 -o y86sim y86sim.c
+ */
+
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+/* Misc manifest constants */
+#define MEMSIZE     (1 << 13)   /* bytes of memory, as yis and psim */
+#define MAXLINE     1024        /* max line of a source file */
+#define MAXLABELS   1024        /* max labels of a program */
+#define MAXLABEL    64          /* max length of a label */
+#define MAXCYCLES   100000000   /* default cycle (step) limit */
+#define BENCHMAX    64          /* longest ncopy block of -b */
+
+/* Instruction codes */
+#define I_HALT      0x0
+#define I_NOP       0x1
+#define I_RRMOVQ    0x2
+#define I_IRMOVQ    0x3
+#define I_RMMOVQ    0x4
+#define I_MRMOVQ    0x5
+#define I_ALU       0x6
+#define I_JMP       0x7
+#define I_CALL      0x8
+#define I_RET       0x9
+#define I_PUSHQ     0xA
+#define I_POPQ      0xB
+#define I_IADDQ     0xC
+
+/* Function codes */
+#define F_NONE      0
+#define A_ADD       0
+#define A_SUB       1
+#define A_AND       2
+#define A_XOR       3
+#define C_YES       0
+#define C_LE        1
+#define C_L         2
+#define C_E         3
+#define C_NE        4
+#define C_GE        5
+#define C_G         6
+
+/* Registers */
+#define REG_RSP     4
+#define REG_NONE    0xF
+
+/* Status */
+#define STAT_BUB    0           /* bubble in stage */
+#define STAT_AOK    1           /* normal execution */
+#define STAT_HLT    2           /* halt instruction encountered */
+#define STAT_ADR    3           /* invalid memory address */
+#define STAT_INS    4           /* invalid instruction */
+
+/* Condition codes */
+#define CC_ZF       4
+#define CC_SF       2
+#define CC_OF       1
+#define DEFAULT_CC  CC_ZF
+
+/* Causes of lost cycles */
+#define LOST_FILL       0
+#define LOST_LOADUSE    1
+#define LOST_MISPREDICT 2
+#define LOST_RET        3
+#define LOST_DRAIN      4
+#define LOST_ICACHE     5
+#define LOST_DCACHE     6
+#define NLOST           7
+
+/* Branch predictors */
+#define PRED_TAKEN      0       /* always taken */
+#define PRED_BTFNT      1       /* backward taken, forward not taken */
+#define PRED_BIMODAL    2       /* 2-bit counters in a BTB */
+#define PRED_GSHARE     3       /* 2-bit counters by PC xor history */
+#define NPRED           4
+#define BTBSIZE         256     /* entries of the BTB */
+#define HISTBITS        12      /* global history of gshare */
+#define RASSIZE         16      /* entries of the return address stack */
+
+/* Caches */
+#define MAXLINES        (MEMSIZE / 8)   /* lines of a cache, at 8-byte blocks */
+
+/* Out-of-order model */
+#define OOO_MAXWIDTH    64      /* widest fetch, issue and commit */
+#define OOO_MAXROB      256     /* largest ROB, and fetch queue */
+
+#define EXCEPTION(stat) ((stat) == STAT_HLT || (stat) == STAT_ADR || (stat) == STAT_INS)
+
+/* Architectural state */
+struct state {
+    uint64_t reg[16];               /* reg[REG_NONE] is never written */
+    unsigned char mem[MEMSIZE];
+    int cc;
+    uint64_t pc;
+};
+
+/* A fetched instruction */
+struct instr {
+    int icode, ifun, rA, rB;
+    uint64_t valC, valP;
+};
+
+/*
+ * A pipeline register (D, E, M or W): the union of the fields of the
+ * four, plus the PC of the instruction and, for a bubble, its cause
+ */
+struct preg {
+    int stat, icode, ifun, rA, rB, srcA, srcB, dstE, dstM, Cnd;
+    uint64_t valC, valP, valA, valB, valE, valM, pc;
+    int cause;                      /* LOST_*, for a bubble */
+    uint64_t cpc;                   /* PC responsible, for a bubble */
+    uint64_t predPC;                /* next PC predicted at fetch */
+    int pidx;                       /* predictor entry of a jXX */
+    int ras;                        /* RAS top after fetch */
+};
+
+/* Counts of the profile, per PC */
+struct prof {
+    uint64_t exec;                  /* times retired */
+    uint64_t lost[NLOST];           /* cycles lost, by cause */
+    uint64_t branch, taken, miss;   /* jXX/ret resolved, taken, mispredicted */
+};
+
+/* Entry of the BTB */
+struct btb {
+    uint64_t tag;
+    int valid;
+    int ctr;                        /* 2-bit counter, taken if >= 2 */
+};
+
+/* A cache line; tag is the block number, the whole address / block */
+struct cline {
+    uint64_t tag;
+    int valid, dirty;
+    long ready;                     /* cycle its fill completes */
+    long used;                      /* cycle last accessed, for LRU */
+};
+
+/* A cache: set associative, LRU, write-back and write-allocate */
+struct cache {
+    int size, ways, block, penalty; /* bytes, ways, bytes, miss cycles */
+    int sets;                       /* 0: no cache, memory is perfect */
+    uint64_t access, miss, writeback;
+    struct cline line[MAXLINES];    /* set s is line[s * ways ..] */
+};
+
+/* Label of the assembler */
+struct label {
+    char name[MAXLABEL];
+    uint64_t addr;
+};
+
+/* Global variables */
+static struct state st;             /* state being simulated */
+static struct state init;           /* state after loading */
+static struct prof prof[MEMSIZE];   /* profile, by PC */
+static uint64_t lost[NLOST];        /* lost cycles, by cause */
+static struct label labels[MAXLABELS];
+static int nlabels;
+static long maxcycles = MAXCYCLES;
+static int verbose = 1;             /* print the final state */
+static int load_fwd;                /* forward W_valM to the data of a store */
+static int predictor = PRED_TAKEN;
+static int use_ras;                 /* predict ret from a RAS */
+static struct btb btb[BTBSIZE];
+static unsigned char pht[1 << HISTBITS];
+static unsigned ghr;                /* global history, newest in bit 0 */
+static uint64_t ras[RASSIZE];
+static int ras_top;                 /* pushes minus pops, mod RASSIZE */
+static struct cache l1i, l1d;       /* -I and -D */
+static int ooo;                     /* -o: the out-of-order model */
+static int ooo_width = 4, ooo_rob = 64, ooo_rs = 32;
+
+static const char *reg_names[16] = {
+    "%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi",
+    "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "----"
+};
+static const char *stat_names[5] = { "BUB", "AOK", "HLT", "ADR", "INS" };
+static const char *lost_names[NLOST] = {
+    "fill", "load/use", "mispredict", "ret", "drain", "icache", "dcache"
+};
+static const char *pred_names[NPRED] = { "taken", "btfnt", "bimodal", "gshare" };
+
+/* Function prototypes */
+static void usage(char *argv0);
+static int load_file(const char *file, int len);
+static int load_ncopy(const char *text, int len);
+static int assemble(const char *text);
+static int load_yo(const char *text);
+static int fetch(const struct state *s, uint64_t pc, struct instr *in);
+static int cond(int cc, int ifun);
+static uint64_t alu(int ifun, uint64_t a, uint64_t b);
+static int alu_cc(int ifun, uint64_t a, uint64_t b, uint64_t r);
+static int seq_step(struct state *s);
+static int run_seq(long *steps);
+static int cache_config(struct cache *c, const char *spec);
+static int run_pipe(long *cycles, long *instrs);
+static int run_ooo(long *cycles, long *instrs);
+static int run_fast(long *steps);
+static int run_jit(long *steps);
+static int compare(void);
+static void print_state(void);
+static void print_profile(long cycles, long instrs);
+static void print_branches(void);
+static void print_ooo(void);
+static void print_caches(void);
+static int check_ncopy(int len);
+static void benchmark(const char *file);
+static void generate(const char *file);
+static void fuzz(long cases, const char *prefix);
+static int disasm(const struct state *s, uint64_t pc, char *buf);
+
+/*
+ * main - assemble or load the program, run it, report
+ */
+int main(int argc, char **argv){
+    int c, seq = 0, fast = 0, jit = 0, check = 0, profile = 0, len = -1, bench = 0, stat;
+    int gen_best = 0;
+    long fuzz_cases = 0;
+    long cycles, instrs = 0;
+
+    while((c = getopt(argc, argv, "hstjco:pP:rfI:D:l:n:bgz:")) != EOF){
+        switch(c){
+            case 's': seq = 1; break;
+            case 't': fast = 1; break;
+            case 'j': jit = 1; break;
+            case 'c': check = 1; break;
+            case 'o':
+                ooo = 1;
+                sscanf(optarg, "%d,%d,%d", &ooo_width, &ooo_rob, &ooo_rs);
+                if(ooo_width < 1 || ooo_width > OOO_MAXWIDTH || ooo_rob < 1
+                   || ooo_rob > OOO_MAXROB || ooo_rs < 1)
+                    usage(argv[0]);
+                break;
+            case 'p': profile = 1; break;
+            case 'P':
+                for(predictor = 0; predictor < NPRED; predictor++)
+                    if(strcmp(optarg, pred_names[predictor]) == 0)
+                        break;
+                if(predictor == NPRED)
+                    usage(argv[0]);
+                break;
+            case 'r': use_ras = 1; break;
+            case 'f': load_fwd = 1; break;
+            case 'I':
+            case 'D':
+                if(!cache_config(c == 'I' ? &l1i : &l1d, optarg))
+                    usage(argv[0]);
+                break;
+            case 'l': maxcycles = atol(optarg); break;
+            case 'n': len = atoi(optarg); break;
+            case 'b': bench = 1; break;
+            case 'g': gen_best = 1; break;
+            case 'z': fuzz_cases = atol(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if(optind != argc - 1)
+        usage(argv[0]);
+    if(bench){
+        benchmark(argv[optind]);
+        return 0;
+    }
+    if(gen_best){
+        generate(argv[optind]);
+        return 0;
+    }
+    if(fuzz_cases > 0){
+        fuzz(fuzz_cases, argv[optind]);
+        return 0;
+    }
+    if(load_file(argv[optind], len) < 0)
+        return 1;
+
+    if(check){
+        stat = compare();
+        if(len >= 0)
+            stat = check_ncopy(len) && stat;
+        return stat ? 0 : 1;
+    }
+    if(seq || fast || jit){
+        stat = seq ? run_seq(&instrs) : fast ? run_fast(&instrs) : run_jit(&instrs);
+        printf("Stopped in %ld steps at PC = 0x%llx.  Status '%s', CC Z=%d S=%d O=%d\n",
+            instrs, (unsigned long long)st.pc, stat_names[stat],
+            !!(st.cc & CC_ZF), !!(st.cc & CC_SF), !!(st.cc & CC_OF));
+    }
+    else{
+        stat = ooo ? run_ooo(&cycles, &instrs) : run_pipe(&cycles, &instrs);
+        printf("Stopped after %ld cycles, %ld instructions (%s %.2f) at PC = 0x%llx.  "
+            "Status '%s', CC Z=%d S=%d O=%d\n", cycles, instrs, ooo ? "IPC" : "CPI",
+            ooo ? (cycles ? (double)instrs / cycles : 0.0) : instrs ? (double)cycles / instrs : 0.0,
+            (unsigned long long)st.pc, stat_names[stat],
+            !!(st.cc & CC_ZF), !!(st.cc & CC_SF), !!(st.cc & CC_OF));
+    }
+    if(verbose)
+        print_state();
+    if(ooo && !seq && !fast && !jit)
+        print_ooo();
+    if(!seq && !fast && !jit)
+        print_caches();
+    if(profile && !seq && !fast && !jit)
+        ooo ? print_branches() : print_profile(cycles, instrs);
+    if(len >= 0)
+        return check_ncopy(len) ? 0 : 1;
+    return 0;
+}
+
+/*
+ * usage - print a help message
+ */
+static void usage(char *argv0){
+    printf("Usage: %s [-s | -t | -j | -c | -o w[,rob[,rs]]] [-p] [-P predictor] [-r] [-f] "
+        "[-I cache] [-D cache] [-l maxcycles] [-n len | -b | -g | -z cases] file.ys|file.yo\n",
+        argv0);
+    printf("   -s          run SEQ (one instruction per step) instead of PIPE\n");
+    printf("   -t          run the fast predecoded mode instead of PIPE\n");
+    printf("   -j          run hot blocks translated to x86-64 instead of PIPE\n");
+    printf("   -c          run SEQ, PIPE, -t and -j and compare their final states\n");
+    printf("   -o w,rob,rs run the out-of-order model: width, ROB and RS entries (4,64,32)\n");
+    printf("   -p          print the lost cycles of PIPE by cause and instruction\n");
+    printf("   -P name     predict jXX by taken (default), btfnt, bimodal or gshare\n");
+    printf("   -r          predict ret with a return address stack\n");
+    printf("   -f          forward a load in W to the data of a store in M\n");
+    printf("   -I cache    I-cache of size[,ways[,block[,penalty]]] (1,16,10),\n");
+    printf("               at least 2 lines, block at least 16\n");
+    printf("   -D cache    D-cache of size[,ways[,block[,penalty]]], at least 2 lines\n");
+    printf("   -l N        stop after N cycles (steps)\n");
+    printf("   -n len      file is ncopy.ys, run it on a block of len words\n");
+    printf("   -b          file is ncopy.ys, print its CPE for lengths 1..%d\n", BENCHMAX);
+    printf("   -g          write the ncopy generated with the best CPE to file\n");
+    printf("   -z cases    test random programs on all cores, failures to file-*.ys\n");
+    exit(1);
+}
+
+/*=========================== LOADING ===========================*/
+
+/*
+ * ncopy_driver - write into buf the driver of gen-driver.pl around the
+ *                ncopy function src, for a block of len words
+ * The words are 1..len, every third one negated.
+ */
+static char *ncopy_driver(const char *src, int len){
+    size_t n = strlen(src) + 128 * (size_t)len + 2048;
+    char *buf = malloc(n), *p = buf;
+    int i;
+
+    if(buf == NULL)
+        return NULL;
+    p += sprintf(p,
+        "\t.pos 0\n"
+        "main:\tirmovq Stack, %%rsp\n"
+        "\tirmovq $%d, %%rdx\n"
+        "\tirmovq dest, %%rsi\n"
+        "\tirmovq src, %%rdi\n"
+        "\tcall ncopy\n"
+        "\thalt\n"
+        "StartFun:\n", len);
+    strcpy(p, src);
+    p += strlen(p);
+    p += sprintf(p, "\nEndFun:\n\t.align 8\nsrc:\n");
+    for(i = 1; i <= len; i++)
+        p += sprintf(p, "\t.quad %d\n", i % 3 == 0 ? -i : i);
+    p += sprintf(p, "\t.quad 0xbcdefa\n\t.align 16\nPredest:\n\t.quad 0xbcdefa\ndest:\n");
+    for(i = 1; i <= len; i++)
+        p += sprintf(p, "\t.quad 0xcdefab\n");
+    p += sprintf(p, "Postdest:\n\t.quad 0xdefabc\n\t.align 8\n");
+    for(i = 0; i < 8; i++)
+        p += sprintf(p, "\t.quad 0\n");
+    sprintf(p, "Stack:\n");
+    return buf;
+}
+
+/*
+ * load_file - assemble (.ys) or load (.yo) file into st and init, wrapped
+ *             in the ncopy driver when len >= 0; return 0 or -1
+ */
+static int load_file(const char *file, int len){
+    FILE *fp = fopen(file, "r");
+    char *text;
+    long n;
+    int rc;
+
+    if(fp == NULL){
+        fprintf(stderr, "%s: cannot open\n", file);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    n = ftell(fp);
+    rewind(fp);
+    text = malloc(n + 1);
+    if(text == NULL || fread(text, 1, n, fp) != (size_t)n){
+        fprintf(stderr, "%s: cannot read\n", file);
+        fclose(fp);
+        free(text);
+        return -1;
+    }
+    text[n] = '\0';
+    fclose(fp);
+
+    n = strlen(file);
+    if(len >= 0 && !(n > 3 && strcmp(file + n - 3, ".yo") == 0)){
+        rc = load_ncopy(text, len);
+        free(text);
+        return rc;
+    }
+    memset(&st, 0, sizeof(st));
+    st.cc = DEFAULT_CC;
+    if(n > 3 && strcmp(file + n - 3, ".yo") == 0)
+        rc = load_yo(text);
+    else
+        rc = assemble(text);
+    free(text);
+    init = st;
+    return rc;
+}
+
+/*
+ * load_ncopy - assemble the ncopy function text in the driver for len
+ *              words into st and init
+ */
+static int load_ncopy(const char *text, int len){
+    char *drv = ncopy_driver(text, len);
+    int rc;
+
+    memset(&st, 0, sizeof(st));
+    st.cc = DEFAULT_CC;
+    rc = drv ? assemble(drv) : -1;
+    free(drv);
+    init = st;
+    return rc;
+}
+
+/*
+ * load_yo - load the address: bytes columns of yas output
+ */
+static int load_yo(const char *text){
+    const char *p = text;
+    unsigned long addr;
+    int lineno = 0, hi, lo;
+
+    while(*p){
+        lineno++;
+        while(*p == ' ' || *p == '\t') p++;
+        if(p[0] == '0' && p[1] == 'x'){
+            addr = strtoul(p, (char **)&p, 16);
+            if(*p++ != ':'){
+                fprintf(stderr, "line %d: bad address\n", lineno);
+                return -1;
+            }
+            while(*p == ' ') p++;
+            while(isxdigit((unsigned char)p[0]) && isxdigit((unsigned char)p[1])){
+                if(addr >= MEMSIZE){
+                    fprintf(stderr, "line %d: address 0x%lx out of range\n", lineno, addr);
+                    return -1;
+                }
+                hi = isdigit((unsigned char)p[0]) ? p[0] - '0' : tolower(p[0]) - 'a' + 10;
+                lo = isdigit((unsigned char)p[1]) ? p[1] - '0' : tolower(p[1]) - 'a' + 10;
+                st.mem[addr++] = (unsigned char)(hi << 4 | lo);
+                p += 2;
+            }
+        }
+        while(*p && *p != '\n') p++;
+        if(*p) p++;
+    }
+    return 0;
+}
+
+/*=========================== ASSEMBLER ===========================*/
+
+/* Operand formats */
+#define FMT_NONE    0   /* halt */
+#define FMT_RR      1   /* rA, rB */
+#define FMT_IR      2   /* V, rB */
+#define FMT_RM      3   /* rA, D(rB) */
+#define FMT_MR      4   /* D(rB), rA */
+#define FMT_DEST    5   /* Dest */
+#define FMT_R       6   /* rA */
+
+static const struct {
+    const char *name;
+    int icode, ifun, fmt, size;
+} mnemonics[] = {
+    { "halt",   I_HALT,   0,     FMT_NONE, 1 },
+    { "nop",    I_NOP,    0,     FMT_NONE, 1 },
+    { "rrmovq", I_RRMOVQ, C_YES, FMT_RR,   2 },
+    { "cmovle", I_RRMOVQ, C_LE,  FMT_RR,   2 },
+    { "cmovl",  I_RRMOVQ, C_L,   FMT_RR,   2 },
+    { "cmove",  I_RRMOVQ, C_E,   FMT_RR,   2 },
+    { "cmovne", I_RRMOVQ, C_NE,  FMT_RR,   2 },
+    { "cmovge", I_RRMOVQ, C_GE,  FMT_RR,   2 },
+    { "cmovg",  I_RRMOVQ, C_G,   FMT_RR,   2 },
+    { "irmovq", I_IRMOVQ, 0,     FMT_IR,   10 },
+    { "rmmovq", I_RMMOVQ, 0,     FMT_RM,   10 },
+    { "mrmovq", I_MRMOVQ, 0,     FMT_MR,   10 },
+    { "addq",   I_ALU,    A_ADD, FMT_RR,   2 },
+    { "subq",   I_ALU,    A_SUB, FMT_RR,   2 },
+    { "andq",   I_ALU,    A_AND, FMT_RR,   2 },
+    { "xorq",   I_ALU,    A_XOR, FMT_RR,   2 },
+    { "jmp",    I_JMP,    C_YES, FMT_DEST, 9 },
+    { "jle",    I_JMP,    C_LE,  FMT_DEST, 9 },
+    { "jl",     I_JMP,    C_L,   FMT_DEST, 9 },
+    { "je",     I_JMP,    C_E,   FMT_DEST, 9 },
+    { "jne",    I_JMP,    C_NE,  FMT_DEST, 9 },
+    { "jge",    I_JMP,    C_GE,  FMT_DEST, 9 },
+    { "jg",     I_JMP,    C_G,   FMT_DEST, 9 },
+    { "call",   I_CALL,   0,     FMT_DEST, 9 },
+    { "ret",    I_RET,    0,     FMT_NONE, 1 },
+    { "pushq",  I_PUSHQ,  0,     FMT_R,    2 },
+    { "popq",   I_POPQ,   0,     FMT_R,    2 },
+    { "iaddq",  I_IADDQ,  0,     FMT_IR,   10 },
+};
+#define NMNEMONICS  (int)(sizeof(mnemonics) / sizeof(mnemonics[0]))
+
+static int lineno;      /* line being assembled */
+static int pass;        /* 1: addresses of labels, 2: emit */
+
+static int asm_error(const char *msg, const char *tok){
+    fprintf(stderr, "line %d: %s '%s'\n", lineno, msg, tok);
+    return -1;
+}
+
+/*
+ * reg_id - the register id of the token "%reg", or -1
+ */
+static int reg_id(const char *tok){
+    int i;
+    for(i = 0; i < 15; i++)
+        if(strcmp(tok, reg_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+/*
+ * value - the value of a number or label tok into *v; labels are 0 in
+ *         pass 1. Return 0 or -1.
+ */
+static int value(const char *tok, uint64_t *v){
+    const char *p = tok + (*tok == '-');
+    char *end;
+    int i;
+
+    if(*tok == '\0')
+        return asm_error("missing value", tok);
+    if(isdigit((unsigned char)*p)){
+        *v = strtoull(p, &end, (p[0] == '0' && p[1] == 'x') ? 16 : 10);
+        if(p != tok)
+            *v = -*v;
+        return *end ? asm_error("bad number", tok) : 0;
+    }
+    for(i = 0; i < nlabels; i++){
+        if(strcmp(labels[i].name, tok) == 0){
+            *v = labels[i].addr;
+            return 0;
+        }
+    }
+    *v = 0;
+    return pass == 1 ? 0 : asm_error("undefined label", tok);
+}
+
+/*
+ * memop - parse "D(%reg)" or "(%reg)" into *d and *r
+ */
+static int memop(char *tok, uint64_t *d, int *r){
+    char *lp = strchr(tok, '('), *rp = strchr(tok, ')');
+    if(lp == NULL || rp == NULL || rp[1] != '\0')
+        return asm_error("bad memory operand", tok);
+    *rp = '\0';
+    if((*r = reg_id(lp + 1)) < 0)
+        return asm_error("bad register", lp + 1);
+    *lp = '\0';
+    if(lp == tok){
+        *d = 0;
+        return 0;
+    }
+    return value(tok, d);
+}
+
+static int emit(uint64_t *addr, uint64_t v, int n){
+    int i;
+    if(*addr + n > MEMSIZE){
+        fprintf(stderr, "line %d: address 0x%llx out of range\n", lineno,
+            (unsigned long long)*addr);
+        return -1;
+    }
+    if(pass == 2)
+        for(i = 0; i < n; i++)
+            st.mem[*addr + i] = (unsigned char)(v >> (8 * i));
+    *addr += n;
+    return 0;
+}
+
+/*
+ * asm_line - assemble the tokens of one line at *addr
+ */
+static int asm_line(char **tok, int ntok, uint64_t *addr){
+    uint64_t v = 0;
+    int i, rA = REG_NONE, rB = REG_NONE, size;
+
+    /* Labels */
+    while(ntok > 0 && tok[0][strlen(tok[0]) - 1] == ':'){
+        tok[0][strlen(tok[0]) - 1] = '\0';
+        if(pass == 1){
+            for(i = 0; i < nlabels; i++)
+                if(strcmp(labels[i].name, tok[0]) == 0)
+                    return asm_error("duplicate label", tok[0]);
+            if(nlabels == MAXLABELS || strlen(tok[0]) >= MAXLABEL)
+                return asm_error("too many labels at", tok[0]);
+            strcpy(labels[nlabels].name, tok[0]);
+            labels[nlabels++].addr = *addr;
+        }
+        tok++;
+        ntok--;
+    }
+    if(ntok == 0)
+        return 0;
+
+    /* Directives, the operand may be glued on as in ".pos0x200" */
+    if(tok[0][0] == '.'){
+        char *arg = tok[0] + 1;
+        char name[16];
+        for(i = 0; isalpha((unsigned char)arg[i]) && i < 15; i++)
+            name[i] = arg[i];
+        name[i] = '\0';
+        arg += i;
+        if(*arg == '\0')
+            arg = ntok > 1 ? tok[1] : "";
+        if(value(arg, &v) < 0)
+            return -1;
+        if(strcmp(name, "pos") == 0)
+            *addr = v;
+        else if(strcmp(name, "align") == 0){
+            if(v == 0 || (v & (v - 1)))
+                return asm_error("bad alignment", arg);
+            *addr = (*addr + v - 1) & ~(v - 1);
+        }
+        else if(strcmp(name, "byte") == 0) return emit(addr, v, 1);
+        else if(strcmp(name, "word") == 0) return emit(addr, v, 2);
+        else if(strcmp(name, "long") == 0) return emit(addr, v, 4);
+        else if(strcmp(name, "quad") == 0) return emit(addr, v, 8);
+        else return asm_error("unknown directive", tok[0]);
+        if(*addr > MEMSIZE)
+            return asm_error("address out of range at", tok[0]);
+        return 0;
+    }
+
+    /* Instructions */
+    for(i = 0; i < NMNEMONICS; i++)
+        if(strcmp(tok[0], mnemonics[i].name) == 0)
+            break;
+    if(i == NMNEMONICS)
+        return asm_error("unknown instruction", tok[0]);
+    size = mnemonics[i].size;
+    switch(mnemonics[i].fmt){
+        case FMT_NONE:
+            if(ntok != 1) return asm_error("extra operand", tok[1]);
+            break;
+        case FMT_RR:
+            if(ntok != 3) return asm_error("expected rA, rB for", tok[0]);
+            if((rA = reg_id(tok[1])) < 0) return asm_error("bad register", tok[1]);
+            if((rB = reg_id(tok[2])) < 0) return asm_error("bad register", tok[2]);
+            break;
+        case FMT_IR:
+            if(ntok != 3) return asm_error("expected V, rB for", tok[0]);
+            if(value(tok[1] + (tok[1][0] == '$'), &v) < 0) return -1;
+            if((rB = reg_id(tok[2])) < 0) return asm_error("bad register", tok[2]);
+            break;
+        case FMT_RM:
+            if(ntok != 3) return asm_error("expected rA, D(rB) for", tok[0]);
+            if((rA = reg_id(tok[1])) < 0) return asm_error("bad register", tok[1]);
+            if(memop(tok[2], &v, &rB) < 0) return -1;
+            break;
+        case FMT_MR:
+            if(ntok != 3) return asm_error("expected D(rB), rA for", tok[0]);
+            if(memop(tok[1], &v, &rB) < 0) return -1;
+            if((rA = reg_id(tok[2])) < 0) return asm_error("bad register", tok[2]);
+            break;
+        case FMT_DEST:
+            if(ntok != 2) return asm_error("expected Dest for", tok[0]);
+            if(value(tok[1], &v) < 0) return -1;
+            break;
+        case FMT_R:
+            if(ntok != 2) return asm_error("expected rA for", tok[0]);
+            if((rA = reg_id(tok[1])) < 0) return asm_error("bad register", tok[1]);
+            break;
+    }
+    if(emit(addr, mnemonics[i].icode << 4 | mnemonics[i].ifun, 1) < 0)
+        return -1;
+    if(size == 2 || size == 10)
+        if(emit(addr, rA << 4 | rB, 1) < 0)
+            return -1;
+    if(size >= 9)
+        return emit(addr, v, 8);
+    return 0;
+}
+
+/*
+ * assemble - assemble the .ys text into st.mem, two passes
+ */
+static int assemble(const char *text){
+    char line[MAXLINE], *tok[8], *p, *c;
+    const char *q;
+    uint64_t addr;
+    size_t n;
+    int ntok;
+
+    nlabels = 0;
+    for(pass = 1; pass <= 2; pass++){
+        addr = 0;
+        lineno = 0;
+        for(q = text; *q; q += n + (q[n] == '\n')){
+            n = strcspn(q, "\n");
+            lineno++;
+            if(n >= MAXLINE){
+                fprintf(stderr, "line %d: too long\n", lineno);
+                return -1;
+            }
+            memcpy(line, q, n);
+            line[n] = '\0';
+            if((c = strchr(line, '#')) != NULL)
+                *c = '\0';
+            ntok = 0;
+            for(p = strtok(line, " \t\r,"); p && ntok < 8; p = strtok(NULL, " \t\r,"))
+                tok[ntok++] = p;
+            if(asm_line(tok, ntok, &addr) < 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/*=========================== ISA ===========================*/
+
+static int get_quad(const struct state *s, uint64_t a, uint64_t *v){
+    int i;
+    if(a >= MEMSIZE || a + 8 > MEMSIZE)
+        return 0;
+    *v = 0;
+    for(i = 7; i >= 0; i--)
+        *v = *v << 8 | s->mem[a + i];
+    return 1;
+}
+
+static int set_quad(struct state *s, uint64_t a, uint64_t v){
+    int i;
+    if(a >= MEMSIZE || a + 8 > MEMSIZE)
+        return 0;
+    for(i = 0; i < 8; i++)
+        s->mem[a + i] = (unsigned char)(v >> (8 * i));
+    return 1;
+}
+
+/*
+ * fetch - fetch the instruction at pc into *in, return its status as
+ *         f_stat of pipe-full.hcl (an imem_error gives a nop)
+ */
+static int fetch(const struct state *s, uint64_t pc, struct instr *in){
+    int need_regids, need_valC;
+
+    in->rA = in->rB = REG_NONE;
+    in->valC = 0;
+    in->valP = pc;
+    if(pc >= MEMSIZE){
+        in->icode = I_NOP;
+        in->ifun = F_NONE;
+        return STAT_ADR;
+    }
+    in->icode = s->mem[pc] >> 4;
+    in->ifun = s->mem[pc] & 0xF;
+    in->valP = pc + 1;
+    need_regids = in->icode == I_RRMOVQ || in->icode == I_ALU || in->icode == I_PUSHQ
+        || in->icode == I_POPQ || in->icode == I_IRMOVQ || in->icode == I_RMMOVQ
+        || in->icode == I_MRMOVQ || in->icode == I_IADDQ;
+    need_valC = in->icode == I_IRMOVQ || in->icode == I_RMMOVQ || in->icode == I_MRMOVQ
+        || in->icode == I_JMP || in->icode == I_CALL || in->icode == I_IADDQ;
+    if(need_regids){
+        if(in->valP >= MEMSIZE)
+            goto imem_error;
+        in->rA = s->mem[in->valP] >> 4;
+        in->rB = s->mem[in->valP] & 0xF;
+        in->valP++;
+    }
+    if(need_valC){
+        if(!get_quad(s, in->valP, &in->valC))
+            goto imem_error;
+        in->valP += 8;
+    }
+    if(in->icode > I_IADDQ)
+        return STAT_INS;
+    return in->icode == I_HALT ? STAT_HLT : STAT_AOK;
+
+imem_error:
+    in->icode = I_NOP;
+    in->ifun = F_NONE;
+    return STAT_ADR;
+}
+
+/*
+ * cond - does the condition ifun hold under cc
+ */
+static int cond(int cc, int ifun){
+    int zf = !!(cc & CC_ZF), sf = !!(cc & CC_SF), of = !!(cc & CC_OF);
+    switch(ifun){
+        case C_YES: return 1;
+        case C_LE: return (sf ^ of) | zf;
+        case C_L: return sf ^ of;
+        case C_E: return zf;
+        case C_NE: return !zf;
+        case C_GE: return !(sf ^ of);
+        case C_G: return !(sf ^ of) & !zf;
+    }
+    return 0;
+}
+
+/*
+ * alu - b op a, as the ALU of the HCL (b - a for subq)
+ */
+static uint64_t alu(int ifun, uint64_t a, uint64_t b){
+    switch(ifun){
+        case A_ADD: return b + a;
+        case A_SUB: return b - a;
+        case A_AND: return b & a;
+        case A_XOR: return b ^ a;
+    }
+    return 0;
+}
+
+static int alu_cc(int ifun, uint64_t a, uint64_t b, uint64_t r){
+    int zf = r == 0, sf = (int64_t)r < 0, of = 0;
+    if(ifun == A_ADD)
+        of = ((int64_t)a < 0) == ((int64_t)b < 0) && ((int64_t)r < 0) != ((int64_t)a < 0);
+    else if(ifun == A_SUB)
+        of = ((int64_t)a < 0) != ((int64_t)b < 0) && ((int64_t)r < 0) != ((int64_t)b < 0);
+    return (zf ? CC_ZF : 0) | (sf ? CC_SF : 0) | (of ? CC_OF : 0);
+}
+
+/*
+ * seq_step - execute the instruction at s->pc, return its status
+ */
+static int seq_step(struct state *s){
+    struct instr in;
+    uint64_t valA, valB, valE, valM;
+    int stat = fetch(s, s->pc, &in);
+
+    if(stat != STAT_AOK)
+        return stat;
+    valA = s->reg[in.rA];
+    valB = s->reg[in.rB];
+    switch(in.icode){
+        case I_NOP:
+            break;
+        case I_RRMOVQ:
+            if(cond(s->cc, in.ifun) && in.rB != REG_NONE)
+                s->reg[in.rB] = valA;
+            break;
+        case I_IRMOVQ:
+            if(in.rB != REG_NONE)
+                s->reg[in.rB] = in.valC;
+            break;
+        case I_RMMOVQ:
+            if(!set_quad(s, valB + in.valC, valA))
+                return STAT_ADR;
+            break;
+        case I_MRMOVQ:
+            if(!get_quad(s, valB + in.valC, &valM))
+                return STAT_ADR;
+            if(in.rA != REG_NONE)
+                s->reg[in.rA] = valM;
+            break;
+        case I_ALU:
+        case I_IADDQ:
+            if(in.icode == I_IADDQ){
+                in.ifun = A_ADD;
+                valA = in.valC;
+            }
+            valE = alu(in.ifun, valA, valB);
+            s->cc = alu_cc(in.ifun, valA, valB, valE);
+            if(in.rB != REG_NONE)
+                s->reg[in.rB] = valE;
+            break;
+        case I_JMP:
+            s->pc = cond(s->cc, in.ifun) ? in.valC : in.valP;
+            return STAT_AOK;
+        case I_CALL:
+            valE = s->reg[REG_RSP] - 8;
+            if(!set_quad(s, valE, in.valP))
+                return STAT_ADR;
+            s->reg[REG_RSP] = valE;
+            s->pc = in.valC;
+            return STAT_AOK;
+        case I_RET:
+            if(!get_quad(s, s->reg[REG_RSP], &valM))
+                return STAT_ADR;
+            s->reg[REG_RSP] += 8;
+            s->pc = valM;
+            return STAT_AOK;
+        case I_PUSHQ:
+            valE = s->reg[REG_RSP] - 8;
+            if(!set_quad(s, valE, valA))
+                return STAT_ADR;
+            s->reg[REG_RSP] = valE;
+            break;
+        case I_POPQ:
+            if(!get_quad(s, s->reg[REG_RSP], &valM))
+                return STAT_ADR;
+            s->reg[REG_RSP] += 8;
+            if(in.rA != REG_NONE)
+                s->reg[in.rA] = valM;
+            break;
+    }
+    s->pc = in.valP;
+    return STAT_AOK;
+}
+
+/*
+ * run_seq - run st until an exception or maxcycles steps, return the
+ *           status, *steps the instructions (the excepting one counts)
+ */
+static int run_seq(long *steps){
+    int stat = STAT_AOK;
+    for(*steps = 0; *steps < maxcycles && stat == STAT_AOK; (*steps)++)
+        stat = seq_step(&st);
+    return stat;
+}
+
+/*=========================== CACHES ===========================*/
+
+/*
+ * cache_config - set up *c from "size,ways,block,penalty", return 0 if
+ *                the geometry is not powers of 2 that fit in memory, has
+ *                one line, or is an I-cache of blocks under 16 bytes
+ */
+static int cache_config(struct cache *c, const char *spec){
+    c->ways = 1;
+    c->block = 16;
+    c->penalty = 10;
+    if(sscanf(spec, "%d,%d,%d,%d", &c->size, &c->ways, &c->block, &c->penalty) < 1)
+        return 0;
+    if(c->size < 8 || c->size > MEMSIZE || (c->size & (c->size - 1)) || c->block < 8
+       || (c->block & (c->block - 1)) || c->ways < 1 || (c->ways & (c->ways - 1))
+       || c->size < c->ways * c->block || c->penalty < 1
+       || c->size / c->block < 2 || (c == &l1i && c->block < 16))
+        return 0;
+    c->sets = c->size / c->block / c->ways;
+    return 1;
+}
+
+static void cache_reset(struct cache *c){
+    memset(c->line, 0, sizeof(c->line));
+    c->access = c->miss = c->writeback = 0;
+}
+
+/*
+ * cache_access - look up the block of addr at cycle now, fill it on a
+ *                miss (the LRU way), return the cycle its data is ready
+ */
+static long cache_access(struct cache *c, uint64_t addr, int write, long now){
+    uint64_t tag = addr / c->block;
+    struct cline *set = &c->line[(tag % c->sets) * c->ways], *v = set;
+    int i;
+
+    for(i = 0; i < c->ways; i++){
+        if(set[i].valid && set[i].tag == tag){
+            set[i].used = now;
+            set[i].dirty |= write;
+            return set[i].ready;
+        }
+        if(!set[i].valid || (v->valid && set[i].used < v->used))
+            v = &set[i];
+    }
+    c->miss++;
+    if(v->valid && v->dirty)
+        c->writeback++;             /* through a write buffer, not timed */
+    v->tag = tag;
+    v->valid = 1;
+    v->dirty = write;
+    v->ready = now + c->penalty;
+    v->used = now;
+    return v->ready;
+}
+
+/*
+ * cache_range - access every block of the n bytes at addr, return the
+ *               cycle all are ready (now without a cache)
+ */
+static long cache_range(struct cache *c, uint64_t addr, int n, int write, long now){
+    long r = now, r2;
+    uint64_t b;
+
+    if(!c->sets || addr >= MEMSIZE || addr + n > MEMSIZE)
+        return now;
+    for(b = addr / c->block; b <= (addr + (n > 1 ? n - 1 : 0)) / c->block; b++){
+        r2 = cache_access(c, b * c->block, write, now);
+        r = r2 > r ? r2 : r;
+    }
+    return r;
+}
+
+/*=========================== PIPE ===========================*/
+
+static void bubble(struct preg *r, int cause, uint64_t cpc){
+    memset(r, 0, sizeof(*r));
+    r->stat = STAT_BUB;
+    r->icode = I_NOP;
+    r->rA = r->rB = r->srcA = r->srcB = r->dstE = r->dstM = REG_NONE;
+    r->cause = cause;
+    r->cpc = cpc;
+}
+
+/*
+ * predict - the next PC after instruction f at pc, as f_predPC; for a
+ *           conditional jump *pidx is the predictor entry used
+ */
+static uint64_t predict(uint64_t pc, const struct instr *f, int *pidx){
+    int taken = 1;
+
+    *pidx = 0;
+    if(f->icode == I_RET && use_ras)
+        return ras[(ras_top - 1) & (RASSIZE - 1)];
+    if(f->icode == I_CALL)
+        return f->valC;
+    if(f->icode != I_JMP)
+        return f->valP;
+    if(f->ifun != C_YES){
+        switch(predictor){
+            case PRED_BTFNT:
+                taken = f->valC <= pc;
+                break;
+            case PRED_BIMODAL:
+                *pidx = (int)(pc % BTBSIZE);
+                taken = btb[*pidx].valid && btb[*pidx].tag == pc && btb[*pidx].ctr >= 2;
+                break;
+            case PRED_GSHARE:
+                *pidx = (int)((pc ^ ghr) & ((1 << HISTBITS) - 1));
+                taken = pht[*pidx] >= 2;
+                break;
+        }
+    }
+    return taken ? f->valC : f->valP;
+}
+
+/*
+ * train - update the predictor with the outcome of the conditional jump
+ *         in E, as it leaves E
+ */
+static void train(const struct preg *E, int taken){
+    struct btb *b = &btb[E->pidx];
+
+    switch(predictor){
+        case PRED_BIMODAL:
+            if(!b->valid || b->tag != E->pc){
+                if(!taken)              /* allocate on taken */
+                    break;
+                b->valid = 1;
+                b->tag = E->pc;
+                b->ctr = 2;
+            }
+            else if(taken && b->ctr < 3)
+                b->ctr++;
+            else if(!taken && b->ctr > 0)
+                b->ctr--;
+            break;
+        case PRED_GSHARE:
+            if(taken && pht[E->pidx] < 3)
+                pht[E->pidx]++;
+            else if(!taken && pht[E->pidx] > 0)
+                pht[E->pidx]--;
+            ghr = ((ghr << 1) | taken) & ((1 << HISTBITS) - 1);
+            break;
+    }
+}
+
+/*
+ * run_pipe - run st on the PIPE processor until an exception reaches W or
+ *            maxcycles cycles, return the status, *cycles the cycles and
+ *            *instrs the instructions retired; fills prof[] and lost[]
+ */
+static int run_pipe(long *cycles, long *instrs){
+    struct preg D, E, M, W, d, e, m;
+    struct instr f;
+    uint64_t F_predPC = 0, f_pc, f_predPC, d_rvalA, d_rvalB, mem_addr = 0, ret_pc, jump_pc;
+    uint64_t aluA, aluB, m_data;
+    int f_stat, f_pidx, cc, set_cc, load_use, mispredict, ret, ret_miss, alufun, dmem_error;
+    int mem_read, mem_write, M_bubble, jump_ras, istall;
+
+    bubble(&D, LOST_FILL, 0);
+    bubble(&E, LOST_FILL, 0);
+    bubble(&M, LOST_FILL, 0);
+    bubble(&W, LOST_FILL, 0);
+    memset(prof, 0, sizeof(prof));
+    memset(lost, 0, sizeof(lost));
+    memset(btb, 0, sizeof(btb));
+    memset(pht, 1, sizeof(pht));        /* weakly not taken */
+    memset(ras, 0, sizeof(ras));
+    cache_reset(&l1i);
+    cache_reset(&l1d);
+    ghr = 0;
+    ras_top = 0;
+    *instrs = 0;
+
+    for(*cycles = 1; ; (*cycles)++){
+        /* Account for W: an instruction retires or a cycle is lost */
+        if(W.stat == STAT_BUB){
+            lost[W.cause]++;
+            if(W.cause != LOST_FILL)
+                prof[W.cpc % MEMSIZE].lost[W.cause]++;
+        }
+        else{
+            (*instrs)++;
+            prof[W.pc % MEMSIZE].exec++;
+        }
+        if(EXCEPTION(W.stat) || *cycles >= maxcycles)
+            break;
+
+        /* Memory */
+        m = M;
+        mem_read = M.icode == I_MRMOVQ || M.icode == I_POPQ || M.icode == I_RET;
+        mem_write = M.icode == I_RMMOVQ || M.icode == I_PUSHQ || M.icode == I_CALL;
+        if(M.icode == I_RMMOVQ || M.icode == I_PUSHQ || M.icode == I_CALL || M.icode == I_MRMOVQ)
+            mem_addr = M.valE;
+        else if(M.icode == I_POPQ || M.icode == I_RET)
+            mem_addr = M.valA;
+        dmem_error = 0;
+        m.valM = 0;
+        if(mem_read && !get_quad(&st, mem_addr, &m.valM))
+            dmem_error = 1;
+        if(mem_write && (mem_addr >= MEMSIZE || mem_addr + 8 > MEMSIZE))
+            dmem_error = 1;
+        m.stat = dmem_error ? STAT_ADR : M.stat;
+
+        /* A D-cache miss holds M and the stages behind it; W drains */
+        if((mem_read || mem_write) && !dmem_error && l1d.sets){
+            if(cache_range(&l1d, mem_addr, 8, mem_write, *cycles) > *cycles){
+                if(load_fwd && (M.icode == I_RMMOVQ || M.icode == I_PUSHQ)
+                   && M.srcA == W.dstM && W.dstM != REG_NONE)
+                    M.valA = W.valM;    /* the load leaves W now */
+                if(W.stat == STAT_AOK){
+                    if(W.dstE != REG_NONE) st.reg[W.dstE] = W.valE;
+                    if(W.dstM != REG_NONE) st.reg[W.dstM] = W.valM;
+                }
+                bubble(&W, LOST_DCACHE, M.pc);
+                continue;
+            }
+            l1d.access++;
+        }
+        if(load_fwd && (M.icode == I_RMMOVQ || M.icode == I_PUSHQ)
+           && M.srcA == W.dstM && W.dstM != REG_NONE)
+            m_data = W.valM;
+        else
+            m_data = M.valA;
+        ret_miss = use_ras && M.icode == I_RET && !dmem_error && m.valM != M.predPC;
+
+        /* Execute */
+        e = E;
+        if(E.icode == I_RRMOVQ || E.icode == I_ALU) aluA = E.valA;
+        else if(E.icode == I_IRMOVQ || E.icode == I_RMMOVQ || E.icode == I_MRMOVQ
+             || E.icode == I_IADDQ) aluA = E.valC;
+        else if(E.icode == I_CALL || E.icode == I_PUSHQ) aluA = (uint64_t)-8;
+        else if(E.icode == I_RET || E.icode == I_POPQ) aluA = 8;
+        else aluA = 0;
+        if(E.icode == I_RMMOVQ || E.icode == I_MRMOVQ || E.icode == I_ALU || E.icode == I_CALL
+         || E.icode == I_PUSHQ || E.icode == I_RET || E.icode == I_POPQ || E.icode == I_IADDQ)
+            aluB = E.valB;
+        else aluB = 0;
+        alufun = E.icode == I_ALU ? E.ifun : A_ADD;
+        e.valE = alu(alufun, aluA, aluB);
+        e.Cnd = cond(st.cc, E.ifun);
+        set_cc = (E.icode == I_ALU || E.icode == I_IADDQ)
+            && !EXCEPTION(m.stat) && !EXCEPTION(W.stat) && !ret_miss;
+        cc = set_cc ? alu_cc(alufun, aluA, aluB, e.valE) : st.cc;
+        if(E.icode == I_RRMOVQ && !e.Cnd)
+            e.dstE = REG_NONE;
+
+        /* Decode */
+        d = D;
+        if(D.icode == I_RRMOVQ || D.icode == I_RMMOVQ || D.icode == I_ALU || D.icode == I_PUSHQ)
+            d.srcA = D.rA;
+        else if(D.icode == I_POPQ || D.icode == I_RET)
+            d.srcA = REG_RSP;
+        else
+            d.srcA = REG_NONE;
+        if(D.icode == I_ALU || D.icode == I_RMMOVQ || D.icode == I_MRMOVQ || D.icode == I_IADDQ)
+            d.srcB = D.rB;
+        else if(D.icode == I_PUSHQ || D.icode == I_POPQ || D.icode == I_CALL || D.icode == I_RET)
+            d.srcB = REG_RSP;
+        else
+            d.srcB = REG_NONE;
+        if(D.icode == I_RRMOVQ || D.icode == I_IRMOVQ || D.icode == I_ALU || D.icode == I_IADDQ)
+            d.dstE = D.rB;
+        else if(D.icode == I_PUSHQ || D.icode == I_POPQ || D.icode == I_CALL || D.icode == I_RET)
+            d.dstE = REG_RSP;
+        else
+            d.dstE = REG_NONE;
+        d.dstM = (D.icode == I_MRMOVQ || D.icode == I_POPQ) ? D.rA : REG_NONE;
+        d_rvalA = st.reg[d.srcA];
+        d_rvalB = st.reg[d.srcB];
+        if(D.icode == I_CALL || D.icode == I_JMP) d.valA = D.valP;
+        else if(d.srcA == REG_NONE) d.valA = d_rvalA;
+        else if(d.srcA == e.dstE) d.valA = e.valE;
+        else if(d.srcA == M.dstM) d.valA = m.valM;
+        else if(d.srcA == M.dstE) d.valA = M.valE;
+        else if(d.srcA == W.dstM) d.valA = W.valM;
+        else if(d.srcA == W.dstE) d.valA = W.valE;
+        else d.valA = d_rvalA;
+        if(d.srcB == REG_NONE) d.valB = d_rvalB;
+        else if(d.srcB == e.dstE) d.valB = e.valE;
+        else if(d.srcB == M.dstM) d.valB = m.valM;
+        else if(d.srcB == M.dstE) d.valB = M.valE;
+        else if(d.srcB == W.dstM) d.valB = W.valM;
+        else if(d.srcB == W.dstE) d.valB = W.valE;
+        else d.valB = d_rvalB;
+
+        /* Fetch */
+        if(M.icode == I_JMP && (M.Cnd ? M.valC : M.valA) != M.predPC)
+            f_pc = M.Cnd ? M.valC : M.valA;
+        else if(W.icode == I_RET && (!use_ras || W.valM != W.predPC)) f_pc = W.valM;
+        else f_pc = F_predPC;
+        f_stat = fetch(&st, f_pc, &f);
+        f_predPC = predict(f_pc, &f, &f_pidx);
+        istall = cache_range(&l1i, f_pc, (int)(f.valP - f_pc), 0, *cycles) > *cycles;
+
+        /* Pipeline register control; a wrong ret squashes E and D */
+        load_use = (E.icode == I_MRMOVQ || E.icode == I_POPQ)
+            && ((E.dstM == d.srcA && !(load_fwd && (D.icode == I_RMMOVQ || D.icode == I_PUSHQ)))
+                || E.dstM == d.srcB) && !ret_miss;
+        mispredict = E.icode == I_JMP && (e.Cnd ? E.valC : E.valP) != E.predPC && !ret_miss;
+        ret = !use_ras && (D.icode == I_RET || E.icode == I_RET || M.icode == I_RET);
+        ret_pc = D.icode == I_RET ? D.pc : E.icode == I_RET ? E.pc : M.pc;
+        jump_pc = E.pc;
+        jump_ras = E.ras;
+        M_bubble = EXCEPTION(m.stat) || EXCEPTION(W.stat);
+
+        /* Predictor statistics and training */
+        if(E.icode == I_JMP && E.ifun != C_YES && E.stat == STAT_AOK && !ret_miss && !M_bubble){
+            prof[E.pc % MEMSIZE].branch++;
+            prof[E.pc % MEMSIZE].taken += e.Cnd;
+            prof[E.pc % MEMSIZE].miss += mispredict;
+            train(&E, e.Cnd);
+        }
+        if(M.icode == I_RET && M.stat == STAT_AOK && use_ras && !M_bubble){
+            prof[M.pc % MEMSIZE].branch++;
+            prof[M.pc % MEMSIZE].taken++;
+            prof[M.pc % MEMSIZE].miss += ret_miss;
+        }
+
+        /* Clock: register file, memory and CC */
+        if(W.stat == STAT_AOK){
+            if(W.dstE != REG_NONE) st.reg[W.dstE] = W.valE;
+            if(W.dstM != REG_NONE) st.reg[W.dstM] = W.valM;
+        }
+        if(mem_write && !dmem_error)
+            set_quad(&st, mem_addr, m_data);
+        st.cc = cc;
+
+        /* Clock: pipeline registers */
+        if(M_bubble)
+            bubble(&M, LOST_DRAIN, EXCEPTION(m.stat) ? M.pc : W.pc);
+        else if(ret_miss)
+            bubble(&M, LOST_RET, M.pc);
+        else
+            M = e;
+        W = m;
+        if(ret_miss)
+            bubble(&E, LOST_RET, W.pc);
+        else if(mispredict)
+            bubble(&E, LOST_MISPREDICT, jump_pc);
+        else if(load_use)
+            bubble(&E, LOST_LOADUSE, E.pc);
+        else
+            E = d;
+        if(ret_miss){
+            bubble(&D, LOST_RET, W.pc);
+            ras_top = W.ras;
+        }
+        else if(load_use)
+            ;                           /* D_stall */
+        else if(mispredict){
+            bubble(&D, LOST_MISPREDICT, jump_pc);
+            ras_top = jump_ras;
+        }
+        else if(ret)
+            bubble(&D, LOST_RET, ret_pc);
+        else if(istall)
+            bubble(&D, LOST_ICACHE, f_pc);
+        else{
+            if(l1i.sets && f_pc < MEMSIZE)
+                l1i.access++;
+            bubble(&D, 0, 0);
+            D.stat = f_stat;
+            D.icode = f.icode;
+            D.ifun = f.ifun;
+            D.rA = f.rA;
+            D.rB = f.rB;
+            D.valC = f.valC;
+            D.valP = f.valP;
+            D.pc = f_pc;
+            D.predPC = f_predPC;
+            D.pidx = f_pidx;
+            if(use_ras && f.icode == I_CALL)
+                ras[ras_top++ & (RASSIZE - 1)] = f.valP;
+            else if(use_ras && f.icode == I_RET)
+                ras_top--;
+            D.ras = ras_top;
+        }
+        if(!load_use && !ret)           /* F_stall; refetch f_pc after a miss */
+            F_predPC = istall ? f_pc : f_predPC;
+    }
+    st.pc = W.pc;
+    return W.stat == STAT_BUB ? STAT_AOK : W.stat;
+}
+
+/*=========================== OOO ===========================*/
+
+/*
+ * A uop of the out-of-order model: one Y86 instruction, with the ROB
+ * slots of the instructions producing its operands. popq and ret have
+ * two results: %rsp is ready after the ALU, the load a LAT_LOAD later.
+ */
+struct uop {
+    uint64_t pc;
+    long seq;                       /* dynamic instruction number */
+    int icode, ifun, stat, mem;
+    int src[5], srcm[5], nsrc;      /* producer slots, whose M result */
+    long srcseq[5];
+    int dste, dstm, setcc;          /* renamed results */
+    long fetched, readyE, readyM;   /* cycles; readyE 0 until issued */
+    int mispredict, taken, pidx;
+    uint64_t addr;                  /* memory address, oracle */
+};
+
+/* Latencies, cycles from issue until a dependent may issue */
+#define LAT_ALU     1
+#define LAT_LOAD    2
+#define CC_REG      16              /* CC renamed as a 17th register */
+
+static struct uop rob[OOO_MAXROB];
+static struct uop fq[OOO_MAXROB];   /* fetch queue */
+static long ooo_stall[5];           /* dispatch: ROB, RS full; fetch: jXX, ret, icache */
+
+/*
+ * ooo_ready - is operand k of u available to issue in cycle now
+ */
+static int ooo_ready(const struct uop *u, int k, long now){
+    const struct uop *p = &rob[u->src[k]];
+    if(p->seq != u->srcseq[k])
+        return 1;                   /* committed and its slot reused */
+    return p->readyE && (u->srcm[k] ? p->readyM : p->readyE) <= now;
+}
+
+/*
+ * ooo_fetch - execute the instruction at st.pc on SEQ and describe it
+ *             in *u; its PC, the operands and the outcome are known now
+ */
+static void ooo_fetch(struct uop *u, long seq, long now){
+    struct instr f;
+    uint64_t pred;
+    int k = fetch(&st, st.pc, &f);
+
+    memset(u, 0, sizeof(*u));
+    u->pc = st.pc;
+    u->seq = seq;
+    u->icode = f.icode;
+    u->ifun = f.ifun;
+    u->fetched = now;
+    u->dste = u->dstm = REG_NONE;
+    if(f.icode == I_RMMOVQ || f.icode == I_MRMOVQ)
+        u->addr = st.reg[f.rB] + f.valC;
+    else if(f.icode == I_PUSHQ || f.icode == I_CALL)
+        u->addr = st.reg[REG_RSP] - 8;
+    else if(f.icode == I_POPQ || f.icode == I_RET)
+        u->addr = st.reg[REG_RSP];
+    u->mem = f.icode == I_RMMOVQ || f.icode == I_MRMOVQ || f.icode == I_PUSHQ
+        || f.icode == I_POPQ || f.icode == I_CALL || f.icode == I_RET;
+    if(f.icode == I_RRMOVQ || f.icode == I_IRMOVQ || f.icode == I_ALU || f.icode == I_IADDQ)
+        u->dste = f.rB;
+    else if(f.icode == I_PUSHQ || f.icode == I_POPQ || f.icode == I_CALL || f.icode == I_RET)
+        u->dste = REG_RSP;
+    if(f.icode == I_MRMOVQ || f.icode == I_POPQ)
+        u->dstm = f.rA;
+    u->setcc = f.icode == I_ALU || f.icode == I_IADDQ;
+
+    /* Operands, as registers for now: renamed at dispatch */
+    if(f.icode == I_RRMOVQ || f.icode == I_RMMOVQ || f.icode == I_ALU || f.icode == I_PUSHQ)
+        u->src[u->nsrc++] = f.rA;
+    if(f.icode == I_ALU || f.icode == I_RMMOVQ || f.icode == I_MRMOVQ || f.icode == I_IADDQ)
+        u->src[u->nsrc++] = f.rB;
+    else if(f.icode == I_PUSHQ || f.icode == I_POPQ || f.icode == I_CALL || f.icode == I_RET)
+        u->src[u->nsrc++] = REG_RSP;
+    if((f.icode == I_JMP || f.icode == I_RRMOVQ) && f.ifun != C_YES){
+        u->src[u->nsrc++] = CC_REG;
+        if(f.icode == I_RRMOVQ)     /* a cmov not taken keeps rB */
+            u->src[u->nsrc++] = f.rB;
+    }
+
+    pred = predict(st.pc, &f, &u->pidx);
+    u->stat = k == STAT_AOK ? seq_step(&st) : k;
+    if(u->stat == STAT_AOK && (f.icode == I_JMP || f.icode == I_RET)){
+        u->taken = st.pc != f.valP;
+        u->mispredict = st.pc != pred || (f.icode == I_RET && !use_ras);
+    }
+    if(use_ras && f.icode == I_CALL)
+        ras[ras_top++ & (RASSIZE - 1)] = f.valP;
+    else if(use_ras && f.icode == I_RET)
+        ras_top--;
+}
+
+/*
+ * run_ooo - run st on the out-of-order model until an exception commits
+ *           or maxcycles cycles, return the status, *cycles the cycles
+ *           and *instrs the instructions committed
+ */
+static int run_ooo(long *cycles, long *instrs){
+    static int mst[MEMSIZE];        /* slot of the last store, by byte */
+    static long mstseq[MEMSIZE];
+    int rat[17], ratm[17], rob_head = 0, rob_n = 0, fq_head = 0, fq_n = 0, rs_n = 0;
+    int fq_size = 4 * ooo_width, mem_ports = ooo_width > 1 ? ooo_width / 2 : 1;
+    int i, j, k, n, alu_n, mem_n, stat = STAT_AOK, fetching = 1, wait_ret = 0;
+    long ratseq[17], seq = 0, resume = 0;
+    struct uop *u;
+    struct instr f;
+    struct preg E;
+
+    memset(prof, 0, sizeof(prof));
+    memset(ooo_stall, 0, sizeof(ooo_stall));
+    memset(btb, 0, sizeof(btb));
+    memset(pht, 1, sizeof(pht));
+    memset(ras, 0, sizeof(ras));
+    cache_reset(&l1i);
+    cache_reset(&l1d);
+    memset(mstseq, -1, sizeof(mstseq));
+    memset(ratseq, -1, sizeof(ratseq));
+    memset(rob, 0, sizeof(rob));
+    for(i = 0; i < MEMSIZE; i++)
+        mst[i] = 0;
+    ghr = 0;
+    ras_top = 0;
+    *instrs = 0;
+    for(i = 0; i < 17; i++)
+        rat[i] = ratm[i] = 0;
+    for(i = 0; i < OOO_MAXROB; i++)
+        rob[i].seq = -2;
+
+    for(*cycles = 1; *cycles < maxcycles; (*cycles)++){
+        long now = *cycles;
+
+        /* Commit in order */
+        for(n = 0; n < ooo_width && rob_n > 0; n++){
+            u = &rob[rob_head];
+            if(!u->readyE || (u->dstm != REG_NONE ? u->readyM : u->readyE) > now)
+                break;
+            (*instrs)++;
+            prof[u->pc % MEMSIZE].exec++;
+            rob_head = (rob_head + 1) % ooo_rob;
+            rob_n--;
+            if(u->stat != STAT_AOK){
+                stat = u->stat;
+                goto done;
+            }
+        }
+
+        /* Issue the oldest ready uops, ooo_width of them, mem_ports to memory */
+        alu_n = mem_n = 0;
+        for(i = 0, k = rob_head; i < rob_n && alu_n + mem_n < ooo_width; i++, k = (k + 1) % ooo_rob){
+            u = &rob[k];
+            if(u->readyE || (u->mem ? mem_n >= mem_ports : 0))
+                continue;
+            for(j = 0; j < u->nsrc && ooo_ready(u, j, now); j++)
+                ;
+            if(j < u->nsrc)
+                continue;
+            u->mem ? mem_n++ : alu_n++;
+            rs_n--;
+            u->readyE = now + LAT_ALU;
+            u->readyM = u->readyE;
+            if(u->mem){             /* the D-cache delays a load, not a store */
+                long r = cache_range(&l1d, u->addr, 8, u->icode == I_RMMOVQ
+                    || u->icode == I_PUSHQ || u->icode == I_CALL, now);
+                u->readyM = (r > now ? r : now) + LAT_LOAD;
+                if(l1d.sets && u->addr + 8 <= MEMSIZE)
+                    l1d.access++;
+            }
+            if(u->icode == I_JMP && u->ifun != C_YES && u->stat == STAT_AOK){
+                prof[u->pc % MEMSIZE].branch++;
+                prof[u->pc % MEMSIZE].taken += u->taken;
+                prof[u->pc % MEMSIZE].miss += u->mispredict;
+                E.pc = u->pc;
+                E.pidx = u->pidx;
+                train(&E, u->taken);
+            }
+            else if(u->icode == I_RET && use_ras && u->stat == STAT_AOK){
+                prof[u->pc % MEMSIZE].branch++;
+                prof[u->pc % MEMSIZE].taken++;
+                prof[u->pc % MEMSIZE].miss += u->mispredict;
+            }
+            if(u->mispredict)       /* fetch the right path once resolved */
+                resume = u->icode == I_RET ? u->readyM : u->readyE;
+        }
+
+        /* Dispatch: rename into the ROB and the reservation stations */
+        for(n = 0; n < ooo_width && fq_n > 0 && fq[fq_head].fetched < now; n++){
+            if(rob_n == ooo_rob){
+                ooo_stall[0]++;
+                break;
+            }
+            if(rs_n == ooo_rs){
+                ooo_stall[1]++;
+                break;
+            }
+            k = (rob_head + rob_n) % ooo_rob;
+            u = &rob[k];
+            *u = fq[fq_head];
+            fq_head = (fq_head + 1) % fq_size;
+            fq_n--;
+            for(i = j = 0; i < u->nsrc; i++){
+                int r = u->src[i];
+                if(r == REG_NONE || rob[rat[r]].seq != ratseq[r])
+                    continue;
+                u->srcseq[j] = ratseq[r];
+                u->srcm[j] = ratm[r];
+                u->src[j++] = rat[r];
+            }
+            u->nsrc = j;
+            if(u->icode == I_MRMOVQ || u->icode == I_POPQ || u->icode == I_RET){
+                /* A load waits for the youngest older store it overlaps */
+                long youngest = -1;
+                for(i = 0; i < 8 && u->addr + i < MEMSIZE; i++){
+                    if(mstseq[u->addr + i] > youngest && rob[mst[u->addr + i]].seq
+                       == mstseq[u->addr + i]){
+                        youngest = mstseq[u->addr + i];
+                        u->src[u->nsrc] = mst[u->addr + i];
+                        u->srcseq[u->nsrc] = youngest;
+                        u->srcm[u->nsrc] = 0;
+                    }
+                }
+                if(youngest >= 0)
+                    u->nsrc++;
+            }
+            if(u->icode == I_RMMOVQ || u->icode == I_PUSHQ || u->icode == I_CALL){
+                for(i = 0; i < 8 && u->addr + i < MEMSIZE; i++){
+                    mst[u->addr + i] = k;
+                    mstseq[u->addr + i] = u->seq;
+                }
+            }
+            if(u->dste != REG_NONE){
+                rat[u->dste] = k;
+                ratseq[u->dste] = u->seq;
+                ratm[u->dste] = 0;
+            }
+            if(u->dstm != REG_NONE){
+                rat[u->dstm] = k;
+                ratseq[u->dstm] = u->seq;
+                ratm[u->dstm] = 1;
+            }
+            if(u->setcc){
+                rat[CC_REG] = k;
+                ratseq[CC_REG] = u->seq;
+                ratm[CC_REG] = 0;
+            }
+            rob_n++;
+            rs_n++;
+        }
+
+        /* Fetch up to a taken transfer, stopping behind a mispredict */
+        if(fetching && resume > now)
+            ooo_stall[wait_ret ? 3 : 2]++;
+        for(n = 0; fetching && resume <= now && n < ooo_width && fq_n < fq_size; n++){
+            fetch(&st, st.pc, &f);
+            if(cache_range(&l1i, st.pc, (int)(f.valP - st.pc), 0, now) > now){
+                ooo_stall[4]++;
+                break;
+            }
+            if(l1i.sets && st.pc < MEMSIZE)
+                l1i.access++;
+            u = &fq[(fq_head + fq_n++) % fq_size];
+            ooo_fetch(u, seq++, now);
+            if(u->stat != STAT_AOK)
+                fetching = 0;       /* nothing past an exception */
+            else if(u->mispredict){
+                resume = LONG_MAX;  /* until it issues */
+                wait_ret = u->icode == I_RET;
+            }
+            if(u->taken)
+                break;
+        }
+    }
+done:
+    return stat;
+}
+
+/*=========================== FAST ===========================*/
+
+/*
+ * A predecoded instruction of the fast mode, cached by PC. A destination
+ * of REG_NONE is FAST_NONE, a register nothing reads, so no handler tests
+ * for it; sources of REG_NONE read reg 15, which stays 0.
+ */
+struct dinstr {
+    const void *op;                 /* handler, decode until decoded */
+    int rA, rB, dst, ifun;
+    uint64_t valC, valP;
+};
+
+#define FAST_NONE   16
+
+static struct dinstr icache[MEMSIZE + 1];  /* [MEMSIZE]: PC past memory */
+
+/*
+ * run_fast - run st instruction by instruction like run_seq, dispatching
+ *            with computed gotos through the predecoded icache; return
+ *            the status, *steps the instructions (the excepting one counts)
+ */
+static int run_fast(long *steps){
+    static const void *alu_ops[4] = { &&addq, &&subq, &&andq, &&xorq };
+    static unsigned char cond_tab[16][8];   /* cond(cc, ifun) */
+    struct dinstr *ip;
+    struct instr in;
+    uint64_t r[FAST_NONE + 1], pc, a, v, k, lo = MEMSIZE, hi = 0;
+    long budget = maxcycles;
+    int cc = st.cc, stat, i, j;
+
+    for(i = 0; i < 16; i++)
+        for(j = 0; j < 8; j++)
+            cond_tab[i][j] = cond(j, i);
+    for(i = 0; i < MEMSIZE; i++)
+        icache[i].op = &&decode;
+    icache[MEMSIZE].op = &&bad_pc;
+    memcpy(r, st.reg, sizeof(st.reg));
+    r[REG_NONE] = r[FAST_NONE] = 0;
+    pc = st.pc;
+
+#define DISPATCH() do{ \
+    if(--budget < 0) goto out; \
+    ip = &icache[pc]; \
+    goto *ip->op; \
+}while(0)
+#define NEXT() do{ pc = ip->valP; DISPATCH(); }while(0)
+#define JUMP(t) do{ pc = (t); if(pc >= MEMSIZE) goto far_pc; DISPATCH(); }while(0)
+#define CHECK_ADDR(a) do{ if((a) > MEMSIZE - 8){ stat = STAT_ADR; goto done; } }while(0)
+#define WRITTEN(a) do{ \
+    if((a) + 8 > lo && (a) < hi) \
+        for(k = (a) >= 9 ? (a) - 9 : 0; k < (a) + 8; k++) \
+            icache[k].op = &&decode; \
+}while(0)
+
+    JUMP(pc);
+
+decode:
+    stat = fetch(&st, pc, &in);
+    ip->rA = in.rA;
+    ip->rB = in.rB;
+    ip->ifun = in.ifun;
+    ip->valC = in.valC;
+    ip->valP = in.valP;
+    ip->dst = FAST_NONE;
+    if(pc < lo) lo = pc;
+    if(pc + 10 > hi) hi = pc + 10;
+    if(stat != STAT_AOK){
+        ip->op = &&stop;
+        ip->valC = stat;
+        goto stop;
+    }
+    switch(in.icode){
+        case I_NOP: ip->op = &&nop; break;
+        case I_RRMOVQ: ip->op = in.ifun == C_YES ? &&rrmovq : &&cmovxx; break;
+        case I_IRMOVQ: ip->op = &&irmovq; break;
+        case I_RMMOVQ: ip->op = &&rmmovq; break;
+        case I_MRMOVQ: ip->op = &&mrmovq; break;
+        case I_ALU: ip->op = in.ifun <= A_XOR ? alu_ops[in.ifun] : &&aluxx; break;
+        case I_JMP: ip->op = in.ifun == C_YES ? &&jmp : &&jxx; break;
+        case I_CALL: ip->op = &&call; break;
+        case I_RET: ip->op = &&ret; break;
+        case I_PUSHQ: ip->op = &&pushq; break;
+        case I_POPQ: ip->op = &&popq; break;
+        case I_IADDQ: ip->op = &&iaddq; break;
+    }
+    if(in.icode == I_MRMOVQ || in.icode == I_POPQ)
+        ip->dst = in.rA;
+    else if(in.icode == I_RRMOVQ || in.icode == I_IRMOVQ || in.icode == I_ALU
+         || in.icode == I_IADDQ)
+        ip->dst = in.rB;
+    if(ip->dst == REG_NONE)
+        ip->dst = FAST_NONE;
+    goto *ip->op;
+
+nop:
+    NEXT();
+rrmovq:
+    r[ip->dst] = r[ip->rA];
+    NEXT();
+cmovxx:
+    if(cond_tab[ip->ifun][cc])
+        r[ip->dst] = r[ip->rA];
+    NEXT();
+irmovq:
+    r[ip->dst] = ip->valC;
+    NEXT();
+rmmovq:
+    a = r[ip->rB] + ip->valC;
+    CHECK_ADDR(a);
+    memcpy(st.mem + a, &r[ip->rA], 8);
+    WRITTEN(a);
+    NEXT();
+mrmovq:
+    a = r[ip->rB] + ip->valC;
+    CHECK_ADDR(a);
+    memcpy(&r[ip->dst], st.mem + a, 8);
+    NEXT();
+addq:
+    v = r[ip->rB] + r[ip->rA];
+    cc = alu_cc(A_ADD, r[ip->rA], r[ip->rB], v);
+    r[ip->dst] = v;
+    NEXT();
+subq:
+    v = r[ip->rB] - r[ip->rA];
+    cc = alu_cc(A_SUB, r[ip->rA], r[ip->rB], v);
+    r[ip->dst] = v;
+    NEXT();
+andq:
+    v = r[ip->rB] & r[ip->rA];
+    cc = alu_cc(A_AND, r[ip->rA], r[ip->rB], v);
+    r[ip->dst] = v;
+    NEXT();
+xorq:
+    v = r[ip->rB] ^ r[ip->rA];
+    cc = alu_cc(A_XOR, r[ip->rA], r[ip->rB], v);
+    r[ip->dst] = v;
+    NEXT();
+aluxx:                                  /* as seq_step: result 0, flags of 0 */
+    cc = alu_cc(ip->ifun, r[ip->rA], r[ip->rB], 0);
+    r[ip->dst] = 0;
+    NEXT();
+iaddq:
+    v = r[ip->rB] + ip->valC;
+    cc = alu_cc(A_ADD, ip->valC, r[ip->rB], v);
+    r[ip->dst] = v;
+    NEXT();
+jmp:
+    JUMP(ip->valC);
+jxx:
+    if(cond_tab[ip->ifun][cc])
+        JUMP(ip->valC);
+    NEXT();
+call:
+    a = r[REG_RSP] - 8;
+    CHECK_ADDR(a);
+    memcpy(st.mem + a, &ip->valP, 8);
+    r[REG_RSP] = a;
+    WRITTEN(a);
+    JUMP(ip->valC);
+ret:
+    a = r[REG_RSP];
+    CHECK_ADDR(a);
+    memcpy(&v, st.mem + a, 8);
+    r[REG_RSP] = a + 8;
+    JUMP(v);
+pushq:
+    a = r[REG_RSP] - 8;
+    CHECK_ADDR(a);
+    memcpy(st.mem + a, &r[ip->rA], 8);
+    r[REG_RSP] = a;
+    WRITTEN(a);
+    NEXT();
+popq:
+    a = r[REG_RSP];
+    CHECK_ADDR(a);
+    r[REG_RSP] = a + 8;
+    memcpy(&r[ip->dst], st.mem + a, 8);
+    NEXT();
+stop:
+    stat = (int)ip->valC;
+    goto done;
+far_pc:
+    if(--budget < 0)
+        goto out;
+bad_pc:
+    stat = STAT_ADR;
+    goto done;
+out:
+    budget = 0;
+    stat = STAT_AOK;
+done:
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef CHECK_ADDR
+#undef WRITTEN
+    *steps = maxcycles - budget;
+    memcpy(st.reg, r, sizeof(st.reg));
+    st.reg[REG_NONE] = 0;
+    st.cc = cc;
+    st.pc = pc;
+    return stat;
+}
+
+/*=========================== JIT ===========================*/
+
+#if defined(__x86_64__)
+
+#define JIT_BUFSIZE     (1 << 20)   /* bytes of generated code */
+#define JIT_MAXINSTRS   64          /* instructions of a block */
+#define JIT_BLOCKMAX    (JIT_MAXINSTRS * 160 + 128) /* bytes of a block, at most */
+#define JIT_MAXEXITS    16384       /* chained exits between flushes */
+#define JIT_HOT         2           /* entries before a block is translated */
+
+/* Why generated code returned to run_jit */
+#define EXIT_LOOKUP     0           /* continue at pc */
+#define EXIT_FAULT      1           /* the instruction at pc faults */
+#define EXIT_SMC        2           /* a store hit translated code */
+#define EXIT_BUDGET     3           /* fewer than a block of instructions left */
+#define EXIT_CHAIN      4           /* + exit index, jump to pc not yet linked */
+
+/* State the generated code works on, at %r15 */
+struct jit_ctx {
+    uint64_t reg[16];               /* reg[REG_NONE] stays 0 */
+    uint64_t budget;                /* instructions left */
+    uint64_t flags;                 /* OF | lahf << 8 of the last ALU op */
+};
+
+/* Returned in %rax:%rdx */
+struct jit_exit {
+    uint64_t pc, reason;
+};
+
+#define CTX_REG(r)  (int)(offsetof(struct jit_ctx, reg) + 8 * (r))
+#define CTX_BUDGET  (int)offsetof(struct jit_ctx, budget)
+#define CTX_FLAGS   (int)offsetof(struct jit_ctx, flags)
+
+/* Host registers */
+#define RAX 0
+#define RCX 1
+#define RDX 2
+
+/* A branch of a block to a stub emitted after the body */
+struct jit_fix {
+    unsigned char *rel;             /* rel32 to point at the stub */
+    int reason, k;                  /* EXIT_*; the instruction */
+    uint64_t pc;
+};
+
+static struct jit_ctx ctx;
+static unsigned char *jit_buf, *jit_ptr;
+static struct jit_exit (*jit_enter)(struct jit_ctx *, unsigned char *, unsigned char *,
+    void **, void *);
+static unsigned char *jit_epilogue;
+static void *jit_blocks[MEMSIZE];           /* translation of a PC */
+static unsigned char jit_codemap[MEMSIZE];  /* bytes of translated code */
+static unsigned char *jit_exits[JIT_MAXEXITS];  /* rel32 of chained exits */
+static int jit_nexits;
+static unsigned char jit_hits[MEMSIZE];
+
+/* Condition codes of x86 for jXX/cmovXX, by ifun */
+static const unsigned char x86_cc[7] = { 0, 0xE, 0xC, 0x4, 0x5, 0xD, 0xF };
+
+static void eb(int b){
+    *jit_ptr++ = (unsigned char)b;
+}
+
+static void e32(uint32_t v){
+    memcpy(jit_ptr, &v, 4);
+    jit_ptr += 4;
+}
+
+static void e64(uint64_t v){
+    memcpy(jit_ptr, &v, 8);
+    jit_ptr += 8;
+}
+
+/* op reg, [%r15 + disp]; rex 0x49 for 64 bits, 0x41 for 32 */
+static void e_ctx(int rex, int op, int reg, int disp){
+    eb(rex);
+    eb(op);
+    eb(0x87 | reg << 3);
+    e32(disp);
+}
+
+static void e_load(int reg, int yreg){
+    e_ctx(0x49, 0x8B, reg, CTX_REG(yreg));
+}
+
+static void e_store(int reg, int yreg){
+    if(yreg != REG_NONE)
+        e_ctx(0x49, 0x89, reg, CTX_REG(yreg));
+}
+
+static void e_imm(int reg, uint64_t v){       /* mov $v, reg */
+    eb(0x48);
+    eb(0xB8 + reg);
+    e64(v);
+}
+
+/* jcc rel32 (cc < 0: jmp), return the rel32 */
+static unsigned char *e_jump(int cc){
+    if(cc < 0)
+        eb(0xE9);
+    else{
+        eb(0x0F);
+        eb(0x80 | cc);
+    }
+    e32(0);
+    return jit_ptr - 4;
+}
+
+static void patch(unsigned char *rel, const void *to){
+    int32_t d = (int32_t)((const unsigned char *)to - (rel + 4));
+    memcpy(rel, &d, 4);
+}
+
+/* After an ALU op whose result was stored: lahf; seto %al; mov %rax, flags */
+static void e_save_flags(void){
+    eb(0x9F);
+    eb(0x0F); eb(0x90); eb(0xC0);
+    e_ctx(0x49, 0x89, RAX, CTX_FLAGS);
+}
+
+/* mov flags, %eax; add $0x7f, %al (OF); sahf (SF, ZF) */
+static void e_load_flags(void){
+    e_ctx(0x41, 0x8B, RAX, CTX_FLAGS);
+    eb(0x04); eb(0x7F);
+    eb(0x9E);
+}
+
+/* cmp $MEMSIZE - 8, %rax; ja fault */
+static void e_check_addr(struct jit_fix *fix, int *nfix, int k, uint64_t pc){
+    eb(0x48); eb(0x3D); e32(MEMSIZE - 8);
+    fix[*nfix].rel = e_jump(0x7);
+    fix[*nfix].reason = EXIT_FAULT;
+    fix[*nfix].k = k;
+    fix[(*nfix)++].pc = pc;
+}
+
+/* After a store to [%r14 + %rax]: cmpq $0, (%r13, %rax); jne smc */
+static void e_check_smc(struct jit_fix *fix, int *nfix, int k, uint64_t next){
+    eb(0x49); eb(0x83); eb(0x7C); eb(0x05); eb(0x00); eb(0x00);
+    fix[*nfix].rel = e_jump(0x5);
+    fix[*nfix].reason = EXIT_SMC;
+    fix[*nfix].k = k;
+    fix[(*nfix)++].pc = next;
+}
+
+/* Exit of a block to a constant pc, linked now or on first use */
+static void e_chain(unsigned char *rel, struct jit_fix *fix, int *nfix, uint64_t pc){
+    if(pc < MEMSIZE && jit_blocks[pc] != NULL){
+        patch(rel, jit_blocks[pc]);
+        return;
+    }
+    fix[*nfix].rel = rel;
+    fix[*nfix].reason = EXIT_CHAIN;
+    fix[*nfix].k = 0;
+    fix[(*nfix)++].pc = pc;
+}
+
+/*
+ * jit_flush - drop every translation, with the entry and exit code
+ *             regenerated at the start of the buffer
+ */
+static void jit_flush(void){
+    memset(jit_blocks, 0, sizeof(jit_blocks));
+    memset(jit_codemap, 0, sizeof(jit_codemap));
+    jit_nexits = 0;
+    jit_ptr = jit_buf;
+
+    /* entry(ctx, mem, codemap, blocks, code): save callee-saved, jump */
+    jit_enter = (struct jit_exit (*)(struct jit_ctx *, unsigned char *, unsigned char *,
+        void **, void *))(void *)jit_ptr;
+    eb(0x53); eb(0x55);                         /* push %rbx, %rbp */
+    eb(0x41); eb(0x54); eb(0x41); eb(0x55);     /* push %r12, %r13 */
+    eb(0x41); eb(0x56); eb(0x41); eb(0x57);     /* push %r14, %r15 */
+    eb(0x49); eb(0x89); eb(0xFF);               /* mov %rdi, %r15 */
+    eb(0x49); eb(0x89); eb(0xF6);               /* mov %rsi, %r14 */
+    eb(0x49); eb(0x89); eb(0xD5);               /* mov %rdx, %r13 */
+    eb(0x49); eb(0x89); eb(0xCC);               /* mov %rcx, %r12 */
+    eb(0x41); eb(0xFF); eb(0xE0);               /* jmp *%r8 */
+    jit_epilogue = jit_ptr;
+    eb(0x41); eb(0x5F); eb(0x41); eb(0x5E);     /* pop %r15, %r14 */
+    eb(0x41); eb(0x5D); eb(0x41); eb(0x5C);     /* pop %r13, %r12 */
+    eb(0x5D); eb(0x5B);                         /* pop %rbp, %rbx */
+    eb(0xC3);
+}
+
+static int jit_supported(const struct instr *in){
+    switch(in->icode){
+        case I_NOP: case I_IRMOVQ: case I_RMMOVQ: case I_MRMOVQ: case I_CALL:
+        case I_RET: case I_PUSHQ: case I_POPQ: case I_IADDQ:
+            return 1;
+        case I_RRMOVQ: case I_JMP:
+            return in->ifun <= C_G;
+        case I_ALU:
+            return in->ifun <= A_XOR;
+    }
+    return 0;
+}
+
+/*
+ * jit_translate - translate the block at pc, return its code or NULL if
+ *                 the first instruction is left to seq_step (halt, a
+ *                 fault of fetch, an invalid code)
+ */
+static void *jit_translate(uint64_t pc){
+    static const unsigned char alu_op[4] = { 0x01, 0x29, 0x21, 0x31 };
+    struct jit_fix fix[2 * JIT_MAXINSTRS + 4];
+    struct instr in;
+    unsigned char *start = jit_ptr, *cmp_n, *sub_n;
+    uint64_t start_pc = pc, a;
+    int n = 0, nfix = 0, i, end = 0;
+
+    /* cmpq $n, budget; jb exit; subq $n, budget */
+    e_ctx(0x49, 0x81, 7, CTX_BUDGET);
+    cmp_n = jit_ptr;
+    e32(0);
+    fix[nfix].rel = e_jump(0x2);
+    fix[nfix].reason = EXIT_BUDGET;
+    fix[nfix].k = 0;
+    fix[nfix++].pc = pc;
+    e_ctx(0x49, 0x81, 5, CTX_BUDGET);
+    sub_n = jit_ptr;
+    e32(0);
+
+    while(!end){
+        if(pc >= MEMSIZE || n == JIT_MAXINSTRS || fetch(&st, pc, &in) != STAT_AOK
+           || !jit_supported(&in)){
+            if(n == 0){
+                jit_ptr = start;
+                return NULL;
+            }
+            e_chain(e_jump(-1), fix, &nfix, pc);
+            break;
+        }
+        for(a = pc; a < in.valP; a++)
+            jit_codemap[a] = 1;
+
+        switch(in.icode){
+            case I_NOP:
+                break;
+            case I_RRMOVQ:
+                if(in.ifun == C_YES){
+                    e_load(RAX, in.rA);
+                    e_store(RAX, in.rB);
+                    break;
+                }
+                e_load_flags();
+                e_load(RCX, in.rA);
+                e_load(RDX, in.rB);
+                eb(0x48); eb(0x0F); eb(0x40 | x86_cc[in.ifun]); eb(0xD1);  /* cmov %rcx, %rdx */
+                e_store(RDX, in.rB);
+                break;
+            case I_IRMOVQ:
+                if(in.rB != REG_NONE){
+                    e_imm(RAX, in.valC);
+                    e_store(RAX, in.rB);
+                }
+                break;
+            case I_RMMOVQ:
+            case I_MRMOVQ:
+                e_load(RAX, in.rB);
+                e_imm(RCX, in.valC);
+                eb(0x48); eb(0x01); eb(0xC8);                   /* add %rcx, %rax */
+                e_check_addr(fix, &nfix, n, pc);
+                if(in.icode == I_MRMOVQ){
+                    eb(0x49); eb(0x8B); eb(0x0C); eb(0x06);     /* mov (%r14,%rax), %rcx */
+                    e_store(RCX, in.rA);
+                    break;
+                }
+                e_load(RCX, in.rA);
+                eb(0x49); eb(0x89); eb(0x0C); eb(0x06);         /* mov %rcx, (%r14,%rax) */
+                e_check_smc(fix, &nfix, n, in.valP);
+                break;
+            case I_ALU:
+            case I_IADDQ:
+                e_load(RAX, in.rB);
+                if(in.icode == I_IADDQ)
+                    e_imm(RCX, in.valC);
+                else
+                    e_load(RCX, in.rA);
+                eb(0x48); eb(in.icode == I_IADDQ ? 0x01 : alu_op[in.ifun]); eb(0xC8);
+                e_store(RAX, in.rB);
+                e_save_flags();
+                break;
+            case I_JMP:
+                if(in.ifun != C_YES){
+                    e_load_flags();
+                    e_chain(e_jump(x86_cc[in.ifun]), fix, &nfix, in.valC);
+                    e_chain(e_jump(-1), fix, &nfix, in.valP);
+                }
+                else
+                    e_chain(e_jump(-1), fix, &nfix, in.valC);
+                end = 1;
+                break;
+            case I_CALL:
+            case I_PUSHQ:
+                if(in.icode == I_PUSHQ)
+                    e_load(RCX, in.rA);
+                else
+                    e_imm(RCX, in.valP);
+                e_load(RAX, REG_RSP);
+                eb(0x48); eb(0x83); eb(0xE8); eb(0x08);         /* sub $8, %rax */
+                e_check_addr(fix, &nfix, n, pc);
+                eb(0x49); eb(0x89); eb(0x0C); eb(0x06);         /* mov %rcx, (%r14,%rax) */
+                e_store(RAX, REG_RSP);
+                if(in.icode == I_PUSHQ){
+                    e_check_smc(fix, &nfix, n, in.valP);
+                    break;
+                }
+                e_check_smc(fix, &nfix, n, in.valC);
+                e_chain(e_jump(-1), fix, &nfix, in.valC);
+                end = 1;
+                break;
+            case I_RET:
+            case I_POPQ:
+                e_load(RAX, REG_RSP);
+                e_check_addr(fix, &nfix, n, pc);
+                eb(0x49); eb(0x8B); eb(0x0C); eb(0x06);         /* mov (%r14,%rax), %rcx */
+                eb(0x48); eb(0x83); eb(0xC0); eb(0x08);         /* add $8, %rax */
+                e_store(RAX, REG_RSP);
+                if(in.icode == I_POPQ){
+                    e_store(RCX, in.rA);
+                    break;
+                }
+                /* Indirect: the block of %rcx if translated, else exit */
+                eb(0x48); eb(0x89); eb(0xC8);                   /* mov %rcx, %rax */
+                eb(0x48); eb(0x3D); e32(MEMSIZE);               /* cmp $MEMSIZE, %rax */
+                fix[nfix].rel = e_jump(0x3);                    /* jae */
+                fix[nfix].reason = EXIT_LOOKUP;
+                fix[nfix++].k = n + 1;
+                eb(0x49); eb(0x8B); eb(0x0C); eb(0xC4);         /* mov (%r12,%rax,8), %rcx */
+                eb(0x48); eb(0x85); eb(0xC9);                   /* test %rcx, %rcx */
+                fix[nfix].rel = e_jump(0x4);                    /* jz */
+                fix[nfix].reason = EXIT_LOOKUP;
+                fix[nfix++].k = n + 1;
+                eb(0xFF); eb(0xE1);                             /* jmp *%rcx */
+                end = 1;
+                break;
+        }
+        n++;
+        pc = in.valP;
+    }
+    memcpy(cmp_n, &n, 4);
+    memcpy(sub_n, &n, 4);
+
+    /* Stubs: give back the budget of what did not run, return pc and why */
+    for(i = 0; i < nfix; i++){
+        patch(fix[i].rel, jit_ptr);
+        if(fix[i].reason == EXIT_FAULT || fix[i].reason == EXIT_SMC){
+            e_ctx(0x49, 0x81, 0, CTX_BUDGET);
+            e32(n - fix[i].k - (fix[i].reason == EXIT_SMC));
+        }
+        if(fix[i].reason != EXIT_LOOKUP)
+            e_imm(RAX, fix[i].pc);
+        eb(0xBA);                                               /* mov $reason, %edx */
+        if(fix[i].reason == EXIT_CHAIN){
+            jit_exits[jit_nexits] = fix[i].rel;
+            e32(EXIT_CHAIN + jit_nexits++);
+        }
+        else
+            e32(fix[i].reason);
+        patch(e_jump(-1), jit_epilogue);
+    }
+    jit_blocks[start_pc] = start;
+    return start;
+}
+
+/*
+ * jit_step - one instruction on seq_step with the JIT state, dropping the
+ *            translations if it stores into them; return its status
+ */
+static int jit_step(uint64_t pc){
+    struct instr in;
+    uint64_t a = MEMSIZE;
+    int stat, i;
+
+    memcpy(st.reg, ctx.reg, sizeof(st.reg));
+    st.cc = ((ctx.flags & 0x4000) ? CC_ZF : 0) | ((ctx.flags & 0x8000) ? CC_SF : 0)
+        | ((ctx.flags & 0xFF) ? CC_OF : 0);
+    st.pc = pc;
+    if(fetch(&st, pc, &in) == STAT_AOK){
+        if(in.icode == I_RMMOVQ)
+            a = st.reg[in.rB] + in.valC;
+        else if(in.icode == I_PUSHQ || in.icode == I_CALL)
+            a = st.reg[REG_RSP] - 8;
+    }
+    stat = seq_step(&st);
+    ctx.budget--;
+    memcpy(ctx.reg, st.reg, sizeof(st.reg));
+    ctx.flags = ((st.cc & CC_ZF) ? 0x4000 : 0) | ((st.cc & CC_SF) ? 0x8000 : 0)
+        | ((st.cc & CC_OF) ? 1 : 0) | 0x200;
+    if(stat == STAT_AOK && a <= MEMSIZE - 8)
+        for(i = 0; i < 8; i++)
+            if(jit_codemap[a + i]){
+                jit_flush();
+                break;
+            }
+    return stat;
+}
+
+/*
+ * run_jit - run st like run_seq, hot blocks translated to x86-64 and
+ *           chained; return the status, *steps the instructions
+ */
+static int run_jit(long *steps){
+    struct jit_exit x;
+    struct instr in;
+    uint64_t pc = st.pc;
+    void *b;
+    int stat = STAT_AOK, more;
+
+    if(jit_buf == NULL){
+        jit_buf = mmap(NULL, JIT_BUFSIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(jit_buf == MAP_FAILED){
+            jit_buf = NULL;
+            fprintf(stderr, "no executable memory, running -t instead\n");
+            return run_fast(steps);
+        }
+    }
+    jit_flush();
+    memset(jit_hits, 0, sizeof(jit_hits));
+    memcpy(ctx.reg, st.reg, sizeof(st.reg));
+    ctx.reg[REG_NONE] = 0;
+    ctx.budget = maxcycles;
+    ctx.flags = ((st.cc & CC_ZF) ? 0x4000 : 0) | ((st.cc & CC_SF) ? 0x8000 : 0)
+        | ((st.cc & CC_OF) ? 1 : 0) | 0x200;
+
+    while(stat == STAT_AOK && ctx.budget > 0){
+        b = NULL;
+        if(pc < MEMSIZE && (b = jit_blocks[pc]) == NULL && jit_hits[pc] >= JIT_HOT){
+            if(jit_buf + JIT_BUFSIZE - jit_ptr < JIT_BLOCKMAX
+               || jit_nexits > JIT_MAXEXITS - 2 * JIT_MAXINSTRS - 4)
+                jit_flush();
+            b = jit_translate(pc);
+        }
+        if(b == NULL){
+            /* Cold or untranslatable: interpret up to a control transfer */
+            if(pc < MEMSIZE && jit_hits[pc] < JIT_HOT)
+                jit_hits[pc]++;
+            do{
+                more = fetch(&st, pc, &in) == STAT_AOK && in.icode != I_JMP
+                    && in.icode != I_CALL && in.icode != I_RET;
+                stat = jit_step(pc);
+                pc = st.pc;
+            }while(more && stat == STAT_AOK && ctx.budget > 0);
+            continue;
+        }
+        x = jit_enter(&ctx, st.mem, jit_codemap, jit_blocks, b);
+        pc = x.pc;
+        if(x.reason == EXIT_FAULT || (x.reason == EXIT_BUDGET && ctx.budget > 0)){
+            stat = jit_step(pc);
+            pc = st.pc;
+        }
+        else if(x.reason == EXIT_SMC)
+            jit_flush();
+        else if(x.reason >= EXIT_CHAIN && pc < MEMSIZE && jit_blocks[pc] == NULL
+                && jit_hits[pc] >= JIT_HOT){
+            unsigned char *rel = jit_exits[x.reason - EXIT_CHAIN];
+            if(jit_buf + JIT_BUFSIZE - jit_ptr >= JIT_BLOCKMAX
+               && jit_nexits <= JIT_MAXEXITS - 2 * JIT_MAXINSTRS - 4
+               && (b = jit_translate(pc)) != NULL)
+                patch(rel, b);
+        }
+        else if(x.reason >= EXIT_CHAIN && pc < MEMSIZE && jit_blocks[pc] != NULL)
+            patch(jit_exits[x.reason - EXIT_CHAIN], jit_blocks[pc]);
+    }
+    *steps = maxcycles - ctx.budget;
+    memcpy(st.reg, ctx.reg, sizeof(st.reg));
+    st.cc = ((ctx.flags & 0x4000) ? CC_ZF : 0) | ((ctx.flags & 0x8000) ? CC_SF : 0)
+        | ((ctx.flags & 0xFF) ? CC_OF : 0);
+    st.pc = pc;
+    return stat;
+}
+
+#else
+
+static int run_jit(long *steps){
+    fprintf(stderr, "the JIT needs an x86-64 host, running -t instead\n");
+    return run_fast(steps);
+}
+
+#endif /* __x86_64__ */
+
+/*=========================== REPORTS ===========================*/
+
+/*
+ * label_at - the label at address addr, or NULL
+ */
+static const char *label_at(uint64_t addr){
+    int i;
+    for(i = 0; i < nlabels; i++)
+        if(labels[i].addr == addr)
+            return labels[i].name;
+    return NULL;
+}
+
+static uint64_t label_addr(const char *name){
+    int i;
+    for(i = 0; i < nlabels; i++)
+        if(strcmp(labels[i].name, name) == 0)
+            return labels[i].addr;
+    return MEMSIZE;
+}
+
+/*
+ * disasm - write the instruction at pc into buf, return its length
+ */
+static int disasm(const struct state *s, uint64_t pc, char *buf){
+    struct instr in;
+    const char *l;
+    int i, stat = fetch(s, pc, &in);
+
+    if(stat == STAT_ADR || stat == STAT_INS){
+        strcpy(buf, "(bad)");
+        return 1;
+    }
+    for(i = 0; i < NMNEMONICS; i++)
+        if(mnemonics[i].icode == in.icode && (mnemonics[i].ifun == in.ifun
+           || !(in.icode == I_RRMOVQ || in.icode == I_ALU || in.icode == I_JMP)))
+            break;
+    if(i == NMNEMONICS){
+        strcpy(buf, "(bad)");
+        return 1;
+    }
+    switch(mnemonics[i].fmt){
+        case FMT_NONE:
+            sprintf(buf, "%s", mnemonics[i].name);
+            break;
+        case FMT_RR:
+            sprintf(buf, "%s %s, %s", mnemonics[i].name, reg_names[in.rA], reg_names[in.rB]);
+            break;
+        case FMT_IR:
+            sprintf(buf, "%s $%lld, %s", mnemonics[i].name, (long long)in.valC, reg_names[in.rB]);
+            break;
+        case FMT_RM:
+            sprintf(buf, "%s %s, %lld(%s)", mnemonics[i].name, reg_names[in.rA],
+                (long long)in.valC, reg_names[in.rB]);
+            break;
+        case FMT_MR:
+            sprintf(buf, "%s %lld(%s), %s", mnemonics[i].name, (long long)in.valC,
+                reg_names[in.rB], reg_names[in.rA]);
+            break;
+        case FMT_DEST:
+            if((l = label_at(in.valC)) != NULL)
+                sprintf(buf, "%s %s", mnemonics[i].name, l);
+            else
+                sprintf(buf, "%s 0x%llx", mnemonics[i].name, (unsigned long long)in.valC);
+            break;
+        case FMT_R:
+            sprintf(buf, "%s %s", mnemonics[i].name, reg_names[in.rA]);
+            break;
+    }
+    return (int)(in.valP - pc);
+}
+
+/*
+ * print_state - print the registers and memory words changed by the run,
+ *               as yis does
+ */
+static void print_state(void){
+    uint64_t a, v0, v1;
+    int i;
+
+    printf("Changes to registers:\n");
+    for(i = 0; i < 15; i++)
+        if(st.reg[i] != init.reg[i])
+            printf("%s:\t0x%016llx\t0x%016llx\n", reg_names[i],
+                (unsigned long long)init.reg[i], (unsigned long long)st.reg[i]);
+    printf("\nChanges to memory:\n");
+    for(a = 0; a < MEMSIZE; a += 8){
+        get_quad(&init, a, &v0);
+        get_quad(&st, a, &v1);
+        if(v0 != v1)
+            printf("0x%04llx:\t0x%016llx\t0x%016llx\n", (unsigned long long)a,
+                (unsigned long long)v0, (unsigned long long)v1);
+    }
+}
+
+static uint64_t total_lost(const struct prof *p){
+    uint64_t t = 0;
+    int i;
+    for(i = 0; i < NLOST; i++)
+        t += p->lost[i];
+    return t;
+}
+
+static int cmp_lost(const void *a, const void *b){
+    const struct prof *pa = &prof[*(const int *)a], *pb = &prof[*(const int *)b];
+    uint64_t ta = total_lost(pa), tb = total_lost(pb);
+    if(ta != tb)
+        return ta < tb ? 1 : -1;
+    return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * print_branches - print the mispredict rate of every jXX (and ret, with
+ *                  -r) under the predictor in use
+ */
+static void print_branches(void){
+    uint64_t branch = 0, miss = 0;
+    char text[64];
+    const char *l;
+    int i;
+
+    for(i = 0; i < MEMSIZE; i++){
+        branch += prof[i].branch;
+        miss += prof[i].miss;
+    }
+    printf("\nPredictor %s%s: %llu of %llu mispredicted (%.1f%%)\n",
+        pred_names[predictor], use_ras ? " + RAS" : "", (unsigned long long)miss,
+        (unsigned long long)branch, branch ? 100.0 * miss / branch : 0.0);
+    if(branch == 0)
+        return;
+    printf("%-6s %-10s %-28s %9s %7s %9s %7s\n", "PC", "label", "instruction",
+        "resolved", "taken", "mispred", "rate");
+    for(i = 0; i < MEMSIZE; i++){
+        const struct prof *p = &prof[i];
+        if(p->branch == 0)
+            continue;
+        disasm(&st, i, text);
+        l = label_at(i);
+        printf("0x%04x %-10s %-28s %9llu %6.1f%% %9llu %6.1f%%\n", i, l ? l : "", text,
+            (unsigned long long)p->branch, 100.0 * p->taken / p->branch,
+            (unsigned long long)p->miss, 100.0 * p->miss / p->branch);
+    }
+}
+
+/*
+ * print_ooo - print the configuration of the out-of-order model and the
+ *             cycles its dispatch and fetch stalled
+ */
+static void print_ooo(void){
+    printf("Out-of-order: width %d, ROB %d, RS %d, predictor %s%s\n", ooo_width, ooo_rob,
+        ooo_rs, pred_names[predictor], use_ras ? " + RAS" : "");
+    printf("Stalls: dispatch ROB full %ld, RS full %ld; fetch mispredict %ld, ret %ld, "
+        "icache %ld\n", ooo_stall[0], ooo_stall[1], ooo_stall[2], ooo_stall[3], ooo_stall[4]);
+}
+
+/*
+ * print_caches - print the geometry and the miss counts of the caches
+ */
+static void print_caches(void){
+    static const char *names[2] = { "I-cache", "D-cache" };
+    const struct cache *c;
+    int i;
+
+    for(i = 0; i < 2; i++){
+        c = i ? &l1d : &l1i;
+        if(!c->sets)
+            continue;
+        printf("%s %d B, %d-way, %d B blocks, %d-cycle miss: %llu accesses, %llu misses "
+            "(%.1f%%), %llu writebacks\n", names[i], c->size, c->ways, c->block, c->penalty,
+            (unsigned long long)c->access, (unsigned long long)c->miss,
+            c->access ? 100.0 * c->miss / c->access : 0.0, (unsigned long long)c->writeback);
+    }
+}
+
+/*
+ * print_profile - print the lost cycles by cause, then every instruction
+ *                 that retired or lost cycles, most lost first
+ */
+static void print_profile(long cycles, long instrs){
+    static int pcs[MEMSIZE];
+    char text[64];
+    const char *l;
+    int i, j, n = 0;
+
+    printf("\nLost cycles: %ld of %ld (%.1f%%)\n", cycles - instrs, cycles,
+        cycles ? 100.0 * (cycles - instrs) / cycles : 0.0);
+    for(i = 0; i < NLOST; i++)
+        printf("  %-10s %8llu\n", lost_names[i], (unsigned long long)lost[i]);
+
+    for(i = 0; i < MEMSIZE; i++)
+        if(prof[i].exec || total_lost(&prof[i]))
+            pcs[n++] = i;
+    qsort(pcs, n, sizeof(pcs[0]), cmp_lost);
+    printf("\n%-6s %-10s %-28s %9s", "PC", "label", "instruction", "exec");
+    for(j = 1; j < NLOST; j++)
+        printf(" %10s", lost_names[j]);
+    printf(" %8s\n", "lost");
+    for(i = 0; i < n; i++){
+        const struct prof *p = &prof[pcs[i]];
+        disasm(&st, pcs[i], text);
+        l = label_at(pcs[i]);
+        printf("0x%04x %-10s %-28s %9llu", pcs[i], l ? l : "", text,
+            (unsigned long long)p->exec);
+        for(j = 1; j < NLOST; j++)
+            printf(" %10llu", (unsigned long long)p->lost[j]);
+        printf(" %8llu\n", (unsigned long long)total_lost(p));
+    }
+
+    print_branches();
+}
+
+/*
+ * check_ncopy - check the result of the ncopy driver for len words:
+ *               the count in %rax, the copy, and the words around dest
+ */
+static int check_ncopy(int len){
+    uint64_t src = label_addr("src"), dest = label_addr("dest"), v = 0, w = 0;
+    long want = len - len / 3;
+    int i, ok = 1;
+
+    if((int64_t)st.reg[0] != want)
+        ok = 0;
+    for(i = 0; i < len; i++){
+        get_quad(&st, src + 8 * i, &v);
+        get_quad(&st, dest + 8 * i, &w);
+        if(v != w)
+            ok = 0;
+    }
+    get_quad(&st, dest - 8, &v);
+    get_quad(&st, dest + 8 * len, &w);
+    if(v != 0xbcdefa || w != 0xdefabc)
+        ok = 0;
+    if(verbose || !ok)
+        printf("ncopy len %d: count %lld (want %ld), %s\n", len,
+            (long long)st.reg[0], want, ok ? "OK" : "WRONG");
+    return ok;
+}
+
+/*
+ * compare - run SEQ, PIPE, the fast mode and the JIT from init, print
+ *           each and return whether all final states agree
+ */
+static int compare(void){
+    static const char *names[4] = { "SEQ", "PIPE", "fast", "JIT" };
+    static struct state res[4];
+    long n[4], cycles;
+    double secs;
+    clock_t t0;
+    int stat[4], i, ok = 1;
+
+    for(i = 0; i < 4; i++){
+        st = init;
+        t0 = clock();
+        if(i == 0)
+            stat[i] = run_seq(&n[i]);
+        else if(i == 1)
+            stat[i] = run_pipe(&cycles, &n[i]);
+        else if(i == 2)
+            stat[i] = run_fast(&n[i]);
+        else
+            stat[i] = run_jit(&n[i]);
+        secs = (double)(clock() - t0) / CLOCKS_PER_SEC;
+        res[i] = st;
+        if(stat[i] != stat[0] || n[i] != n[0] || res[i].pc != res[0].pc
+         || res[i].cc != res[0].cc || memcmp(res[i].reg, res[0].reg, sizeof(st.reg))
+         || memcmp(res[i].mem, res[0].mem, MEMSIZE))
+            ok = 0;
+        printf("%-5s %10ld instructions at PC = 0x%llx, status '%s', CC %d  %8.1f MIPS\n",
+            names[i], n[i], (unsigned long long)res[i].pc, stat_names[stat[i]], res[i].cc,
+            secs > 0 ? n[i] / secs / 1e6 : 0.0);
+    }
+    printf("%s\n", ok ? "States agree" : "States DIFFER");
+    return ok;
+}
+
+/*
+ * benchmark - print the cycles and CPE of ncopy for every length up to
+ *             BENCHMAX and the mean CPE of lengths 1..BENCHMAX; with -f
+ *             for pipe-full.hcl and with load forwarding side by side
+ */
+static void benchmark(const char *file){
+    long cycles[2], instrs;
+    double sum[2] = { 0, 0 };
+    int len, k, nk = load_fwd && !ooo ? 2 : 1;
+
+    verbose = 0;
+    printf("%5s %8s %8s", "len", "cycles", "CPE");
+    if(load_fwd)
+        printf(" %8s %8s", "fwd", "CPE");
+    printf("\n");
+    for(len = 0; len <= BENCHMAX; len++){
+        for(k = 0; k < nk; k++){
+            load_fwd = k;
+            if(load_file(file, len) < 0)
+                return;
+            ooo ? run_ooo(&cycles[k], &instrs) : run_pipe(&cycles[k], &instrs);
+            check_ncopy(len);
+            if(len > 0)
+                sum[k] += (double)cycles[k] / len;
+        }
+        printf("%5d", len);
+        for(k = 0; k < nk; k++)
+            printf(" %8ld %8.2f", cycles[k], len ? (double)cycles[k] / len : 0.0);
+        printf("\n");
+    }
+    printf("Average CPE %.2f", sum[0] / BENCHMAX);
+    if(nk == 2)
+        printf(", with load forwarding %.2f", sum[1] / BENCHMAX);
+    printf("\n");
+}
+
+/*=========================== GENERATOR ===========================*/
+
+/* Choices of a generated ncopy */
+#define SCHED_BATCH     0       /* all loads, all stores, then the tests */
+#define SCHED_PAIR      1       /* two loads, then store and test each */
+#define SCHED_STREAM    2       /* each load one element ahead */
+#define NSCHED          3
+#define REM_SEARCH      0       /* binary search into the tail chain */
+#define REM_TABLE       1       /* jump table, pushq and ret */
+#define REM_LINEAR      2       /* one test per length into the chain */
+#define REM_LOOP        3       /* a loop of one element */
+#define NREM            4
+#define GEN_MAXUNROLL   16
+#define GEN_MAXBYTES    1000    /* longest ncopy, as check-len.pl */
+#define GEN_BUFSIZE     65536
+
+/* A generated ncopy and its score */
+struct variant {
+    int unroll, sched, rem, store_first;
+    int bytes;
+    double cpe;                     /* < 0: too long */
+};
+
+static const char *sched_names[NSCHED] = { "batch", "pair", "stream" };
+static const char *rem_names[NREM] = { "search", "table", "linear", "loop" };
+static const char *val_regs[10] = {
+    "%rcx", "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%rbx", "%rbp"
+};
+static char gen_buf[GEN_BUFSIZE];
+static size_t gen_len;
+static int gen_labels;              /* labels of the binary search */
+
+static void gen(const char *fmt, ...){
+    va_list ap;
+    va_start(ap, fmt);
+    gen_len += vsnprintf(gen_buf + gen_len, GEN_BUFSIZE - gen_len, fmt, ap);
+    va_end(ap);
+}
+
+/* The code for a tail of r elements: Done, or the chain from LR(r-1) */
+static void gen_entry(char *buf, int r){
+    if(r == 0)
+        strcpy(buf, "Done");
+    else
+        sprintf(buf, "LR%d", r - 1);
+}
+
+static void gen_load(int k){
+    gen("\tmrmovq %d(%%rdi), %s\n", 8 * k, val_regs[k % 10]);
+}
+
+static void gen_store(int k){
+    gen("\trmmovq %s, %d(%%rsi)\n", val_regs[k % 10], 8 * k);
+}
+
+static void gen_test(int k){
+    gen("\tandq %s, %s\n\tjle N%d\n\tiaddq $1, %%rax\nN%d:\n", val_regs[k % 10],
+        val_regs[k % 10], k, k);
+}
+
+/*
+ * gen_search - branch on %rdx = r - off to the entry of each r in
+ *              lo..hi, halving the range with each test
+ */
+static void gen_search(int lo, int hi, int off){
+    char e[16];
+    int mid = (lo + hi + 1) / 2, left = 0;
+
+    if(lo == hi){
+        gen_entry(e, lo);
+        gen("\tjmp %s\n", e);
+        return;
+    }
+    if(off != mid)
+        gen("\tiaddq $%d, %%rdx\n", off - mid);
+    else
+        gen("\tandq %%rdx, %%rdx\n");
+    gen_entry(e, lo);
+    if(mid - 1 == lo)
+        gen("\tjl %s\n", e);
+    else{
+        left = ++gen_labels;
+        gen("\tjl BS%d\n", left);
+    }
+    gen_entry(e, mid);
+    gen(mid == hi ? "\tjmp %s\n" : "\tje %s\n", e);
+    if(mid < hi)
+        gen_search(mid + 1, hi, mid);
+    if(left){
+        gen("BS%d:\n", left);
+        gen_search(lo, mid - 1, mid);
+    }
+}
+
+/*
+ * gen_ncopy - write the ncopy of v into gen_buf
+ */
+static void gen_ncopy(const struct variant *v){
+    int u = v->unroll, k, a, b;
+    char e[16], last[32];
+
+    gen_len = 0;
+    gen_labels = 0;
+    gen("# ncopy: unroll %d, %s schedule, %s tail, %s\n", u, sched_names[v->sched],
+        rem_names[v->rem], v->store_first ? "store first" : "test first");
+    gen("ncopy:\n\tiaddq $%d, %%rdx\n\tjl Rem\nLoop:\n", -u);
+    switch(v->sched){
+        case SCHED_BATCH:
+            for(a = 0; a < u; a = b){
+                b = a + 10 < u ? a + 10 : u;
+                for(k = a; k < b; k++)
+                    gen_load(k);
+                for(k = a; k < b; k++)
+                    gen_store(k);
+                for(k = b - 1; k >= a; k--)
+                    gen_test(k);
+            }
+            break;
+        case SCHED_PAIR:
+            for(k = 0; k < u; k += 2){
+                gen_load(k);
+                if(k + 1 < u)
+                    gen_load(k + 1);
+                gen_store(k);
+                gen_test(k);
+                if(k + 1 < u){
+                    gen_store(k + 1);
+                    gen_test(k + 1);
+                }
+            }
+            break;
+        case SCHED_STREAM:
+            gen_load(0);
+            for(k = 0; k < u; k++){
+                if(k + 1 < u)
+                    gen_load(k + 1);
+                gen_store(k);
+                gen_test(k);
+            }
+            break;
+    }
+    gen("\tiaddq $%d, %%rdi\n\tiaddq $%d, %%rsi\n\tiaddq $%d, %%rdx\n\tjge Loop\nRem:\n",
+        8 * u, 8 * u, -u);
+
+    /* Tail of 0..u-1 elements; %rdx is its length - u */
+    if(u > 1){
+        switch(v->rem){
+            case REM_SEARCH:
+                gen_search(0, u - 1, u);
+                sprintf(last, "\tjmp LR%d\n", u - 2);
+                if(gen_len >= strlen(last) && strcmp(gen_buf + gen_len - strlen(last), last) == 0)
+                    gen_len -= strlen(last);    /* falls into the chain */
+                break;
+            case REM_TABLE:
+                gen("\tiaddq $%d, %%rdx\n\taddq %%rdx, %%rdx\n\taddq %%rdx, %%rdx\n"
+                    "\taddq %%rdx, %%rdx\n\tmrmovq JT(%%rdx), %%rdx\n\tpushq %%rdx\n\tret\n"
+                    "\t.align 8\nJT:\n", u);
+                for(k = 0; k < u; k++){
+                    gen_entry(e, k);
+                    gen("\t.quad %s\n", e);
+                }
+                break;
+            case REM_LINEAR:
+                gen("\tiaddq $%d, %%rdx\n\tje Done\n", u);
+                for(k = 1; k < u - 1; k++){
+                    gen_entry(e, k);
+                    gen("\tiaddq $-1, %%rdx\n\tje %s\n", e);
+                }
+                break;
+            case REM_LOOP:
+                gen("\tiaddq $%d, %%rdx\n\tjle Done\nRL:\n\tmrmovq (%%rdi), %%rcx\n"
+                    "\tiaddq $8, %%rdi\n\trmmovq %%rcx, (%%rsi)\n\tiaddq $8, %%rsi\n"
+                    "\tandq %%rcx, %%rcx\n\tjle RN\n\tiaddq $1, %%rax\n"
+                    "RN:\n\tiaddq $-1, %%rdx\n\tjg RL\n", u);
+                break;
+        }
+        for(k = u - 2; k >= 0 && v->rem != REM_LOOP; k--){
+            gen_entry(e, k);
+            gen("LR%d:\n", k);
+            gen_load(k);
+            if(v->store_first)
+                gen_store(k);
+            gen("\tandq %s, %s\n", val_regs[k % 10], val_regs[k % 10]);
+            if(!v->store_first)
+                gen_store(k);
+            gen("\tjle %s\n\tiaddq $1, %%rax\n", e);
+        }
+    }
+    gen("Done:\n\tret\nEnd:\n");
+}
+
+/*
+ * gen_score - the mean CPE of gen_buf over lengths 1..BENCHMAX on the
+ *             processor configured, *bytes its length; exit if wrong
+ */
+static double gen_score(const struct variant *v, int *bytes){
+    long cycles, instrs;
+    double sum = 0;
+    int len;
+
+    for(len = 0; len <= BENCHMAX; len++){
+        if(load_ncopy(gen_buf, len) < 0 || (ooo ? run_ooo(&cycles, &instrs)
+           : run_pipe(&cycles, &instrs)) != STAT_HLT || !check_ncopy(len)){
+            fprintf(stderr, "unroll %d %s %s: wrong at len %d\n", v->unroll,
+                sched_names[v->sched], rem_names[v->rem], len);
+            exit(1);
+        }
+        if(len == 0)
+            *bytes = (int)(label_addr("EndFun") - label_addr("StartFun"));
+        else
+            sum += (double)cycles / len;
+    }
+    return sum / BENCHMAX;
+}
+
+static int cmp_cpe(const void *a, const void *b){
+    const struct variant *x = a, *y = b;
+    if((x->cpe < 0) != (y->cpe < 0))
+        return x->cpe < 0 ? 1 : -1;
+    return x->cpe < y->cpe ? -1 : x->cpe > y->cpe;
+}
+
+/*
+ * generate - score every ncopy variant on the processor configured,
+ *            print the best and write the best into file
+ */
+static void generate(const char *file){
+    static struct variant vs[GEN_MAXUNROLL * NSCHED * NREM * 2];
+    struct variant *v;
+    FILE *fp;
+    int n = 0, i, u, s, r, f, toolong = 0;
+
+    verbose = 0;
+    for(u = 1; u <= GEN_MAXUNROLL; u++)
+        for(s = 0; s < NSCHED; s++)
+            for(r = 0; r < NREM; r++)
+                for(f = 0; f < 2; f++){
+                    if(u == 1 && (s || r || f))
+                        continue;       /* no tail to dispatch */
+                    if(r == REM_LOOP && f)
+                        continue;
+                    v = &vs[n++];
+                    v->unroll = u;
+                    v->sched = s;
+                    v->rem = r;
+                    v->store_first = f;
+                    gen_ncopy(v);
+                    v->cpe = gen_score(v, &v->bytes);
+                    if(v->bytes > GEN_MAXBYTES){
+                        v->cpe = -1;
+                        toolong++;
+                    }
+                }
+    qsort(vs, n, sizeof(vs[0]), cmp_cpe);
+
+    printf("%d variants scored on %s, predictor %s%s%s; %d over %d bytes\n", n,
+        ooo ? "the out-of-order model" : "PIPE", pred_names[predictor],
+        use_ras ? " + RAS" : "", load_fwd ? ", load forwarding" : "", toolong, GEN_MAXBYTES);
+    printf("%4s %6s %-8s %-8s %-12s %6s %8s\n", "rank", "unroll", "schedule", "tail",
+        "tail order", "bytes", "CPE");
+    for(i = 0; i < n && i < 10 && vs[i].cpe >= 0; i++)
+        printf("%4d %6d %-8s %-8s %-12s %6d %8.2f\n", i + 1, vs[i].unroll,
+            sched_names[vs[i].sched], rem_names[vs[i].rem],
+            vs[i].store_first ? "store first" : "test first", vs[i].bytes, vs[i].cpe);
+
+    gen_ncopy(&vs[0]);
+    if((fp = fopen(file, "w")) == NULL){
+        fprintf(stderr, "%s: cannot open\n", file);
+        exit(1);
+    }
+    fprintf(fp, "# Generated by y86sim -g: average CPE %.2f, %d bytes\n%s",
+        vs[0].cpe, vs[0].bytes, gen_buf);
+    fclose(fp);
+    printf("Best written to %s\n", file);
+}
+
+/*=========================== FUZZ ===========================*/
+
+#define FUZZ_MAXINSTRS  64      /* instructions of a random program */
+#define FUZZ_STEPS      4000    /* SEQ steps a case must stop within */
+#define FUZZ_CODE       0x400   /* code below, stores there discard a case */
+#define FUZZ_DATA       0x1000  /* %rbp at start */
+#define FUZZ_STACK      0x1800  /* %rsp at start */
+#define FUZZ_MAXFAIL    3       /* failures minimized and written per worker */
+
+/* An instruction of a random program; a jump or call targets an index */
+struct ginstr {
+    int icode, ifun, rA, rB, target;
+    uint64_t valC;
+};
+
+/* Counts a worker reports */
+struct fuzz_count {
+    long cases, skipped, failed;
+};
+
+static uint64_t rng;
+
+static uint64_t rnd(void){
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+/* A register, %rsp and %rbp (the stack and data pointers) rarely */
+static int rnd_reg(void){
+    int r = (int)(rnd() % 16);
+    if((r == REG_RSP || r == 5) && rnd() % 4)
+        r = (int)(rnd() % 4);
+    return r == REG_NONE && rnd() % 4 ? 0 : r;
+}
+
+static uint64_t rnd_value(void){
+    static const uint64_t edges[6] = {
+        0, 1, (uint64_t)-1, 0x7fffffffffffffffULL, 0x8000000000000000ULL, 8
+    };
+    return rnd() % 2 ? edges[rnd() % 6] : rnd() % 3 ? rnd() % 64 - 32 : rnd();
+}
+
+static int fuzz_size(const struct ginstr *g){
+    switch(g->icode){
+        case I_RRMOVQ: case I_ALU: case I_PUSHQ: case I_POPQ: return 2;
+        case I_IRMOVQ: case I_RMMOVQ: case I_MRMOVQ: case I_IADDQ: return 10;
+        case I_JMP: case I_CALL: return 9;
+    }
+    return 1;
+}
+
+/*
+ * fuzz_program - fill prog with a random program of n instructions:
+ *                pointers and registers set up, then every kind of
+ *                instruction, ending in halt; return n
+ */
+static int fuzz_program(struct ginstr *prog){
+    int n = 8 + (int)(rnd() % (FUZZ_MAXINSTRS - 8)), i, k;
+    struct ginstr *g;
+
+    memset(prog, 0, n * sizeof(*prog));
+    for(i = 0; i < n - 1; i++){
+        g = &prog[i];
+        g->rA = g->rB = REG_NONE;
+        g->target = -1;
+        k = (int)(rnd() % 100);
+        if(i < 2){
+            g->icode = I_IRMOVQ;
+            g->rB = i ? 5 : REG_RSP;
+            g->valC = i ? FUZZ_DATA : FUZZ_STACK;
+        }
+        else if(k < 20){
+            g->icode = I_ALU;
+            g->ifun = rnd() % 50 ? (int)(rnd() % 4) : 4 + (int)(rnd() % 12);
+            g->rA = rnd_reg();
+            g->rB = rnd_reg();
+        }
+        else if(k < 28){
+            g->icode = I_IADDQ;
+            g->rB = rnd_reg();
+            g->valC = rnd_value();
+        }
+        else if(k < 36){
+            g->icode = I_IRMOVQ;
+            g->rB = rnd_reg();
+            g->valC = rnd_value();
+        }
+        else if(k < 44){
+            g->icode = I_RRMOVQ;
+            g->ifun = (int)(rnd() % 7);
+            g->rA = rnd_reg();
+            g->rB = rnd_reg();
+        }
+        else if(k < 60){
+            g->icode = rnd() % 2 ? I_MRMOVQ : I_RMMOVQ;
+            g->rA = rnd_reg();
+            g->rB = rnd() % 8 ? 5 : rnd() % 2 ? REG_RSP : rnd_reg();
+            g->valC = 8 * (rnd() % 32) + (rnd() % 16 ? 0 : rnd() % 8);
+            if(rnd() % 32 == 0)
+                g->valC = rnd_value();
+        }
+        else if(k < 68){
+            g->icode = rnd() % 2 ? I_PUSHQ : I_POPQ;
+            g->rA = rnd_reg();
+        }
+        else if(k < 82){
+            g->icode = I_JMP;
+            g->ifun = (int)(rnd() % 7);
+            g->target = i + 1 + (int)(rnd() % (n - i)) - (rnd() % 4 ? 0 : (int)(rnd() % 8));
+            g->target = g->target < 0 ? 0 : g->target;
+        }
+        else if(k < 88){
+            g->icode = I_CALL;
+            g->target = i + 1 + (int)(rnd() % (n - i));
+        }
+        else if(k < 93)
+            g->icode = I_RET;
+        else if(k < 97)
+            g->icode = I_NOP;
+        else
+            g->icode = rnd() % 2 ? I_HALT : 0xD + (int)(rnd() % 3);
+    }
+    prog[n - 1].icode = I_HALT;
+    prog[n - 1].target = -1;
+    return n;
+}
+
+/*
+ * fuzz_load - encode prog into the memory of st and init; jumps past
+ *             the end land on the zero bytes after it, a halt
+ */
+static void fuzz_load(const struct ginstr *prog, int n){
+    uint64_t addr[FUZZ_MAXINSTRS + 1], a = 0;
+    const struct ginstr *g;
+    int i;
+
+    for(i = 0; i <= n; i++){
+        addr[i] = a;
+        if(i < n)
+            a += fuzz_size(&prog[i]);
+    }
+    memset(&st, 0, sizeof(st));
+    st.cc = DEFAULT_CC;
+    for(i = 0; i < n; i++){
+        g = &prog[i];
+        a = addr[i];
+        st.mem[a] = (unsigned char)(g->icode << 4 | g->ifun);
+        if(fuzz_size(g) == 2 || fuzz_size(g) == 10)
+            st.mem[a + 1] = (unsigned char)(g->rA << 4 | g->rB);
+        if(fuzz_size(g) >= 9)
+            set_quad(&st, a + fuzz_size(g) - 8, g->target >= 0 ? addr[g->target] : g->valC);
+    }
+    init = st;
+}
+
+/*
+ * fuzz_case - run prog on SEQ, then PIPE, the fast mode and the JIT;
+ *             return a mask of those (1, 2, 4) whose state differs from
+ *             SEQ's, or -1 when SEQ does not stop or writes to the code
+ */
+static int fuzz_case(const struct ginstr *prog, int n){
+    static struct state ref;
+    long steps, k, cycles;
+    int i, stat, refstat, mask = 0;
+
+    fuzz_load(prog, n);
+    maxcycles = FUZZ_STEPS;
+    refstat = run_seq(&steps);
+    if(refstat == STAT_AOK || memcmp(st.mem, init.mem, FUZZ_CODE))
+        return -1;
+    ref = st;
+    maxcycles = 16 * FUZZ_STEPS;    /* cycles on PIPE */
+    for(i = 0; i < 3; i++){
+        st = init;
+        if(i == 0)
+            stat = run_pipe(&cycles, &k);
+        else if(i == 1)
+            stat = run_fast(&k);
+        else
+            stat = run_jit(&k);
+        if(stat != refstat || k != steps || st.pc != ref.pc || st.cc != ref.cc
+           || memcmp(st.reg, ref.reg, sizeof(st.reg)) || memcmp(st.mem, ref.mem, MEMSIZE))
+            mask |= 1 << i;
+    }
+    return mask;
+}
+
+/* A random PIPE configuration, so every feature is covered */
+static void fuzz_config(void){
+    predictor = (int)(rnd() % NPRED);
+    use_ras = (int)(rnd() % 2);
+    load_fwd = (int)(rnd() % 2);
+    l1i.sets = l1d.sets = 0;
+    if(rnd() % 2){
+        l1i.size = l1d.size = 64 << (rnd() % 3);
+        l1i.ways = l1d.ways = 1 << (rnd() % 3);
+        l1i.block = l1d.block = 8;
+        l1i.penalty = 1 + (int)(rnd() % 8);
+        l1d.penalty = 1 + (int)(rnd() % 8);
+        l1i.sets = l1d.sets = l1i.size / l1i.block / l1i.ways;
+    }
+}
+
+/*
+ * fuzz_minimize - drop every instruction whose removal keeps prog
+ *                 failing, until none can go; return the new length
+ */
+static int fuzz_minimize(struct ginstr *prog, int n){
+    struct ginstr save[FUZZ_MAXINSTRS];
+    int i, j, changed = 1;
+
+    while(changed){
+        changed = 0;
+        for(i = n - 2; i >= 0; i--){    /* keep the final halt */
+            memcpy(save, prog, n * sizeof(*prog));
+            memmove(&prog[i], &prog[i + 1], (n - i - 1) * sizeof(*prog));
+            for(j = 0; j < n - 1; j++)
+                if(prog[j].target > i)
+                    prog[j].target--;
+            if(fuzz_case(prog, n - 1) > 0){
+                n--;
+                changed = 1;
+            }
+            else
+                memcpy(prog, save, n * sizeof(*prog));
+        }
+    }
+    return n;
+}
+
+/*
+ * fuzz_write - write prog as a .ys file, with the options that fail it
+ */
+static void fuzz_write(const char *file, const struct ginstr *prog, int n, long seed, int mask){
+    static const char *names[3] = { "PIPE", "fast", "JIT" };
+    char text[64];
+    uint64_t a = 0;
+    FILE *fp = fopen(file, "w");
+    int i, j;
+
+    if(fp == NULL){
+        fprintf(stderr, "%s: cannot open\n", file);
+        return;
+    }
+    fuzz_load(prog, n);
+    fprintf(fp, "# Case %ld: differs from SEQ on", seed);
+    for(i = 0; i < 3; i++)
+        if(mask & (1 << i))
+            fprintf(fp, " %s", names[i]);
+    fprintf(fp, "\n# PIPE options: -P %s%s%s", pred_names[predictor], use_ras ? " -r" : "",
+        load_fwd ? " -f" : "");
+    if(l1i.sets)
+        fprintf(fp, " -I %d,%d,%d,%d -D %d,%d,%d,%d", l1i.size, l1i.ways, l1i.block,
+            l1i.penalty, l1d.size, l1d.ways, l1d.block, l1d.penalty);
+    fprintf(fp, "\n\t.pos 0\n");
+    for(i = 0; i < n; a += fuzz_size(&prog[i++])){
+        disasm(&init, a, text);
+        if(strcmp(text, "(bad)") == 0){
+            fprintf(fp, "\t.byte");
+            for(j = 0; j < fuzz_size(&prog[i]); j++)
+                fprintf(fp, "%s0x%02x", j ? ", " : " ", init.mem[a + j]);
+            fprintf(fp, "\t# 0x%03llx\n", (unsigned long long)a);
+        }
+        else
+            fprintf(fp, "\t%s\t# 0x%03llx\n", text, (unsigned long long)a);
+    }
+    fclose(fp);
+}
+
+/*
+ * fuzz - run cases random programs on all cores, each on SEQ, PIPE (in a
+ *        random configuration), the fast mode and the JIT; minimize the
+ *        first failures of each worker into prefix-<worker>-<k>.ys
+ */
+static void fuzz(long cases, const char *prefix){
+    struct ginstr prog[FUZZ_MAXINSTRS];
+    struct fuzz_count c, total = { 0, 0, 0 };
+    int nworkers = (int)sysconf(_SC_NPROCESSORS_ONLN), fd[2], w, n, mask;
+    char file[MAXLINE];
+    long seed;
+    pid_t pid;
+    time_t t0 = time(NULL);
+
+    verbose = 0;
+    if(nworkers < 1)
+        nworkers = 1;
+    if(pipe(fd) < 0){
+        perror("pipe");
+        exit(1);
+    }
+    fflush(stdout);
+    for(w = 0; w < nworkers; w++){
+        if((pid = fork()) < 0){
+            perror("fork");
+            exit(1);
+        }
+        if(pid > 0)
+            continue;
+        close(fd[0]);
+        memset(&c, 0, sizeof(c));
+        for(seed = w; seed < cases; seed += nworkers){
+            rng = 0x9E3779B97F4A7C15ULL * (uint64_t)(seed + 1);
+            fuzz_config();
+            n = fuzz_program(prog);
+            c.cases++;
+            if((mask = fuzz_case(prog, n)) < 0)
+                c.skipped++;
+            else if(mask > 0 && c.failed++ < FUZZ_MAXFAIL){
+                n = fuzz_minimize(prog, n);
+                snprintf(file, sizeof(file), "%s-%d-%ld.ys", prefix, w, c.failed);
+                fuzz_write(file, prog, n, seed, fuzz_case(prog, n));
+                printf("case %ld differs, minimized to %d instructions in %s\n",
+                    seed, n, file);
+                fflush(stdout);
+            }
+        }
+        if(write(fd[1], &c, sizeof(c)) != sizeof(c))
+            _exit(1);
+        _exit(0);
+    }
+    close(fd[1]);
+    while(read(fd[0], &c, sizeof(c)) == sizeof(c)){
+        total.cases += c.cases;
+        total.skipped += c.skipped;
+        total.failed += c.failed;
+    }
+    while(wait(NULL) > 0)
+        ;
+    printf("%ld cases on %d workers in %ld s: %ld compared, %ld skipped "
+        "(no halt in %d steps or a store into code), %ld differ\n", total.cases, nworkers,
+        (long)(time(NULL) - t0), total.cases - total.skipped, total.skipped, FUZZ_STEPS,
+        total.failed);
+}